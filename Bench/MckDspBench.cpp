@@ -0,0 +1,511 @@
+#include "DelayModule.hpp"
+#include "FeedbackDelayNetwork.hpp"
+#include "LongDelay.hpp"
+#include "MultiChannelDelay.hpp"
+#include "MultiTapDelay.hpp"
+#include "OnePoleFilter.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        size_t samplesPerCase{1 << 20};
+        bool csv{false};
+    };
+
+    struct Result
+    {
+        double nsPerSample{0.0};
+        double samplesPerSecond{0.0};
+    };
+
+    enum class FilterSetup
+    {
+        None,
+        LowPass,
+        HighPass,
+        Both
+    };
+
+    const char *filterName(FilterSetup f)
+    {
+        switch (f)
+        {
+        case FilterSetup::LowPass:
+            return "lp";
+        case FilterSetup::HighPass:
+            return "hp";
+        case FilterSetup::Both:
+            return "lp+hp";
+        default:
+            return "none";
+        }
+    }
+
+    const char *interpolationName(MckDsp::Interpolation mode)
+    {
+        switch (mode)
+        {
+        case MckDsp::Interpolation::Linear:
+            return "linear";
+        case MckDsp::Interpolation::Lagrange:
+            return "lagrange";
+        case MckDsp::Interpolation::Hermite:
+            return "hermite";
+        case MckDsp::Interpolation::Allpass:
+            return "allpass";
+        default:
+            return "none";
+        }
+    }
+
+    // Keeps the optimizer from discarding the processed samples
+    volatile double g_sink{0.0};
+
+    template <typename SampleType>
+    std::vector<SampleType> makeNoise(size_t len)
+    {
+        std::vector<SampleType> noise(len);
+        uint32_t state = 0x12345678u;
+        for (auto &s : noise)
+        {
+            state = state * 1664525u + 1013904223u;
+            s = static_cast<SampleType>(static_cast<double>(state) / 2147483648.0 - 1.0);
+        }
+        return noise;
+    }
+
+    template <typename Func>
+    Result measure(size_t numSamples, Func &&func)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto stop = std::chrono::steady_clock::now();
+
+        double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+        Result res;
+        res.nsPerSample = ns / static_cast<double>(numSamples);
+        res.samplesPerSecond = res.nsPerSample > 0.0 ? 1e9 / res.nsPerSample : 0.0;
+        return res;
+    }
+
+    template <typename Delay>
+    void setupDelay(Delay &dly, double delayInMs, FilterSetup filter)
+    {
+        dly.setDelayInMs(delayInMs);
+        dly.setFeedback(0.5);
+        dly.setMix(0.5);
+        dly.setLowPass(filter == FilterSetup::LowPass || filter == FilterSetup::Both, 5000.0);
+        dly.setHighPass(filter == FilterSetup::HighPass || filter == FilterSetup::Both, 100.0);
+    }
+
+    void printHeader(const Options &opt)
+    {
+        if (opt.csv)
+        {
+            std::printf("kernel,type,channels,block,rate,delay_ms,filter,ns_per_sample,samples_per_second\n");
+        }
+        else
+        {
+            std::printf("%-40s %6s %3s %6s %8s %8s %7s %12s %16s\n", "kernel", "type", "ch", "block", "rate", "delay", "filter", "ns/sample", "samples/s");
+        }
+    }
+
+    template <typename SampleType>
+    const char *typeName();
+
+    template <>
+    const char *typeName<float>() { return "float"; }
+
+    template <>
+    const char *typeName<double>() { return "double"; }
+
+    template <typename SampleType>
+    void printResult(const Options &opt, const char *kernel, int numChannels, int blockSize, double sampleRate, double delayInMs, const char *filter, const Result &res)
+    {
+        if (opt.csv)
+        {
+            std::printf("%s,%s,%d,%d,%.0f,%.0f,%s,%.4f,%.0f\n", kernel, typeName<SampleType>(), numChannels, blockSize, sampleRate, delayInMs, filter, res.nsPerSample, res.samplesPerSecond);
+        }
+        else
+        {
+            std::printf("%-40s %6s %3d %6d %8.0f %8.0f %7s %12.4f %16.0f\n", kernel, typeName<SampleType>(), numChannels, blockSize, sampleRate, delayInMs, filter, res.nsPerSample, res.samplesPerSecond);
+        }
+    }
+
+    Options parseArgs(int argc, char **argv)
+    {
+        Options opt;
+        for (int i = 1; i < argc; i++)
+        {
+            if (std::strcmp(argv[i], "--csv") == 0)
+            {
+                opt.csv = true;
+            }
+            else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            {
+                opt.samplesPerCase = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+            }
+            else
+            {
+                std::fprintf(stderr, "Usage: %s [--csv] [--samples <samples per case>]\n", argv[0]);
+                std::exit(1);
+            }
+        }
+        return opt;
+    }
+
+    const int blockSizes[] = {16, 64, 256, 1024, 4096};
+    const double sampleRates[] = {44100.0, 48000.0, 96000.0, 192000.0};
+    const double delays[] = {10.0, 250.0, 1000.0};
+    const FilterSetup filters[] = {FilterSetup::None, FilterSetup::LowPass, FilterSetup::HighPass, FilterSetup::Both};
+
+    template <typename SampleType>
+    void runBenchmarks(const Options &opt, double sampleRate)
+    {
+        const auto noise = makeNoise<SampleType>(blockSizes[4]);
+        std::vector<SampleType> out(noise.size(), SampleType(0));
+
+        for (auto blockSize : blockSizes)
+        {
+            // Round up to whole blocks so every kernel sees the same amount of work
+            const size_t numBlocks = (opt.samplesPerCase + blockSize - 1) / blockSize;
+            const size_t numSamples = numBlocks * blockSize;
+
+            for (auto delayInMs : delays)
+            {
+                for (auto filter : filters)
+                {
+                    MckDsp::DelayModule<SampleType> dly;
+                    dly.prepareToPlay(sampleRate, blockSize);
+                    setupDelay(dly, delayInMs, filter);
+                    auto res = measure(numSamples, [&]
+                                       {
+                        double acc = 0.0;
+                        for (size_t b = 0; b < numBlocks; b++)
+                        {
+                            for (int s = 0; s < blockSize; s++)
+                            {
+                                acc += dly.processSample(noise[s]);
+                            }
+                        }
+                        g_sink = acc; });
+                    printResult<SampleType>(opt, "DelayModule::processSample", 1, blockSize, sampleRate, delayInMs, filterName(filter), res);
+
+                    setupDelay(dly, delayInMs, filter);
+                    res = measure(numSamples, [&]
+                                  {
+                        for (size_t b = 0; b < numBlocks; b++)
+                        {
+                            dly.processBlock(noise.data(), out.data(), blockSize);
+                        }
+                        g_sink = out[blockSize - 1]; });
+                    printResult<SampleType>(opt, "DelayModule::processBlock", 1, blockSize, sampleRate, delayInMs, filterName(filter), res);
+
+                    for (int numChannels : {1, 2, 4, 8})
+                    {
+                        MckDsp::MultiChannelDelay<SampleType> multi;
+                        multi.prepareToPlay(sampleRate, blockSize, numChannels);
+                        setupDelay(multi, delayInMs, filter);
+
+                        std::vector<const SampleType *> readPtrs(numChannels, noise.data());
+                        std::vector<std::vector<SampleType>> outs(numChannels, std::vector<SampleType>(blockSize));
+                        std::vector<SampleType *> writePtrs;
+                        for (auto &o : outs)
+                        {
+                            writePtrs.push_back(o.data());
+                        }
+
+                        // Reported per channel sample to be comparable with the mono kernels
+                        res = measure(numSamples * numChannels, [&]
+                                      {
+                            for (size_t b = 0; b < numBlocks; b++)
+                            {
+                                multi.processBlock(readPtrs.data(), writePtrs.data(), blockSize);
+                            }
+                            g_sink = outs[0][blockSize - 1]; });
+                        printResult<SampleType>(opt, "MultiChannelDelay::processBlock", numChannels, blockSize, sampleRate, delayInMs, filterName(filter), res);
+                    }
+                }
+            }
+        }
+
+        // Cost of the fractional read modes at a typical block size and a delay between samples
+        {
+            const int blockSize = 256;
+            const double delayInMs = 250.01;
+            const size_t numBlocks = (opt.samplesPerCase + blockSize - 1) / blockSize;
+            const size_t numSamples = numBlocks * blockSize;
+
+            for (auto mode : {MckDsp::Interpolation::None, MckDsp::Interpolation::Linear, MckDsp::Interpolation::Lagrange,
+                              MckDsp::Interpolation::Hermite, MckDsp::Interpolation::Allpass})
+            {
+                const std::string suffix = std::string(":") + interpolationName(mode);
+
+                MckDsp::DelayModule<SampleType> dly;
+                dly.prepareToPlay(sampleRate, blockSize);
+                dly.setInterpolation(mode);
+                setupDelay(dly, delayInMs, FilterSetup::None);
+                auto res = measure(numSamples, [&]
+                                   {
+                    for (size_t b = 0; b < numBlocks; b++)
+                    {
+                        dly.processBlock(noise.data(), out.data(), blockSize);
+                    }
+                    g_sink = out[blockSize - 1]; });
+                printResult<SampleType>(opt, ("DelayModule::processBlock" + suffix).c_str(), 1, blockSize, sampleRate, delayInMs, "none", res);
+
+                const int numChannels = 2;
+                MckDsp::MultiChannelDelay<SampleType> multi;
+                multi.prepareToPlay(sampleRate, blockSize, numChannels);
+                multi.setInterpolation(mode);
+                setupDelay(multi, delayInMs, FilterSetup::None);
+
+                std::vector<const SampleType *> readPtrs(numChannels, noise.data());
+                std::vector<std::vector<SampleType>> outs(numChannels, std::vector<SampleType>(blockSize));
+                std::vector<SampleType *> writePtrs{outs[0].data(), outs[1].data()};
+                res = measure(numSamples * numChannels, [&]
+                              {
+                    for (size_t b = 0; b < numBlocks; b++)
+                    {
+                        multi.processBlock(readPtrs.data(), writePtrs.data(), blockSize);
+                    }
+                    g_sink = outs[0][blockSize - 1]; });
+                printResult<SampleType>(opt, ("MultiChannelDelay::processBlock" + suffix).c_str(), numChannels, blockSize, sampleRate, delayInMs, "none", res);
+            }
+        }
+
+        // Stereo multi-tap line, the taps spread evenly across the delay range
+        {
+            const int blockSize = 256;
+            const int numChannels = 2;
+            const size_t numBlocks = (opt.samplesPerCase + blockSize - 1) / blockSize;
+            const size_t numSamples = numBlocks * blockSize;
+
+            for (int numTaps : {1, 4, 8, 16})
+            {
+                MckDsp::MultiTapDelay<SampleType> multi;
+                multi.prepareToPlay(sampleRate, blockSize, numChannels);
+                multi.setFeedback(0.5);
+                multi.setMix(0.5);
+                multi.setNumTaps(numTaps);
+                for (int t = 0; t < numTaps; t++)
+                {
+                    MckDsp::DelayTap tap;
+                    tap.timeInMs = 1000.0 * (t + 1) / numTaps;
+                    tap.gain = 1.0 / numTaps;
+                    tap.pan = numTaps > 1 ? -1.0 + 2.0 * t / (numTaps - 1) : 0.0;
+                    multi.setTap(t, tap);
+                }
+
+                std::vector<const SampleType *> readPtrs(numChannels, noise.data());
+                std::vector<std::vector<SampleType>> outs(numChannels, std::vector<SampleType>(blockSize));
+                std::vector<SampleType *> writePtrs{outs[0].data(), outs[1].data()};
+                auto res = measure(numSamples * numChannels, [&]
+                                   {
+                    for (size_t b = 0; b < numBlocks; b++)
+                    {
+                        multi.processBlock(readPtrs.data(), writePtrs.data(), blockSize);
+                    }
+                    g_sink = outs[0][blockSize - 1]; });
+                const std::string kernel = "MultiTapDelay::processBlock:" + std::to_string(numTaps) + "taps";
+                printResult<SampleType>(opt, kernel.c_str(), numChannels, blockSize, sampleRate, 1000.0, "none", res);
+            }
+        }
+
+        // Stereo long line in every storage format, the decode and encode cost per block
+        {
+            const int blockSize = 256;
+            const int numChannels = 2;
+            const double delayInMs = 10000.0;
+            const size_t numBlocks = (opt.samplesPerCase + blockSize - 1) / blockSize;
+            const size_t numSamples = numBlocks * blockSize;
+
+            for (auto format : {MckDsp::SampleFormat::Float32, MckDsp::SampleFormat::Pcm24, MckDsp::SampleFormat::Pcm16})
+            {
+                MckDsp::LongDelay<SampleType> longDelay;
+                longDelay.setFormat(format);
+                longDelay.setMaxDelayInMs(delayInMs);
+                longDelay.prepareToPlay(sampleRate, blockSize, numChannels);
+                longDelay.setFeedback(0.5);
+                longDelay.setMix(0.5);
+                longDelay.setInterpolation(MckDsp::Interpolation::Linear);
+                longDelay.setDelayInMs(delayInMs);
+
+                std::vector<const SampleType *> readPtrs(numChannels, noise.data());
+                std::vector<std::vector<SampleType>> outs(numChannels, std::vector<SampleType>(blockSize));
+                std::vector<SampleType *> writePtrs{outs[0].data(), outs[1].data()};
+                auto res = measure(numSamples * numChannels, [&]
+                                   {
+                    for (size_t b = 0; b < numBlocks; b++)
+                    {
+                        longDelay.processBlock(readPtrs.data(), writePtrs.data(), blockSize);
+                    }
+                    g_sink = outs[0][blockSize - 1]; });
+                const char *formatName = format == MckDsp::SampleFormat::Float32 ? "float32" : (format == MckDsp::SampleFormat::Pcm24 ? "pcm24" : "pcm16");
+                const std::string kernel = std::string("LongDelay::processBlock:") + formatName;
+                printResult<SampleType>(opt, kernel.c_str(), numChannels, blockSize, sampleRate, delayInMs, "none", res);
+            }
+        }
+
+        // Stereo FDN for every line count with damping, the cost of the gathers and the Hadamard mix
+        {
+            const int blockSize = 256;
+            const int numChannels = 2;
+            const double delayInMs = 100.0;
+            const size_t numBlocks = (opt.samplesPerCase + blockSize - 1) / blockSize;
+            const size_t numSamples = numBlocks * blockSize;
+
+            for (int numLines : {4, 8, 16})
+            {
+                MckDsp::FeedbackDelayNetwork<SampleType> fdn;
+                fdn.setMaxNumLines(numLines);
+                fdn.prepareToPlay(sampleRate, blockSize, numChannels);
+                fdn.setNumLines(numLines);
+                fdn.setFeedback(0.8);
+                fdn.setMix(0.5);
+                fdn.setLowPass(true, 5000.0);
+                fdn.setDelayInMs(delayInMs);
+
+                std::vector<const SampleType *> readPtrs(numChannels, noise.data());
+                std::vector<std::vector<SampleType>> outs(numChannels, std::vector<SampleType>(blockSize));
+                std::vector<SampleType *> writePtrs{outs[0].data(), outs[1].data()};
+                auto res = measure(numSamples * numChannels, [&]
+                                   {
+                    for (size_t b = 0; b < numBlocks; b++)
+                    {
+                        fdn.processBlock(readPtrs.data(), writePtrs.data(), blockSize);
+                    }
+                    g_sink = outs[0][blockSize - 1]; });
+                const std::string kernel = "FeedbackDelayNetwork::processBlock:" + std::to_string(numLines) + "lines";
+                printResult<SampleType>(opt, kernel.c_str(), numChannels, blockSize, sampleRate, delayInMs, filterName(FilterSetup::LowPass), res);
+            }
+        }
+
+        // Stereo chorus, every sample of every channel reads from its own modulated position
+        {
+            const int blockSize = 256;
+            const int numChannels = 2;
+            const double delayInMs = 15.0;
+            const size_t numBlocks = (opt.samplesPerCase + blockSize - 1) / blockSize;
+            const size_t numSamples = numBlocks * blockSize;
+
+            for (auto mode : {MckDsp::Interpolation::Linear, MckDsp::Interpolation::Hermite})
+            {
+                for (auto shape : {MckDsp::LfoShape::Sine, MckDsp::LfoShape::Triangle, MckDsp::LfoShape::Random})
+                {
+                    MckDsp::MultiChannelDelay<SampleType> multi;
+                    multi.prepareToPlay(sampleRate, blockSize, numChannels);
+                    multi.setInterpolation(mode);
+                    setupDelay(multi, delayInMs, FilterSetup::None);
+                    multi.setModulation(shape, 0.8, 3.0, 0.0, 0.25);
+
+                    std::vector<const SampleType *> readPtrs(numChannels, noise.data());
+                    std::vector<std::vector<SampleType>> outs(numChannels, std::vector<SampleType>(blockSize));
+                    std::vector<SampleType *> writePtrs{outs[0].data(), outs[1].data()};
+                    auto res = measure(numSamples * numChannels, [&]
+                                       {
+                        for (size_t b = 0; b < numBlocks; b++)
+                        {
+                            multi.processBlock(readPtrs.data(), writePtrs.data(), blockSize);
+                        }
+                        g_sink = outs[0][blockSize - 1]; });
+                    const char *shapeName = shape == MckDsp::LfoShape::Sine ? "sine" : (shape == MckDsp::LfoShape::Triangle ? "triangle" : "random");
+                    const std::string kernel = std::string("MultiChannelDelay::processBlock:mod:") + interpolationName(mode) + ":" + shapeName;
+                    printResult<SampleType>(opt, kernel.c_str(), numChannels, blockSize, sampleRate, delayInMs, "none", res);
+                }
+            }
+        }
+
+        // Convolution in the feedback path, the cost per sample grows with the partitions of the response
+        {
+            const int blockSize = 256;
+            const int numChannels = 2;
+            const double delayInMs = 250.0;
+            const size_t numBlocks = (opt.samplesPerCase + blockSize - 1) / blockSize;
+            const size_t numSamples = numBlocks * blockSize;
+
+            for (size_t irLength : {256, 4096, 65536})
+            {
+                std::vector<float> ir(irLength);
+                for (size_t i = 0; i < irLength; i++)
+                {
+                    ir[i] = static_cast<float>(noise[i % noise.size()]) * std::exp(-6.0f * static_cast<float>(i) / static_cast<float>(irLength)) / 64.0f;
+                }
+
+                MckDsp::MultiChannelDelay<SampleType> multi;
+                multi.prepareToPlay(sampleRate, blockSize, numChannels);
+                multi.setInterpolation(MckDsp::Interpolation::Linear);
+                setupDelay(multi, delayInMs, FilterSetup::None);
+                multi.setImpulseResponse(ir.data(), ir.size());
+                multi.setConvolution(true);
+
+                std::vector<const SampleType *> readPtrs(numChannels, noise.data());
+                std::vector<std::vector<SampleType>> outs(numChannels, std::vector<SampleType>(blockSize));
+                std::vector<SampleType *> writePtrs{outs[0].data(), outs[1].data()};
+                auto res = measure(numSamples * numChannels, [&]
+                                   {
+                    for (size_t b = 0; b < numBlocks; b++)
+                    {
+                        multi.processBlock(readPtrs.data(), writePtrs.data(), blockSize);
+                    }
+                    g_sink = outs[0][blockSize - 1]; });
+                const std::string kernel = std::string("MultiChannelDelay::processBlock:conv:") + std::to_string(irLength);
+                printResult<SampleType>(opt, kernel.c_str(), numChannels, blockSize, sampleRate, delayInMs, "none", res);
+            }
+        }
+
+        const size_t numSamples = ((opt.samplesPerCase + noise.size() - 1) / noise.size()) * noise.size();
+        for (auto filter : {FilterSetup::None, FilterSetup::LowPass, FilterSetup::HighPass})
+        {
+            MckDsp::OnePoleFilter<SampleType> flt;
+            flt.prepareToPlay(sampleRate, static_cast<int>(noise.size()));
+            if (filter == FilterSetup::HighPass)
+            {
+                flt.setHPF(100.0);
+            }
+            else
+            {
+                flt.setLPF(5000.0);
+            }
+            flt.setBypass(filter == FilterSetup::None);
+
+            auto res = measure(numSamples, [&]
+                               {
+                double acc = 0.0;
+                for (size_t i = 0; i < numSamples; i += noise.size())
+                {
+                    for (auto in : noise)
+                    {
+                        acc += flt.processSample(in);
+                    }
+                }
+                g_sink = acc; });
+            printResult<SampleType>(opt, "OnePoleFilter::processSample", 1, 1, sampleRate, 0.0, filterName(filter), res);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const Options opt = parseArgs(argc, argv);
+
+    printHeader(opt);
+
+    for (auto sampleRate : sampleRates)
+    {
+        runBenchmarks<float>(opt, sampleRate);
+        runBenchmarks<double>(opt, sampleRate);
+    }
+
+    return 0;
+}
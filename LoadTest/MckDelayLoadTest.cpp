@@ -0,0 +1,358 @@
+#include "PluginProcessor.hpp"
+
+#include "LoadProfiler.hpp"
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+// Hosts many plugin instances in one process, the way a large session does, and reports how
+// the cost per block and the resident memory grow with the number of instances.
+namespace
+{
+    struct Options
+    {
+        std::vector<int> instances{1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1000};
+        int blockSize{256};
+        double sampleRate{48000.0};
+        int numChannels{2};
+        double seconds{5.0};
+        int numThreads{1};
+        int mode{0};
+        // Share of the instances that receive a parameter change per block
+        double automationRate{0.1};
+        bool silence{false};
+        uint32_t seed{1};
+        bool csv{false};
+    };
+
+    // Resident set size of the process in bytes, 0 where it cannot be read
+    size_t residentMemory()
+    {
+#if defined(__linux__)
+        long pages = 0, resident = 0;
+        if (FILE *f = std::fopen("/proc/self/statm", "r"))
+        {
+            if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            {
+                resident = 0;
+            }
+            std::fclose(f);
+        }
+        return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#elif defined(__APPLE__)
+        mach_task_basic_info_data_t info{};
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+        {
+            return 0;
+        }
+        return static_cast<size_t>(info.resident_size);
+#else
+        return 0;
+#endif
+    }
+
+    // Reproducible random numbers for the input and the automation
+    struct Random
+    {
+        uint32_t state;
+
+        uint32_t next()
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        }
+
+        float uniform() { return static_cast<float>(next() >> 8) / 16777216.0f; }
+    };
+
+    juce::RangedAudioParameter *findParameter(juce::AudioProcessor &processor, const juce::String &id)
+    {
+        for (auto *param : processor.getParameters())
+        {
+            auto *ranged = dynamic_cast<juce::RangedAudioParameter *>(param);
+            if (ranged != nullptr && ranged->getParameterID() == id)
+            {
+                return ranged;
+            }
+        }
+        return nullptr;
+    }
+
+    // One plugin instance with the parameters the automation moves
+    struct Instance
+    {
+        std::unique_ptr<MckDelayAudioProcessor> processor;
+        std::vector<juce::RangedAudioParameter *> automated;
+    };
+
+    // Instances processed one after another on the same buffer, like the inserts of a track
+    struct Chain
+    {
+        std::vector<Instance *> instances;
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+    };
+
+    struct Result
+    {
+        MckDsp::LoadStats load;
+        double cpuPerBlockInUs{0.0};
+        double wallPerBlockInUs{0.0};
+        size_t residentBytes{0};
+        double setupInMs{0.0};
+    };
+
+    Result runInstances(const Options &opt, int numInstances, MckDsp::WorkerPool &pool)
+    {
+        Result res;
+        const auto setupStart = std::chrono::steady_clock::now();
+
+        Random rnd{opt.seed * 2654435761u + 1u};
+        std::vector<Instance> instances(static_cast<size_t>(numInstances));
+        for (auto &inst : instances)
+        {
+            inst.processor = std::make_unique<MckDelayAudioProcessor>();
+            auto &p = *inst.processor;
+            juce::AudioProcessor::BusesLayout layout;
+            layout.inputBuses.add(juce::AudioChannelSet::canonicalChannelSet(opt.numChannels));
+            layout.outputBuses.add(juce::AudioChannelSet::canonicalChannelSet(opt.numChannels));
+            p.setBusesLayout(layout);
+            p.setRateAndBufferSizeDetails(opt.sampleRate, opt.blockSize);
+            if (auto *mode = findParameter(p, "mode"))
+            {
+                mode->setValueNotifyingHost(mode->convertTo0to1(static_cast<float>(opt.mode)));
+            }
+            // Every instance starts from other settings, so the lines differ in length and load
+            for (auto id : {"time", "feedback", "mix", "lpfreq", "hpfreq"})
+            {
+                auto *param = findParameter(p, id);
+                if (param != nullptr)
+                {
+                    param->setValueNotifyingHost(rnd.uniform());
+                    inst.automated.push_back(param);
+                }
+            }
+            p.prepareToPlay(opt.sampleRate, opt.blockSize);
+        }
+        res.setupInMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setupStart).count();
+        res.residentBytes = residentMemory();
+
+        // The instances are dealt round robin to one chain per thread
+        const int numChains = std::max(1, std::min(opt.numThreads, numInstances));
+        std::vector<Chain> chains(static_cast<size_t>(numChains));
+        for (int i = 0; i < numInstances; i++)
+        {
+            chains[static_cast<size_t>(i % numChains)].instances.push_back(&instances[static_cast<size_t>(i)]);
+        }
+        for (auto &chain : chains)
+        {
+            chain.buffer.setSize(opt.numChannels, opt.blockSize);
+        }
+
+        auto processChain = [&](size_t c)
+        {
+            auto &chain = chains[c];
+            for (auto *inst : chain.instances)
+            {
+                inst->processor->processBlock(chain.buffer, chain.midi);
+            }
+        };
+
+        MckDsp::LoadProfiler profiler;
+        const double budgetInUs = 1e6 * opt.blockSize / opt.sampleRate;
+        const auto numBlocks = static_cast<size_t>(std::max(1.0, opt.seconds * opt.sampleRate / opt.blockSize));
+        double cpuTotal = 0.0, wallTotal = 0.0;
+        for (size_t b = 0; b < numBlocks; b++)
+        {
+            // Host side work before the block, not part of the measurement
+            for (auto &inst : instances)
+            {
+                if (rnd.uniform() < opt.automationRate)
+                {
+                    auto *param = inst.automated[rnd.next() % inst.automated.size()];
+                    param->setValue(rnd.uniform());
+                }
+            }
+            for (auto &chain : chains)
+            {
+                for (int ch = 0; ch < opt.numChannels; ch++)
+                {
+                    auto *data = chain.buffer.getWritePointer(ch);
+                    for (int s = 0; s < opt.blockSize; s++)
+                    {
+                        data[s] = opt.silence ? 0.0f : 0.5f * rnd.uniform() - 0.25f;
+                    }
+                }
+            }
+
+            const std::clock_t cpuStart = std::clock();
+            const auto wallStart = std::chrono::steady_clock::now();
+            pool.run(chains.size(), processChain);
+            const double wallInUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - wallStart).count();
+            const double cpuInUs = 1e6 * static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+            profiler.record(wallInUs / budgetInUs);
+            wallTotal += wallInUs;
+            cpuTotal += cpuInUs;
+        }
+
+        res.load = profiler.getStats();
+        res.wallPerBlockInUs = wallTotal / static_cast<double>(numBlocks);
+        res.cpuPerBlockInUs = cpuTotal / static_cast<double>(numBlocks);
+
+        for (auto &inst : instances)
+        {
+            inst.processor->releaseResources();
+        }
+        return res;
+    }
+
+    void printHeader(const Options &opt)
+    {
+        if (opt.csv)
+        {
+            std::printf("instances,threads,block,rate,channels,mode,wall_us_per_block,cpu_us_per_block,cpu_us_per_instance,load_mean,load_p50,load_p99,load_max,overruns,rss_mb,rss_mb_per_instance,setup_ms\n");
+        }
+        else
+        {
+            std::printf("%9s %7s %12s %12s %12s %8s %8s %8s %8s %9s %10s %10s\n", "instances", "threads", "wall us/blk", "cpu us/blk",
+                        "cpu us/inst", "mean", "p50", "p99", "max", "overruns", "rss MB", "MB/inst");
+        }
+    }
+
+    void printResult(const Options &opt, int numInstances, int numThreads, const Result &res, size_t baseResident)
+    {
+        const double rssMb = static_cast<double>(res.residentBytes) / (1024.0 * 1024.0);
+        const double perInstanceMb = res.residentBytes > baseResident ? static_cast<double>(res.residentBytes - baseResident) / (1024.0 * 1024.0) / numInstances : 0.0;
+        const double cpuPerInstance = res.cpuPerBlockInUs / numInstances;
+        if (opt.csv)
+        {
+            std::printf("%d,%d,%d,%.0f,%d,%d,%.3f,%.3f,%.4f,%.4f,%.4f,%.4f,%.4f,%llu,%.2f,%.4f,%.1f\n", numInstances, numThreads, opt.blockSize,
+                        opt.sampleRate, opt.numChannels, opt.mode, res.wallPerBlockInUs, res.cpuPerBlockInUs, cpuPerInstance, res.load.mean,
+                        res.load.p50, res.load.p99, res.load.max, static_cast<unsigned long long>(res.load.numOverruns), rssMb, perInstanceMb, res.setupInMs);
+        }
+        else
+        {
+            std::printf("%9d %7d %12.2f %12.2f %12.4f %8.4f %8.4f %8.4f %8.4f %9llu %10.1f %10.3f\n", numInstances, numThreads, res.wallPerBlockInUs,
+                        res.cpuPerBlockInUs, cpuPerInstance, res.load.mean, res.load.p50, res.load.p99, res.load.max,
+                        static_cast<unsigned long long>(res.load.numOverruns), rssMb, perInstanceMb);
+        }
+        std::fflush(stdout);
+    }
+
+    [[noreturn]] void usage(const char *name)
+    {
+        std::fprintf(stderr,
+                     "Usage: %s [--instances <n,n,...>] [--block <frames>] [--rate <hz>] [--channels <n>] [--seconds <s>]\n"
+                     "       [--threads <n>] [--mode <index>] [--automation <share>] [--silence] [--seed <n>] [--csv]\n"
+                     "\n"
+                     "  --instances  instance counts to run, default 1,2,4,...,512,1000\n"
+                     "  --threads    chains the instances are dealt to, processed in parallel\n"
+                     "  --mode       0 single, 1 multi-tap, 2 long, 3 FDN\n"
+                     "  --automation share of the instances that get a random parameter change per block\n"
+                     "  --silence    silent input, lets idle lines skip processing\n",
+                     name);
+        std::exit(1);
+    }
+
+    Options parseArgs(int argc, char **argv)
+    {
+        Options opt;
+        for (int i = 1; i < argc; i++)
+        {
+            const bool hasValue = i + 1 < argc;
+            if (std::strcmp(argv[i], "--instances") == 0 && hasValue)
+            {
+                opt.instances.clear();
+                for (auto &n : juce::StringArray::fromTokens(argv[++i], ",", ""))
+                {
+                    opt.instances.push_back(juce::jlimit(1, 100000, n.getIntValue()));
+                }
+            }
+            else if (std::strcmp(argv[i], "--block") == 0 && hasValue)
+            {
+                opt.blockSize = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--rate") == 0 && hasValue)
+            {
+                opt.sampleRate = std::max(8000.0, std::atof(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--channels") == 0 && hasValue)
+            {
+                opt.numChannels = juce::jlimit(1, MckDelayAudioProcessor::maxBusChannels, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--seconds") == 0 && hasValue)
+            {
+                opt.seconds = std::max(0.0, std::atof(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--threads") == 0 && hasValue)
+            {
+                opt.numThreads = juce::jlimit(1, MckDsp::WorkerPool::maxWorkers + 1, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--mode") == 0 && hasValue)
+            {
+                opt.mode = juce::jlimit(0, 3, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--automation") == 0 && hasValue)
+            {
+                opt.automationRate = juce::jlimit(0.0, 1.0, std::atof(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--silence") == 0)
+            {
+                opt.silence = true;
+            }
+            else if (std::strcmp(argv[i], "--seed") == 0 && hasValue)
+            {
+                opt.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            }
+            else if (std::strcmp(argv[i], "--csv") == 0)
+            {
+                opt.csv = true;
+            }
+            else
+            {
+                usage(argv[0]);
+            }
+        }
+        return opt;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const Options opt = parseArgs(argc, argv);
+
+    // The processors post async updates, which need a message manager
+    juce::ScopedJuceInitialiser_GUI juceInit;
+    const size_t baseResident = residentMemory();
+
+    // The calling thread processes one chain itself, like the audio thread of a host
+    MckDsp::WorkerPool pool;
+    pool.start(opt.numThreads - 1);
+
+    printHeader(opt);
+    for (int numInstances : opt.instances)
+    {
+        const Result res = runInstances(opt, numInstances, pool);
+        printResult(opt, numInstances, std::max(1, std::min(opt.numThreads, numInstances)), res, baseResident);
+    }
+    return 0;
+}
@@ -0,0 +1,439 @@
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "DelayModule.hpp"
+#include "FeedbackDelayNetwork.hpp"
+#include "LongDelay.hpp"
+#include "MultiTapDelay.hpp"
+#include "ParameterSnapshot.hpp"
+#include "PresetBank.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        juce::File stateFile{};
+        juce::StringPairArray overrides{};
+        juce::File outDir{};
+        juce::Array<juce::File> inputs{};
+        int numJobs{juce::SystemStats::getNumCpus()};
+        int chunkSize{1 << 16};
+        double tailInSeconds{0.0};
+    };
+
+    // Same attribute names and defaults as MckDelayAudioProcessor::setStateInformation
+    MckDsp::DelayParameters parametersFromXml(const juce::XmlElement &xml)
+    {
+        MckDsp::DelayParameters params;
+        params.timeInMs = xml.getIntAttribute("time", 250);
+        params.feedback = xml.getIntAttribute("feedback", 25) / 100.0;
+        params.mix = xml.getIntAttribute("mix", 50) / 100.0;
+        params.lpActive = xml.getBoolAttribute("lpactive", false);
+        params.lpFreq = xml.getDoubleAttribute("lpfreq", 1000);
+        params.hpActive = xml.getBoolAttribute("hpactive", false);
+        params.hpFreq = xml.getDoubleAttribute("hpfreq", 1000);
+        params.interpolation = static_cast<MckDsp::Interpolation>(juce::jlimit(0, 4, xml.getIntAttribute("interp", 1)));
+        params.multiTap = xml.getIntAttribute("mode", 0) == 1;
+        params.numTaps = juce::jlimit(1, MckDsp::maxDelayTaps, xml.getIntAttribute("taps", 4));
+        params.longDelay = xml.getIntAttribute("mode", 0) == 2;
+        params.longTimeInMs = xml.getIntAttribute("longtime", 4000);
+        params.longFormat = static_cast<MckDsp::SampleFormat>(juce::jlimit(0, 2, xml.getIntAttribute("longformat", 1)));
+        params.fdn = xml.getIntAttribute("mode", 0) == 3;
+        params.fdnLines = 4 << juce::jlimit(0, 2, xml.getIntAttribute("fdnlines", 1));
+        params.modShape = static_cast<MckDsp::LfoShape>(juce::jlimit(0, 2, xml.getIntAttribute("modshape", 0)));
+        params.modRateInHz = xml.getDoubleAttribute("modrate", 0.5);
+        params.modDepthInMs = xml.getDoubleAttribute("moddepth", 0.0);
+        params.modPhase = xml.getIntAttribute("modphase", 90) / 360.0;
+        for (int t = 0; t < MckDsp::maxDelayTaps; t++)
+        {
+            auto id = "tap" + juce::String(t + 1);
+            auto &tap = params.taps[t];
+            tap.timeInMs = xml.getIntAttribute(id + "time", std::min(1000, 125 * (t + 1)));
+            tap.gain = xml.getIntAttribute(id + "level", 25) / 100.0;
+            tap.pan = xml.getIntAttribute(id + "pan", 0) / 100.0;
+            tap.lpActive = xml.getBoolAttribute(id + "lpactive", false);
+            tap.lpFreq = xml.getDoubleAttribute(id + "lpfreq", 1000);
+            tap.hpActive = xml.getBoolAttribute(id + "hpactive", false);
+            tap.hpFreq = xml.getDoubleAttribute(id + "hpfreq", 1000);
+        }
+        return params;
+    }
+
+    // Turns a binary state into the XML attributes parametersFromXml reads
+    std::unique_ptr<juce::XmlElement> xmlFromState(const MckDsp::StateView &state)
+    {
+        juce::StringArray names{"time", "feedback", "mix", "lpactive", "lpfreq", "hpactive", "hpfreq", "interp",
+                                "mode", "taps", "longtime", "longformat", "fdnlines", "modshape", "modrate", "moddepth",
+                                "modphase", "automation"};
+        for (int t = 0; t < MckDsp::maxDelayTaps; t++)
+        {
+            auto id = "tap" + juce::String(t + 1);
+            for (auto suffix : {"time", "level", "pan", "lpactive", "lpfreq", "hpactive", "hpfreq"})
+            {
+                names.add(id + suffix);
+            }
+        }
+
+        auto xml = std::make_unique<juce::XmlElement>("MckDelay");
+        for (const auto &name : names)
+        {
+            const uint32_t id = MckDsp::stateId(name.toStdString());
+            for (size_t i = 0; i < state.getNumValues(); i++)
+            {
+                const auto v = state.getValue(i);
+                if (v.id != id)
+                {
+                    continue;
+                }
+                if (v.value == std::floor(v.value))
+                {
+                    xml->setAttribute(name, static_cast<int>(v.value));
+                }
+                else
+                {
+                    xml->setAttribute(name, static_cast<double>(v.value));
+                }
+                break;
+            }
+        }
+        return xml;
+    }
+
+    // Accepts the binary state written by getStateInformation and the XML of older versions,
+    // either as text or in the binary wrapper of juce::AudioProcessor::copyXmlToBinary
+    std::unique_ptr<juce::XmlElement> loadState(const juce::File &file)
+    {
+        juce::MemoryBlock data;
+        if (!file.loadFileAsData(data))
+        {
+            return nullptr;
+        }
+        MckDsp::StateView state;
+        if (state.open(data.getData(), data.getSize()))
+        {
+            return xmlFromState(state);
+        }
+        const uint32_t magic = 0x21324356;
+        if (data.getSize() > 8 && juce::ByteOrder::littleEndianInt(data.getData()) == magic)
+        {
+            const auto len = std::min<size_t>(juce::ByteOrder::littleEndianInt(data.begin() + 4), data.getSize() - 8);
+            return juce::parseXML(juce::String::fromUTF8(data.begin() + 8, static_cast<int>(len)));
+        }
+        return juce::parseXML(data.toString());
+    }
+
+    // Delay engines for one file, a DelayModule per channel or one MultiTapDelay, LongDelay or FeedbackDelayNetwork for all of them
+    class Renderer
+    {
+    public:
+        Renderer(const MckDsp::DelayParameters &params, double sampleRate, int numChannels, int blockSize)
+            : m_numChannels(numChannels)
+        {
+            if (params.multiTap)
+            {
+                double maxTime = 0.0;
+                for (int t = 0; t < params.numTaps; t++)
+                {
+                    maxTime = std::max(maxTime, params.taps[t].timeInMs);
+                }
+                m_multiTap = std::make_unique<MckDsp::MultiTapDelay<float>>();
+                m_multiTap->setMaxDelayInMs(std::max(1000.0, maxTime));
+                m_multiTap->prepareToPlay(sampleRate, blockSize, numChannels);
+                m_multiTap->setMix(params.mix);
+                m_multiTap->setFeedback(params.feedback);
+                m_multiTap->setInterpolation(params.interpolation);
+                m_multiTap->setNumTaps(params.numTaps);
+                for (int t = 0; t < MckDsp::maxDelayTaps; t++)
+                {
+                    m_multiTap->setTap(t, params.taps[t]);
+                }
+                return;
+            }
+            if (params.longDelay)
+            {
+                m_long = std::make_unique<MckDsp::LongDelay<float>>();
+                m_long->setFormat(params.longFormat);
+                m_long->setMaxDelayInMs(params.longTimeInMs);
+                m_long->prepareToPlay(sampleRate, blockSize, numChannels);
+                m_long->setMix(params.mix);
+                m_long->setFeedback(params.feedback);
+                m_long->setLowPass(params.lpActive, params.lpFreq);
+                m_long->setHighPass(params.hpActive, params.hpFreq);
+                m_long->setInterpolation(params.interpolation);
+                m_long->setDelayInMs(params.longTimeInMs);
+                return;
+            }
+            if (params.fdn)
+            {
+                m_fdn = std::make_unique<MckDsp::FeedbackDelayNetwork<float>>();
+                m_fdn->setMaxDelayInMs(std::max(1000.0, params.timeInMs));
+                m_fdn->prepareToPlay(sampleRate, blockSize, numChannels);
+                m_fdn->setNumLines(params.fdnLines);
+                m_fdn->setMix(params.mix);
+                m_fdn->setFeedback(params.feedback);
+                m_fdn->setLowPass(params.lpActive, params.lpFreq);
+                m_fdn->setHighPass(params.hpActive, params.hpFreq);
+                m_fdn->setDelayInMs(params.timeInMs);
+                return;
+            }
+
+            for (int c = 0; c < numChannels; c++)
+            {
+                auto delay = std::make_unique<MckDsp::DelayModule<float>>();
+                delay->setMaxDelayInMs(std::max(1000.0, params.timeInMs));
+                delay->prepareToPlay(sampleRate, blockSize);
+                delay->setMix(params.mix);
+                delay->setFeedback(params.feedback);
+                delay->setLowPass(params.lpActive, params.lpFreq);
+                delay->setHighPass(params.hpActive, params.hpFreq);
+                delay->setInterpolation(params.interpolation);
+                delay->setDelayInMs(params.timeInMs);
+                // Same phase per channel as the lanes of MultiChannelDelay in the plugin
+                delay->setModulation(params.modShape, params.modRateInHz, params.modDepthInMs, c * params.modPhase);
+                m_delays.push_back(std::move(delay));
+            }
+        }
+
+        void process(juce::AudioBuffer<float> &buffer, int numSamples)
+        {
+            if (m_multiTap != nullptr)
+            {
+                m_multiTap->processBlock(buffer.getArrayOfReadPointers(), buffer.getArrayOfWritePointers(), static_cast<size_t>(numSamples));
+                return;
+            }
+            if (m_long != nullptr)
+            {
+                m_long->processBlock(buffer.getArrayOfReadPointers(), buffer.getArrayOfWritePointers(), static_cast<size_t>(numSamples));
+                return;
+            }
+            if (m_fdn != nullptr)
+            {
+                m_fdn->processBlock(buffer.getArrayOfReadPointers(), buffer.getArrayOfWritePointers(), static_cast<size_t>(numSamples));
+                return;
+            }
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                m_delays[c]->processBlock(buffer.getReadPointer(c), buffer.getWritePointer(c), static_cast<size_t>(numSamples));
+            }
+        }
+
+    private:
+        int m_numChannels{0};
+        std::vector<std::unique_ptr<MckDsp::DelayModule<float>>> m_delays;
+        std::unique_ptr<MckDsp::MultiTapDelay<float>> m_multiTap;
+        std::unique_ptr<MckDsp::LongDelay<float>> m_long;
+        std::unique_ptr<MckDsp::FeedbackDelayNetwork<float>> m_fdn;
+    };
+
+    // Streams one file through the delay in chunks of opt.chunkSize frames
+    bool renderFile(const juce::File &input, const Options &opt, const MckDsp::DelayParameters &params, juce::String &message)
+    {
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(input));
+        if (reader == nullptr)
+        {
+            message = "cannot read " + input.getFullPathName();
+            return false;
+        }
+
+        const int numChannels = static_cast<int>(reader->numChannels);
+        if (params.multiTap && numChannels > MckDsp::MultiTapDelay<float>::maxChannels)
+        {
+            message = input.getFileName() + " has more channels than the multi-tap mode supports";
+            return false;
+        }
+        if (params.longDelay && numChannels > MckDsp::LongDelay<float>::maxChannels)
+        {
+            message = input.getFileName() + " has more channels than the long mode supports";
+            return false;
+        }
+        if (params.fdn && numChannels > MckDsp::FeedbackDelayNetwork<float>::maxChannels)
+        {
+            message = input.getFileName() + " has more channels than the FDN mode supports";
+            return false;
+        }
+
+        auto output = opt.outDir.getChildFile(input.getFileNameWithoutExtension() + ".wav");
+        if (output == input)
+        {
+            message = "refusing to overwrite the input " + input.getFullPathName();
+            return false;
+        }
+        output.deleteFile();
+        auto stream = output.createOutputStream();
+        if (stream == nullptr)
+        {
+            message = "cannot write " + output.getFullPathName();
+            return false;
+        }
+
+        juce::WavAudioFormat wav;
+        const int bits = reader->usesFloatingPointData ? 32 : static_cast<int>(std::min(24u, reader->bitsPerSample));
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), reader->sampleRate,
+                                                                             static_cast<unsigned>(numChannels), bits, {}, 0));
+        if (writer == nullptr)
+        {
+            message = "cannot create a WAV writer for " + output.getFullPathName();
+            return false;
+        }
+        // The writer owns the stream from now on
+        stream.release();
+
+        Renderer renderer(params, reader->sampleRate, numChannels, opt.chunkSize);
+        juce::AudioBuffer<float> buffer(numChannels, opt.chunkSize);
+
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        const juce::int64 numFrames = reader->lengthInSamples;
+        const juce::int64 tailFrames = static_cast<juce::int64>(opt.tailInSeconds * reader->sampleRate);
+        for (juce::int64 pos = 0; pos < numFrames + tailFrames; pos += opt.chunkSize)
+        {
+            const int len = static_cast<int>(std::min<juce::int64>(opt.chunkSize, numFrames + tailFrames - pos));
+            buffer.clear();
+            if (pos < numFrames)
+            {
+                reader->read(&buffer, 0, static_cast<int>(std::min<juce::int64>(len, numFrames - pos)), pos, true, true);
+            }
+            renderer.process(buffer, len);
+            if (!writer->writeFromAudioSampleBuffer(buffer, 0, len))
+            {
+                message = "write failed for " + output.getFullPathName();
+                return false;
+            }
+        }
+
+        const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+        const double audioSeconds = static_cast<double>(numFrames + tailFrames) / reader->sampleRate;
+        message = input.getFileName() + " -> " + output.getFullPathName() + " ("
+                  + juce::String(seconds > 0.0 ? audioSeconds / seconds : 0.0, 1) + "x real-time)";
+        return true;
+    }
+
+    [[noreturn]] void usage(const char *name)
+    {
+        std::fprintf(stderr,
+                     "Usage: %s --out <dir> [--state <file>] [--set <attribute>=<value>]... [--jobs <n>]\n"
+                     "       [--chunk <frames>] [--tail <seconds>] <input files>...\n"
+                     "\n"
+                     "  --state  XML or binary plugin state as written by getStateInformation\n"
+                     "  --set    overrides a single state attribute, e.g. --set time=375\n",
+                     name);
+        std::exit(1);
+    }
+
+    Options parseArgs(int argc, char **argv)
+    {
+        Options opt;
+        for (int i = 1; i < argc; i++)
+        {
+            const bool hasValue = i + 1 < argc;
+            if (std::strcmp(argv[i], "--out") == 0 && hasValue)
+            {
+                opt.outDir = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--state") == 0 && hasValue)
+            {
+                opt.stateFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--set") == 0 && hasValue)
+            {
+                const juce::String pair(argv[++i]);
+                if (!pair.containsChar('='))
+                {
+                    usage(argv[0]);
+                }
+                opt.overrides.set(pair.upToFirstOccurrenceOf("=", false, false), pair.fromFirstOccurrenceOf("=", false, false));
+            }
+            else if (std::strcmp(argv[i], "--jobs") == 0 && hasValue)
+            {
+                opt.numJobs = std::max(1, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--chunk") == 0 && hasValue)
+            {
+                opt.chunkSize = std::max(64, std::atoi(argv[++i]));
+            }
+            else if (std::strcmp(argv[i], "--tail") == 0 && hasValue)
+            {
+                opt.tailInSeconds = std::max(0.0, std::atof(argv[++i]));
+            }
+            else if (argv[i][0] == '-')
+            {
+                usage(argv[0]);
+            }
+            else
+            {
+                opt.inputs.add(juce::File::getCurrentWorkingDirectory().getChildFile(argv[i]));
+            }
+        }
+        if (opt.outDir == juce::File{} || opt.inputs.isEmpty())
+        {
+            usage(argv[0]);
+        }
+        return opt;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const Options opt = parseArgs(argc, argv);
+
+    juce::XmlElement state("MckDelay");
+    if (opt.stateFile != juce::File{})
+    {
+        auto loaded = loadState(opt.stateFile);
+        if (loaded == nullptr || !loaded->hasTagName("MckDelay"))
+        {
+            std::fprintf(stderr, "%s is not a MckDelay state\n", opt.stateFile.getFullPathName().toRawUTF8());
+            return 1;
+        }
+        state = *loaded;
+    }
+    for (auto &key : opt.overrides.getAllKeys())
+    {
+        state.setAttribute(key, opt.overrides[key]);
+    }
+    const MckDsp::DelayParameters params = parametersFromXml(state);
+
+    if (!opt.outDir.createDirectory())
+    {
+        std::fprintf(stderr, "cannot create %s\n", opt.outDir.getFullPathName().toRawUTF8());
+        return 1;
+    }
+
+    // Every file is an independent job, the delay buffers all come from the shared arena
+    std::atomic<int> numFailed{0};
+    juce::CriticalSection printLock;
+    {
+        juce::ThreadPool pool(std::min(opt.numJobs, opt.inputs.size()));
+        for (auto &input : opt.inputs)
+        {
+            pool.addJob([&, input]
+                        {
+                            juce::String message;
+                            const bool ok = renderFile(input, opt, params, message);
+                            if (!ok)
+                            {
+                                numFailed++;
+                            }
+                            const juce::ScopedLock lock(printLock);
+                            std::fprintf(ok ? stdout : stderr, "%s\n", message.toRawUTF8());
+                            return juce::ThreadPoolJob::jobHasFinished;
+                        });
+        }
+        while (pool.getNumJobs() > 0)
+        {
+            juce::Thread::sleep(20);
+        }
+    }
+
+    return numFailed > 0 ? 1 : 0;
+}
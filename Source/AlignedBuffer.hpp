@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace MckDsp
+{
+    // Heap array whose storage starts on a cache line, suitable for SIMD loads and stores
+    template <typename T>
+    class AlignedBuffer
+    {
+    public:
+        static constexpr size_t alignment = 64;
+
+        AlignedBuffer() = default;
+
+        ~AlignedBuffer() { release(); }
+
+        AlignedBuffer(const AlignedBuffer &) = delete;
+        AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+        AlignedBuffer(AlignedBuffer &&other) noexcept
+            : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0))
+        {
+        }
+
+        AlignedBuffer &operator=(AlignedBuffer &&other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                m_data = std::exchange(other.m_data, nullptr);
+                m_size = std::exchange(other.m_size, 0);
+            }
+            return *this;
+        }
+
+        // Reallocates the buffer to hold size zero initialized elements
+        void allocate(size_t size)
+        {
+            release();
+            if (size > 0)
+            {
+                m_data = static_cast<T *>(::operator new(size * sizeof(T), std::align_val_t(alignment)));
+                m_size = size;
+                clear();
+            }
+        }
+
+        void clear() { std::fill(m_data, m_data + m_size, T(0)); }
+
+        T *data() { return m_data; }
+        const T *data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+        T &operator[](size_t idx) { return m_data[idx]; }
+        const T &operator[](size_t idx) const { return m_data[idx]; }
+
+    private:
+        void release()
+        {
+            if (m_data != nullptr)
+            {
+                ::operator delete(m_data, std::align_val_t(alignment));
+                m_data = nullptr;
+                m_size = 0;
+            }
+        }
+
+        T *m_data{nullptr};
+        size_t m_size{0};
+    };
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace MckDsp
+{
+    // Storage formats of the long delay line
+    enum class SampleFormat
+    {
+        Float32 = 0,
+        Pcm24,
+        Pcm16
+    };
+
+    inline size_t bytesPerSample(SampleFormat format)
+    {
+        switch (format)
+        {
+        case SampleFormat::Pcm24:
+            return 3;
+        case SampleFormat::Pcm16:
+            return 2;
+        default:
+            return 4;
+        }
+    }
+
+    // Full scale of the integer formats, 12 dB above 0 dBFS so feedback can build up without clipping
+    constexpr double compactFullScale = 4.0;
+
+    // Triangular dither with a peak of one LSB, from two uniform draws of an LCG
+    struct Dither
+    {
+        uint32_t state{0x2545f491u};
+
+        inline float next()
+        {
+            state = state * 1664525u + 1013904223u;
+            const float u0 = static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+            state = state * 1664525u + 1013904223u;
+            const float u1 = static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+            return u0 + u1 - 1.0f;
+        }
+    };
+
+    namespace Detail
+    {
+        template <int Bits, typename SampleType>
+        inline int32_t quantize(SampleType x, float dither)
+        {
+            constexpr double scale = static_cast<double>(1 << (Bits - 1)) / compactFullScale;
+            constexpr int32_t maxValue = (1 << (Bits - 1)) - 1;
+            const double v = static_cast<double>(x) * scale + static_cast<double>(dither);
+            const int32_t q = static_cast<int32_t>(v + (v < 0.0 ? -0.5 : 0.5));
+            return q > maxValue ? maxValue : (q < -maxValue - 1 ? -maxValue - 1 : q);
+        }
+    }
+
+    // Converts numSamples samples to the storage format, integer formats are dithered
+    template <typename SampleType>
+    inline void encodeSamples(SampleFormat format, const SampleType *src, uint8_t *dst, size_t numSamples, Dither &dither)
+    {
+        switch (format)
+        {
+        case SampleFormat::Pcm24:
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                const uint32_t q = static_cast<uint32_t>(Detail::quantize<24>(src[s], dither.next()));
+                dst[3 * s] = static_cast<uint8_t>(q);
+                dst[3 * s + 1] = static_cast<uint8_t>(q >> 8);
+                dst[3 * s + 2] = static_cast<uint8_t>(q >> 16);
+            }
+            break;
+        case SampleFormat::Pcm16:
+        {
+            int16_t *out = reinterpret_cast<int16_t *>(dst);
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                out[s] = static_cast<int16_t>(Detail::quantize<16>(src[s], dither.next()));
+            }
+            break;
+        }
+        default:
+        {
+            float *out = reinterpret_cast<float *>(dst);
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                out[s] = static_cast<float>(src[s]);
+            }
+            break;
+        }
+        }
+    }
+
+    template <typename SampleType>
+    inline void decodeSamples(SampleFormat format, const uint8_t *src, SampleType *dst, size_t numSamples)
+    {
+        switch (format)
+        {
+        case SampleFormat::Pcm24:
+        {
+            const SampleType scale = static_cast<SampleType>(compactFullScale / static_cast<double>(1 << 23));
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                // Shift the 24 bits to the top and back down to extend the sign
+                const uint32_t u = static_cast<uint32_t>(src[3 * s]) << 8 | static_cast<uint32_t>(src[3 * s + 1]) << 16 |
+                                   static_cast<uint32_t>(src[3 * s + 2]) << 24;
+                dst[s] = static_cast<SampleType>(static_cast<int32_t>(u) >> 8) * scale;
+            }
+            break;
+        }
+        case SampleFormat::Pcm16:
+        {
+            const SampleType scale = static_cast<SampleType>(compactFullScale / static_cast<double>(1 << 15));
+            const int16_t *in = reinterpret_cast<const int16_t *>(src);
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                dst[s] = static_cast<SampleType>(in[s]) * scale;
+            }
+            break;
+        }
+        default:
+        {
+            const float *in = reinterpret_cast<const float *>(src);
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                dst[s] = static_cast<SampleType>(in[s]);
+            }
+            break;
+        }
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#include "DelayArena.hpp"
+
+#include <cstring>
+#include <new>
+
+namespace MckDsp
+{
+    // Header in front of every block, the sample memory starts one cache line later
+    struct DelayArena::Block
+    {
+        Block *next;
+        size_t size;
+        int sizeClass;
+    };
+
+    static_assert(sizeof(DelayArena::Block) <= DelayArena::alignment, "Block header has to fit into one cache line");
+
+    namespace
+    {
+        int sizeClassForBytes(size_t numBytes)
+        {
+            int sizeClass = 6;
+            while ((size_t(1) << sizeClass) < numBytes)
+            {
+                sizeClass++;
+            }
+            return sizeClass;
+        }
+    }
+
+    DelayArena::~DelayArena()
+    {
+        trim();
+    }
+
+    DelayArena &DelayArena::shared()
+    {
+        static DelayArena arena;
+        return arena;
+    }
+
+    DelayArena::Block *DelayArena::acquire(size_t numBytes)
+    {
+        const int sizeClass = sizeClassForBytes(numBytes);
+        if (sizeClass >= numSizeClasses)
+        {
+            throw std::bad_alloc();
+        }
+        const size_t size = size_t(1) << sizeClass;
+
+        Block *block = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto &head = m_free[sizeClass];
+            block = head.load(std::memory_order_acquire);
+            while (block != nullptr && head.compare_exchange_weak(block, block->next, std::memory_order_acquire) == false)
+            {
+            }
+        }
+
+        if (block == nullptr)
+        {
+            void *mem = ::operator new(alignment + size, std::align_val_t(alignment));
+            block = new (mem) Block{nullptr, size, sizeClass};
+            m_reservedBytes.fetch_add(size, std::memory_order_relaxed);
+        }
+
+        block->next = nullptr;
+        std::memset(data(block), 0, size);
+        m_usedBytes.fetch_add(size, std::memory_order_relaxed);
+        return block;
+    }
+
+    void DelayArena::release(Block *block)
+    {
+        if (block == nullptr)
+        {
+            return;
+        }
+        m_usedBytes.fetch_sub(block->size, std::memory_order_relaxed);
+
+        auto &head = m_free[block->sizeClass];
+        block->next = head.load(std::memory_order_relaxed);
+        while (head.compare_exchange_weak(block->next, block, std::memory_order_release, std::memory_order_relaxed) == false)
+        {
+        }
+    }
+
+    void DelayArena::trim()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto &head : m_free)
+        {
+            Block *block = head.exchange(nullptr, std::memory_order_acquire);
+            while (block != nullptr)
+            {
+                Block *next = block->next;
+                m_reservedBytes.fetch_sub(block->size, std::memory_order_relaxed);
+                block->~Block();
+                ::operator delete(block, std::align_val_t(alignment));
+                block = next;
+            }
+        }
+    }
+
+    void *DelayArena::data(Block *block)
+    {
+        return reinterpret_cast<char *>(block) + alignment;
+    }
+
+    size_t DelayArena::size(Block *block)
+    {
+        return block->size;
+    }
+
+    void DelayStorage::setArena(DelayArena &arena)
+    {
+        if (&arena != m_arena)
+        {
+            release();
+            m_arena = &arena;
+        }
+    }
+
+    void DelayStorage::prepare(size_t numBytes)
+    {
+        // Audio is stopped, so a queued block can be taken over directly
+        update();
+
+        if (m_current != nullptr && DelayArena::size(m_current) >= numBytes)
+        {
+            std::memset(DelayArena::data(m_current), 0, DelayArena::size(m_current));
+        }
+        else
+        {
+            m_arena->release(m_current);
+            m_current = numBytes > 0 ? m_arena->acquire(numBytes) : nullptr;
+        }
+        m_reservedBytes = size();
+    }
+
+    void DelayStorage::request(size_t numBytes)
+    {
+        if (numBytes <= m_reservedBytes)
+        {
+            return;
+        }
+
+        DelayArena::Block *block = m_arena->acquire(numBytes);
+        m_reservedBytes = DelayArena::size(block);
+
+        // A block the audio thread didn't pick up yet is superseded by the larger one
+        m_arena->release(m_pending.exchange(block, std::memory_order_acq_rel));
+    }
+
+    bool DelayStorage::update()
+    {
+        if (m_pending.load(std::memory_order_relaxed) == nullptr)
+        {
+            return false;
+        }
+        DelayArena::Block *block = m_pending.exchange(nullptr, std::memory_order_acq_rel);
+        if (block == nullptr)
+        {
+            return false;
+        }
+        m_arena->release(m_current);
+        m_current = block;
+        return true;
+    }
+
+    void DelayStorage::release()
+    {
+        m_arena->release(m_pending.exchange(nullptr, std::memory_order_acq_rel));
+        m_arena->release(m_current);
+        m_current = nullptr;
+        m_reservedBytes = 0;
+    }
+}
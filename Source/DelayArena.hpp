@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+
+namespace MckDsp
+{
+    // Pool of cache line aligned memory blocks for delay lines.
+    // Blocks are rounded up to a power of two and recycled per size class, so
+    // instances that come and go with the same settings keep reusing the same memory.
+    // acquire() may allocate and must stay off the audio thread, release() is lock-free.
+    class DelayArena
+    {
+    public:
+        struct Block;
+
+        static constexpr size_t alignment = 64;
+
+        DelayArena() = default;
+        ~DelayArena();
+
+        DelayArena(const DelayArena &) = delete;
+        DelayArena &operator=(const DelayArena &) = delete;
+
+        // Process wide arena shared by all delay lines that don't bring their own
+        static DelayArena &shared();
+
+        // Returns a zero initialized block of at least numBytes bytes, not real-time safe
+        Block *acquire(size_t numBytes);
+
+        // Hands a block back to its size class, real-time safe
+        void release(Block *block);
+
+        // Frees all blocks that are currently not in use, not real-time safe
+        void trim();
+
+        static void *data(Block *block);
+        static size_t size(Block *block);
+
+        // Bytes allocated from the system, including cached free blocks
+        size_t getReservedBytes() const { return m_reservedBytes.load(std::memory_order_relaxed); }
+
+        // Bytes currently handed out to delay lines
+        size_t getUsedBytes() const { return m_usedBytes.load(std::memory_order_relaxed); }
+
+    private:
+        static constexpr int numSizeClasses = 48;
+
+        // Pops are serialized by m_lock, so the lock-free pushes in release() can't run into ABA
+        std::mutex m_lock;
+        std::atomic<Block *> m_free[numSizeClasses]{};
+
+        std::atomic<size_t> m_reservedBytes{0};
+        std::atomic<size_t> m_usedBytes{0};
+    };
+
+    // Ring buffer memory of one delay line.
+    // Growing the buffer while audio runs reserves the block on the calling thread and
+    // queues it, the audio thread picks it up in update() and hands the old block back
+    // to the arena. A block that is already large enough is kept as is.
+    class DelayStorage
+    {
+    public:
+        explicit DelayStorage(DelayArena &arena = DelayArena::shared()) : m_arena(&arena) {}
+        ~DelayStorage() { release(); }
+
+        DelayStorage(const DelayStorage &) = delete;
+        DelayStorage &operator=(const DelayStorage &) = delete;
+
+        // Switches to another arena, returns the current memory to the old one first
+        void setArena(DelayArena &arena);
+
+        // Provides at least numBytes zeroed bytes right away, only while audio is stopped
+        void prepare(size_t numBytes);
+
+        // Queues at least numBytes bytes for the audio thread. May allocate, so it is called from one
+        // other thread only, never concurrently
+        void request(size_t numBytes);
+
+        // Takes over a queued block, returns true if data() changed. Called on the audio thread
+        bool update();
+
+        // Returns all memory to the arena, only while audio is stopped
+        void release();
+
+        // Exchanges the current blocks of both storages without copying, called on the audio thread.
+        // Both have to use the same arena and blocks of the same size, queued blocks stay where they are.
+        void swap(DelayStorage &other) { std::swap(m_current, other.m_current); }
+
+        void *data() { return m_current != nullptr ? DelayArena::data(m_current) : nullptr; }
+        size_t size() const { return m_current != nullptr ? DelayArena::size(m_current) : 0; }
+
+        // Size of the newest block, 0 after release(), only for the requesting thread
+        size_t getReservedBytes() const { return m_reservedBytes; }
+
+    private:
+        DelayArena *m_arena;
+
+        // Owned by the audio thread
+        DelayArena::Block *m_current{nullptr};
+
+        std::atomic<DelayArena::Block *> m_pending{nullptr};
+
+        // Size of the newest block, current or pending, only touched by the requesting thread
+        size_t m_reservedBytes{0};
+    };
+}
@@ -1,101 +1,488 @@
 #include "DelayModule.hpp"
+#include "Trace.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <thread>
+#include <utility>
 
 namespace MckDsp
 {
-    DelayModule::DelayModule()
+    template <typename SampleType>
+    DelayModule<SampleType>::DelayModule()
     {
     }
 
-    DelayModule::~DelayModule()
+    template <typename SampleType>
+    DelayModule<SampleType>::~DelayModule()
     {
     }
 
-    void DelayModule::prepareToPlay(double sampleRate, int samplesPerBlock)
+    template <typename SampleType>
+    void DelayModule<SampleType>::prepareToPlay(double sampleRate, int samplesPerBlock)
     {
-        m_lpFilter.prepareToPlay(sampleRate, samplesPerBlock);
-        m_hpFilter.prepareToPlay(sampleRate, samplesPerBlock);
-        resizeBuffer(sampleRate, m_maxDelayInMs);
-        m_samplesPerBlock = samplesPerBlock;
+        (void)samplesPerBlock;
+        m_sampleRate = sampleRate;
+        m_hpHistIn = m_hpHistOut = m_lpHistIn = m_lpHistOut = SampleType(0);
+        m_lfo.prepareToPlay(sampleRate, 1);
+        m_modDepthInSamples = m_modDepthInMs / 1000.0 * sampleRate;
+        m_storage.prepare(bufferBytes(m_requestedMaxDelayInMs.load(std::memory_order_relaxed)));
+        attachBuffer();
+        setCaptureEnabled(m_captureEnabled);
+    }
+
+    template <typename SampleType>
+    void DelayModule<SampleType>::releaseResources()
+    {
+        m_storage.release();
+        m_spare.release();
+        m_spareIdx = 0;
+        m_snapshotLength.store(0, std::memory_order_relaxed);
+        attachBuffer();
+    }
+
+    template <typename SampleType>
+    SampleType DelayModule<SampleType>::processSample(SampleType in)
+    {
+        switch (m_interpolation)
+        {
+        case Interpolation::Linear:
+            return processSample<Interpolation::Linear>(in);
+        case Interpolation::Lagrange:
+            return processSample<Interpolation::Lagrange>(in);
+        case Interpolation::Hermite:
+            return processSample<Interpolation::Hermite>(in);
+        case Interpolation::Allpass:
+            return processSample<Interpolation::Allpass>(in);
+        default:
+            return processSample<Interpolation::None>(in);
+        }
     }
 
-    double DelayModule::processSample(double in)
+    template <typename SampleType>
+    template <Interpolation Mode>
+    SampleType DelayModule<SampleType>::processSample(SampleType in)
     {
+        updateBuffer();
         if (m_len == 0)
         {
             return in;
         }
+        if (m_frozen)
+        {
+            SampleType out;
+            processFrozen(&in, &out, 1);
+            return out;
+        }
+
+        FractionalReader<SampleType, 1, Mode> reader;
+        reader.state.v = m_apState;
+        reader.setDelay(m_modDepthInSamples > 0.0 ? modulatedDelay() : m_delayInSamples);
+        const SampleType dly = reader.read(m_buf, m_mask, m_idx).v;
+        m_apState = reader.state.v;
+
+        const SampleType y = m_fb * dly + in;
+        switch (m_filterStages)
+        {
+        case FilterStages::HighPass:
+            m_buf[m_idx] = filterSample<true, false>(y);
+            break;
+        case FilterStages::LowPass:
+            m_buf[m_idx] = filterSample<false, true>(y);
+            break;
+        case FilterStages::Both:
+            m_buf[m_idx] = filterSample<true, true>(y);
+            break;
+        default:
+            m_buf[m_idx] = y;
+            break;
+        }
+        m_idx = (m_idx + 1) & m_mask;
 
-        unsigned readIdx = (m_idx + m_len - m_delayInSamples) % m_len;
+        return m_mix * dly + (SampleType(1) - m_mix) * in;
+    }
 
-        m_buf[m_idx] = m_lpFilter.processSample(m_hpFilter.processSample(m_fb * m_buf[readIdx] + in));
-        m_idx = (m_idx + 1) % m_len;
+    template <typename SampleType>
+    void DelayModule<SampleType>::processBlock(const SampleType *readPtr, SampleType *writePtr, size_t numSamples)
+    {
+        MCK_TRACE_ZONE("DelayModule::processBlock");
+        switch (m_interpolation)
+        {
+        case Interpolation::Linear:
+            processBlock<Interpolation::Linear>(readPtr, writePtr, numSamples);
+            break;
+        case Interpolation::Lagrange:
+            processBlock<Interpolation::Lagrange>(readPtr, writePtr, numSamples);
+            break;
+        case Interpolation::Hermite:
+            processBlock<Interpolation::Hermite>(readPtr, writePtr, numSamples);
+            break;
+        case Interpolation::Allpass:
+            processBlock<Interpolation::Allpass>(readPtr, writePtr, numSamples);
+            break;
+        default:
+            processBlock<Interpolation::None>(readPtr, writePtr, numSamples);
+            break;
+        }
+    }
 
-        return m_mix * m_buf[readIdx] + (1.0 - m_mix) * in;
+    template <typename SampleType>
+    template <bool HighPass, bool LowPass>
+    SampleType DelayModule<SampleType>::filterSample(SampleType in)
+    {
+        FilterChain<SampleType, 1, HighPass, LowPass> chain;
+        chain.load(m_hpCoeffs, m_lpCoeffs, &m_hpHistIn, &m_hpHistOut, &m_lpHistIn, &m_lpHistOut);
+        const SampleType out = chain.process({in}).v;
+        chain.store(&m_hpHistIn, &m_hpHistOut, &m_lpHistIn, &m_lpHistOut);
+        return out;
     }
 
-    void DelayModule::processBlock(const double *readPtr, double *writePtr)
+    template <typename SampleType>
+    template <Interpolation Mode>
+    void DelayModule<SampleType>::processBlock(const SampleType *readPtr, SampleType *writePtr, size_t numSamples)
     {
+        updateBuffer();
         if (m_len == 0)
         {
+            if (readPtr != writePtr)
+            {
+                std::copy(readPtr, readPtr + numSamples, writePtr);
+            }
             return;
         }
-        unsigned readIdx = 0;
-        for (size_t s = 0; s < m_samplesPerBlock; s++)
+        if (m_frozen)
         {
-            readIdx = (m_idx + m_len - m_delayInSamples) % m_len;
-            m_buf[m_idx] = m_lpFilter.processSample(m_hpFilter.processSample(m_fb * m_buf[readIdx] + readPtr[s]));
-            m_idx = (m_idx + 1) % m_len;
+            processFrozen(readPtr, writePtr, numSamples);
+            return;
+        }
 
-            writePtr[s] = m_mix * m_buf[readIdx] + (1.0 - m_mix) * readPtr[s];
+        // The filter stages only change with the lpactive/hpactive settings, so they are picked once per block
+        switch (m_filterStages)
+        {
+        case FilterStages::HighPass:
+            processBlock<Mode, true, false>(readPtr, writePtr, numSamples);
+            break;
+        case FilterStages::LowPass:
+            processBlock<Mode, false, true>(readPtr, writePtr, numSamples);
+            break;
+        case FilterStages::Both:
+            processBlock<Mode, true, true>(readPtr, writePtr, numSamples);
+            break;
+        default:
+            processBlock<Mode, false, false>(readPtr, writePtr, numSamples);
+            break;
         }
     }
 
-    void DelayModule::setMaxDelayInMs(double maxDelayInMs)
+    template <typename SampleType>
+    template <Interpolation Mode, bool HighPass, bool LowPass>
+    void DelayModule<SampleType>::processBlock(const SampleType *readPtr, SampleType *writePtr, size_t numSamples)
     {
-        resizeBuffer(m_sampleRate, maxDelayInMs);
+        FilterChain<SampleType, 1, HighPass, LowPass> chain;
+        chain.load(m_hpCoeffs, m_lpCoeffs, &m_hpHistIn, &m_hpHistOut, &m_lpHistIn, &m_lpHistOut);
+
+        const SampleType fb = m_fb;
+        const SampleType wet = m_mix;
+        const SampleType dry = SampleType(1) - m_mix;
+
+        FractionalReader<SampleType, 1, Mode> reader;
+        reader.state.v = m_apState;
+        reader.setDelay(m_delayInSamples);
+
+        if (m_modDepthInSamples > 0.0)
+        {
+            // Under modulation every sample reads from its own position
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                reader.setDelay(modulatedDelay());
+                const SampleType in = readPtr[s];
+                const SampleType dly = reader.read(m_buf, m_mask, m_idx).v;
+                m_buf[m_idx] = chain.process({fb * dly + in}).v;
+                writePtr[s] = wet * dly + dry * in;
+                m_idx = (m_idx + 1) & m_mask;
+            }
+        }
+        else if constexpr (Mode == Interpolation::None)
+        {
+            // Split the block into spans in which neither the read nor the write head wraps,
+            // so the inner loop runs over plain contiguous memory without any index math.
+            // As both heads wrap at most once per buffer length, this yields at most three spans.
+            while (numSamples > 0)
+            {
+                const unsigned readIdx = (m_idx - reader.n) & m_mask;
+                const size_t len = std::min<size_t>(numSamples, std::min(m_len - m_idx, m_len - readIdx));
+
+                const SampleType *dlyPtr = m_buf + readIdx;
+                SampleType *bufPtr = m_buf + m_idx;
+
+                for (size_t s = 0; s < len; s++)
+                {
+                    const SampleType in = readPtr[s];
+                    const SampleType dly = dlyPtr[s];
+                    bufPtr[s] = chain.process({fb * dly + in}).v;
+                    writePtr[s] = wet * dly + dry * in;
+                }
+
+                m_idx = (m_idx + static_cast<unsigned>(len)) & m_mask;
+                readPtr += len;
+                writePtr += len;
+                numSamples -= len;
+            }
+        }
+        else
+        {
+            // The fraction is constant across the block, only the masked tap reads remain per sample
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                const SampleType in = readPtr[s];
+                const SampleType dly = reader.read(m_buf, m_mask, m_idx).v;
+                m_buf[m_idx] = chain.process({fb * dly + in}).v;
+                writePtr[s] = wet * dly + dry * in;
+                m_idx = (m_idx + 1) & m_mask;
+            }
+        }
+
+        m_apState = reader.state.v;
+        chain.store(&m_hpHistIn, &m_hpHistOut, &m_lpHistIn, &m_lpHistOut);
+    }
+
+    template <typename SampleType>
+    void DelayModule<SampleType>::setMaxDelayInMs(double maxDelayInMs)
+    {
+        m_requestedMaxDelayInMs.store(maxDelayInMs, std::memory_order_relaxed);
+        if (m_sampleRate > 0.0)
+        {
+            m_storage.request(bufferBytes(maxDelayInMs));
+            if (m_captureEnabled)
+            {
+                m_spare.request(bufferBytes(maxDelayInMs));
+            }
+        }
     }
 
-    void DelayModule::setDelayInMs(double delayInMs)
+    template <typename SampleType>
+    void DelayModule<SampleType>::setDelayInMs(double delayInMs)
     {
         m_delayInMs = std::min(delayInMs, m_maxDelayInMs);
-        m_delayInSamples = static_cast<unsigned>(std::round(m_delayInMs / 1000.0 * m_sampleRate));
+        m_delayInSamples = std::max(minInterpolatedDelay, std::min(m_delayInMs / 1000.0 * m_sampleRate, static_cast<double>(m_maxDelayInSamples)));
     }
 
-    void DelayModule::setMix(double mix)
+    template <typename SampleType>
+    void DelayModule<SampleType>::setModulation(LfoShape shape, double rateInHz, double depthInMs, double phase)
     {
-        m_mix = std::min(1.0, std::max(0.0, mix));
+        m_lfo.setShape(shape);
+        m_lfo.setRate(rateInHz);
+        m_lfo.setPhase(phase, 0.0);
+        m_modDepthInMs = std::max(0.0, depthInMs);
+        m_modDepthInSamples = m_modDepthInMs / 1000.0 * m_sampleRate;
     }
 
-    void DelayModule::setFeedback(double fb)
+    template <typename SampleType>
+    void DelayModule<SampleType>::setInterpolation(Interpolation mode)
     {
-        m_fb = std::min(1.0, std::max(0.0, fb));
+        if (mode != m_interpolation)
+        {
+            m_apState = 0;
+            m_interpolation = mode;
+        }
     }
 
-    void DelayModule::setLowPass(bool active, double freq)
+    template <typename SampleType>
+    void DelayModule<SampleType>::setMix(double mix)
     {
-        m_lpFilter.setBypass(active == false);
-        m_lpFilter.setLPF(freq);
-    };
+        m_mix = static_cast<SampleType>(std::min(1.0, std::max(0.0, mix)));
+    }
 
-    void DelayModule::setHighPass(bool active, double freq)
+    template <typename SampleType>
+    void DelayModule<SampleType>::setFeedback(double fb)
     {
-        m_hpFilter.setBypass(active == false);
-        m_hpFilter.setHPF(freq);
-    };
+        m_fb = static_cast<SampleType>(std::min(1.0, std::max(0.0, fb)));
+    }
 
-    void DelayModule::resizeBuffer(double sampleRate, double maxDelayInMs)
+    template <typename SampleType>
+    void DelayModule<SampleType>::setLowPass(bool active, double freq)
     {
-        unsigned maxDly = static_cast<unsigned>(std::ceil(maxDelayInMs / 1000.0 * sampleRate));
+        // Bypassed stages don't run, so they start from silence when switched on again
+        if (active && m_lpActive == false)
+        {
+            m_lpHistIn = m_lpHistOut = SampleType(0);
+        }
+        m_lpActive = active;
+        m_lpCoeffs = OnePoleFilter<SampleType>::makeLPF(freq, m_sampleRate);
+        m_filterStages = makeFilterStages(m_hpActive, m_lpActive);
+    }
 
-        if (maxDly > m_len)
+    template <typename SampleType>
+    void DelayModule<SampleType>::setHighPass(bool active, double freq)
+    {
+        if (active && m_hpActive == false)
         {
-            m_buf.resize(maxDly, 0.0);
-            m_len = maxDly;
+            m_hpHistIn = m_hpHistOut = SampleType(0);
         }
-        m_sampleRate = sampleRate;
-        m_maxDelayInSamples = maxDly;
-        m_maxDelayInMs = maxDelayInMs;
+        m_hpActive = active;
+        m_hpCoeffs = OnePoleFilter<SampleType>::makeHPF(freq, m_sampleRate);
+        m_filterStages = makeFilterStages(m_hpActive, m_lpActive);
     }
+
+    template <typename SampleType>
+    void DelayModule<SampleType>::processFrozen(const SampleType *readPtr, SampleType *writePtr, size_t numSamples)
+    {
+        const SampleType wet = m_mix;
+        const SampleType dry = SampleType(1) - m_mix;
+        const unsigned start = m_idx - m_loopLen;
+        for (size_t s = 0; s < numSamples; s++)
+        {
+            const SampleType dly = m_loopLen > 0 ? m_buf[(start + m_loopPos) & m_mask] : SampleType(0);
+            writePtr[s] = wet * dly + dry * readPtr[s];
+            m_loopPos = m_loopPos + 1 < m_loopLen ? m_loopPos + 1 : 0;
+        }
+    }
+
+    template <typename SampleType>
+    void DelayModule<SampleType>::setFreeze(bool frozen)
+    {
+        if (frozen && !m_frozen)
+        {
+            // The loop starts with the sample the line would have read next
+            m_loopLen = std::min(static_cast<unsigned>(m_delayInSamples + 0.5), m_maxDelayInSamples);
+            m_loopPos = 0;
+        }
+        m_frozen = frozen;
+    }
+
+    template <typename SampleType>
+    void DelayModule<SampleType>::setCaptureEnabled(bool enabled)
+    {
+        m_captureEnabled = enabled;
+        if (enabled && m_sampleRate > 0.0)
+        {
+            m_spare.prepare(bufferBytes(m_requestedMaxDelayInMs.load(std::memory_order_relaxed)));
+        }
+        else
+        {
+            m_spare.release();
+        }
+        m_spareIdx = 0;
+        m_snapshotLength.store(0, std::memory_order_relaxed);
+    }
+
+    template <typename SampleType>
+    bool DelayModule<SampleType>::capture()
+    {
+        SnapshotAccess expected = SnapshotAccess::Idle;
+        if (m_len == 0 || !m_snapshotAccess.compare_exchange_strong(expected, SnapshotAccess::Capturing, std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        // Larger blocks queued by setMaxDelayInMs() are taken over first, the spare one replaces the snapshot with silence
+        updateBuffer();
+        if (m_spare.update())
+        {
+            m_spareIdx = 0;
+            m_snapshotLength.store(0, std::memory_order_relaxed);
+        }
+
+        // Until both blocks of a growth arrived the ring would trade places with a smaller one its storage doesn't know about
+        if (m_spare.data() == nullptr || m_spare.size() != m_storage.size())
+        {
+            m_snapshotAccess.store(SnapshotAccess::Idle, std::memory_order_release);
+            return false;
+        }
+
+        const unsigned loopLen = m_frozen ? m_loopLen : std::min(static_cast<unsigned>(m_delayInSamples + 0.5), m_maxDelayInSamples);
+        m_storage.swap(m_spare);
+        std::swap(m_idx, m_spareIdx);
+        m_loopLen = m_snapshotLength.exchange(loopLen, std::memory_order_relaxed);
+        m_loopPos = 0;
+
+        // Unlike attachBuffer() the write head stays with its buffer
+        m_buf = static_cast<SampleType *>(m_storage.data());
+        m_len = static_cast<unsigned>(m_storage.size() / sizeof(SampleType));
+        m_mask = m_len - 1;
+        updateMaxDelay();
+        m_loopLen = std::min(m_loopLen, m_maxDelayInSamples);
+
+        m_snapshotAccess.store(SnapshotAccess::Idle, std::memory_order_release);
+        return true;
+    }
+
+    template <typename SampleType>
+    size_t DelayModule<SampleType>::exportSnapshot(SampleType *dst, size_t maxSamples)
+    {
+        SnapshotAccess expected = SnapshotAccess::Idle;
+        while (!m_snapshotAccess.compare_exchange_weak(expected, SnapshotAccess::Exporting, std::memory_order_acquire))
+        {
+            expected = SnapshotAccess::Idle;
+            std::this_thread::yield();
+        }
+
+        const SampleType *buf = static_cast<const SampleType *>(m_spare.data());
+        const size_t numSamples = buf != nullptr ? std::min<size_t>(m_snapshotLength.load(std::memory_order_relaxed), maxSamples) : 0;
+        const unsigned mask = static_cast<unsigned>(m_spare.size() / sizeof(SampleType)) - 1;
+        const unsigned start = m_spareIdx - static_cast<unsigned>(m_snapshotLength.load(std::memory_order_relaxed));
+        for (size_t i = 0; i < numSamples; i++)
+        {
+            dst[i] = buf[(start + static_cast<unsigned>(i)) & mask];
+        }
+
+        m_snapshotAccess.store(SnapshotAccess::Idle, std::memory_order_release);
+        return numSamples;
+    }
+
+    template <typename SampleType>
+    void DelayModule<SampleType>::getLevels(size_t numSamples, Levels &wet, Levels &feedback) const
+    {
+        LevelAccumulator wetAcc, fbAcc;
+        if (m_len > 0 && m_frozen)
+        {
+            // Nothing is written while frozen, the loop is all there is to hear
+            wetAcc.addRing(m_buf, m_len, m_idx - m_loopLen, std::min<size_t>(numSamples, m_loopLen), 1, 0);
+        }
+        else if (m_len > 0)
+        {
+            const unsigned start = m_idx - static_cast<unsigned>(numSamples);
+            const unsigned delay = static_cast<unsigned>(m_delayInSamples + 0.5);
+            wetAcc.addRing(m_buf, m_len, start - delay, numSamples, 1, 0);
+            fbAcc.addRing(m_buf, m_len, start, numSamples, 1, 0);
+        }
+        wet = wetAcc.get();
+        feedback = fbAcc.get();
+    }
+
+    template <typename SampleType>
+    size_t DelayModule<SampleType>::bufferBytes(double maxDelayInMs) const
+    {
+        // The arena rounds up to a power of two, which keeps the ring length a power of two as well
+        const size_t maxDly = static_cast<size_t>(std::ceil(maxDelayInMs / 1000.0 * m_sampleRate));
+        return (maxDly + interpolationGuardFrames) * sizeof(SampleType);
+    }
+
+    template <typename SampleType>
+    void DelayModule<SampleType>::attachBuffer()
+    {
+        // Existing content would be scrambled by the new wrap point anyway, a new block starts out silent
+        m_buf = static_cast<SampleType *>(m_storage.data());
+        m_len = static_cast<unsigned>(m_storage.size() / sizeof(SampleType));
+        m_mask = m_len > 0 ? m_len - 1 : 0;
+        m_idx = 0;
+        updateMaxDelay();
+        m_loopLen = std::min(m_loopLen, m_maxDelayInSamples);
+        m_loopPos = 0;
+    }
+
+    template <typename SampleType>
+    void DelayModule<SampleType>::updateMaxDelay()
+    {
+        m_maxDelayInMs = m_requestedMaxDelayInMs.load(std::memory_order_relaxed);
+
+        // Until a larger buffer arrives, the delay is limited to what the current one can hold
+        const unsigned maxDly = static_cast<unsigned>(std::ceil(m_maxDelayInMs / 1000.0 * m_sampleRate));
+        const unsigned maxFit = m_len > interpolationGuardFrames ? m_len - interpolationGuardFrames : 0;
+        m_maxDelayInSamples = std::min(maxDly, maxFit);
+        m_delayInSamples = std::max(minInterpolatedDelay, std::min(m_delayInSamples, static_cast<double>(m_maxDelayInSamples)));
+    }
+
+    template class DelayModule<float>;
+    template class DelayModule<double>;
 }
\ No newline at end of file
@@ -1,11 +1,18 @@
 #pragma once
 
-#include <vector>
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include "DelayArena.hpp"
+#include "FilterChain.hpp"
+#include "Interpolation.hpp"
+#include "Lfo.hpp"
 #include "OnePoleFilter.hpp"
+#include "Telemetry.hpp"
 
 namespace MckDsp
 {
+    template <typename SampleType>
     class DelayModule
     {
     public:
@@ -14,15 +21,37 @@ namespace MckDsp
 
         void prepareToPlay(double sampleRate, int samplesPerBlock);
 
-        double processSample(double in);
+        // Hands the ring buffer back to the arena, only while audio is stopped
+        void releaseResources();
 
-        void processBlock(const double *readPtr, double *writePtr);
+        // Selects the arena the ring buffer is taken from, only while audio is stopped
+        void setArena(DelayArena &arena)
+        {
+            m_storage.setArena(arena);
+            m_spare.setArena(arena);
+        };
 
+        SampleType processSample(SampleType in);
+
+        // Processes numSamples samples with the current delay time, readPtr and writePtr may alias
+        void processBlock(const SampleType *readPtr, SampleType *writePtr, size_t numSamples);
+
+        // Called from one thread other than the audio thread, usually the message thread. A larger buffer is
+        // reserved there, as that may allocate,
+        // and taken over by the audio thread at the start of the next processed sample or block
         void setMaxDelayInMs(double maxDelayInMs);
-        double getMaxDelayInMs() { return m_maxDelayInMs; };
+        double getMaxDelayInMs() { return m_requestedMaxDelayInMs.load(std::memory_order_relaxed); };
 
         void setDelayInMs(double delayInMs);
 
+        // Selects how fractional delay times are read from the ring buffer
+        void setInterpolation(Interpolation mode);
+        Interpolation getInterpolation() { return m_interpolation; };
+
+        // Moves the read position around the delay time by up to depthInMs, a depth of zero turns
+        // the modulation off. phase is the position of this line in the LFO cycle.
+        void setModulation(LfoShape shape, double rateInHz, double depthInMs, double phase = 0.0);
+
         void setMix(double mix);
 
         void setFeedback(double fb);
@@ -31,27 +60,132 @@ namespace MckDsp
 
         void setHighPass(bool active, double freq = 10.0);
 
-    private:
-        void resizeBuffer(double sampleRate, double maxDelayInMs);
+        // Switches the write head off and plays the last delay time of the line as a loop,
+        // the input only reaches the output dry. Switching back resumes where the write head stopped.
+        void setFreeze(bool frozen);
+        bool getFreeze() { return m_frozen; };
+
+        // Reserves a spare ring buffer of the same size for capture(), only while audio is stopped
+        void setCaptureEnabled(bool enabled);
+
+        // Exchanges the ring buffer with the snapshot without copying. The snapshot takes the
+        // current loop, the line continues with the previous snapshot, silent at first, so a
+        // second call brings the loop back. Called on the audio thread, returns false without
+        // a spare buffer, while setMaxDelayInMs() grew only one of the two buffers yet or while
+        // exportSnapshot() reads the snapshot.
+        bool capture();
 
-        OnePoleFilter m_lpFilter{};
-        OnePoleFilter m_hpFilter{};
+        // Length of the loop held by the snapshot, zero until the first capture()
+        size_t getSnapshotLength() const { return m_snapshotLength.load(std::memory_order_relaxed); };
 
-        size_t m_samplesPerBlock{0};
+        // Copies up to maxSamples samples of the snapshot loop, oldest first, and returns how many.
+        // Called off the audio thread, which never waits for it, only this call waits for a running capture().
+        size_t exportSnapshot(SampleType *dst, size_t maxSamples);
+
+        // Levels of the delayed signal and of the signal written into the line during the
+        // last numSamples samples, read back from the ring buffer
+        void getLevels(size_t numSamples, Levels &wet, Levels &feedback) const;
+
+    private:
+        template <Interpolation Mode>
+        SampleType processSample(SampleType in);
+
+        template <Interpolation Mode>
+        void processBlock(const SampleType *readPtr, SampleType *writePtr, size_t numSamples);
+
+        template <Interpolation Mode, bool HighPass, bool LowPass>
+        void processBlock(const SampleType *readPtr, SampleType *writePtr, size_t numSamples);
+
+        template <bool HighPass, bool LowPass>
+        SampleType filterSample(SampleType in);
+
+        // Plays the frozen loop, the write head and the filters stand still
+        void processFrozen(const SampleType *readPtr, SampleType *writePtr, size_t numSamples);
+
+        size_t bufferBytes(double maxDelayInMs) const;
+
+        // Takes over a buffer or maximum delay time queued by setMaxDelayInMs()
+        inline void updateBuffer()
+        {
+            if (m_storage.update())
+            {
+                attachBuffer();
+            }
+            else if (m_requestedMaxDelayInMs.load(std::memory_order_relaxed) != m_maxDelayInMs)
+            {
+                updateMaxDelay();
+            }
+        }
+
+        void attachBuffer();
+
+        void updateMaxDelay();
+
+        // Delay of the next sample including the modulation, within the usable range of the buffer
+        inline double modulatedDelay()
+        {
+            const double delay = m_delayInSamples + m_modDepthInSamples * static_cast<double>(*m_lfo.next());
+            return std::max(minInterpolatedDelay, std::min(delay, static_cast<double>(m_maxDelayInSamples)));
+        }
+
+        typename OnePoleFilter<SampleType>::Coefficients m_lpCoeffs{};
+        typename OnePoleFilter<SampleType>::Coefficients m_hpCoeffs{};
+        bool m_lpActive{false};
+        bool m_hpActive{false};
+        FilterStages m_filterStages{FilterStages::None};
+
+        SampleType m_lpHistIn{0};
+        SampleType m_lpHistOut{0};
+        SampleType m_hpHistIn{0};
+        SampleType m_hpHistOut{0};
 
         double m_sampleRate{0};
 
-        double m_mix{0.0};
-        double m_fb{0.0};
+        SampleType m_mix{0};
+        SampleType m_fb{0};
 
+        std::atomic<double> m_requestedMaxDelayInMs{1000.0};
         double m_maxDelayInMs{1000.0};
         unsigned m_maxDelayInSamples{0};
 
         double m_delayInMs{0.0};
-        unsigned m_delayInSamples{0};
+        double m_delayInSamples{minInterpolatedDelay};
 
+        Interpolation m_interpolation{Interpolation::None};
+        SampleType m_apState{0};
+
+        Lfo<SampleType> m_lfo{};
+        double m_modDepthInMs{0.0};
+        double m_modDepthInSamples{0.0};
+
+        // Buffer length is a power of two so indices wrap with m_mask instead of a modulo
         unsigned m_len{0};
+        unsigned m_mask{0};
         unsigned m_idx{0};
-        std::vector<double> m_buf{};
+        SampleType *m_buf{nullptr};
+        DelayStorage m_storage{};
+
+        // The loop ends at the write head and is m_loopLen samples long, m_loopPos is the next one
+        bool m_frozen{false};
+        unsigned m_loopLen{0};
+        unsigned m_loopPos{0};
+
+        // Ring buffer of the snapshot, swapped with m_storage by capture()
+        bool m_captureEnabled{false};
+        DelayStorage m_spare{};
+        unsigned m_spareIdx{0};
+        std::atomic<unsigned> m_snapshotLength{0};
+
+        // Idle, exporting or capturing, whoever gets it from idle owns the snapshot
+        enum class SnapshotAccess
+        {
+            Idle,
+            Exporting,
+            Capturing
+        };
+        std::atomic<SnapshotAccess> m_snapshotAccess{SnapshotAccess::Idle};
     };
+
+    extern template class DelayModule<float>;
+    extern template class DelayModule<double>;
 }
\ No newline at end of file
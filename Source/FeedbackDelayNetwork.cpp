@@ -0,0 +1,406 @@
+#include "FeedbackDelayNetwork.hpp"
+#include "Trace.hpp"
+#include "SimdVec.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace MckDsp
+{
+    namespace
+    {
+        bool isPrime(unsigned n)
+        {
+            if (n < 2)
+            {
+                return false;
+            }
+            for (unsigned d = 2; d * d <= n; d++)
+            {
+                if (n % d == 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        unsigned largestPrimeAtMost(unsigned n)
+        {
+            while (n > 2 && isPrime(n) == false)
+            {
+                n--;
+            }
+            return std::max(n, 2u);
+        }
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels)
+    {
+        (void)samplesPerBlock;
+        m_numChannels = std::max(1, std::min(maxChannels, numChannels));
+        m_sampleRate = sampleRate;
+
+        // Fewer lines than reserved never need new memory, more wait for setMaxNumLines()
+        m_storage.prepare(bufferBytes(m_requestedMaxDelayInMs.load(std::memory_order_relaxed)));
+        attachBuffer();
+        clearLines();
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::releaseResources()
+    {
+        m_storage.release();
+        attachBuffer();
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples)
+    {
+        MCK_TRACE_ZONE("FeedbackDelayNetwork::processBlock");
+        updateBuffer();
+        if (m_len == 0)
+        {
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                if (readPtrs[c] != writePtrs[c])
+                {
+                    std::copy(readPtrs[c], readPtrs[c] + numSamples, writePtrs[c]);
+                }
+            }
+            return;
+        }
+
+        switch (m_numLines)
+        {
+        case 4:
+            processBlock<4>(readPtrs, writePtrs, numSamples);
+            break;
+        case 8:
+            processBlock<8>(readPtrs, writePtrs, numSamples);
+            break;
+        default:
+            processBlock<16>(readPtrs, writePtrs, numSamples);
+            break;
+        }
+        m_validFrames = static_cast<unsigned>(std::min<size_t>(m_len, static_cast<size_t>(m_validFrames) + numSamples));
+    }
+
+    template <typename SampleType>
+    template <int Lines>
+    void FeedbackDelayNetwork<SampleType>::processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples)
+    {
+        switch (m_filterStages)
+        {
+        case FilterStages::HighPass:
+            processBlock<Lines, true, false>(readPtrs, writePtrs, numSamples);
+            break;
+        case FilterStages::LowPass:
+            processBlock<Lines, false, true>(readPtrs, writePtrs, numSamples);
+            break;
+        case FilterStages::Both:
+            processBlock<Lines, true, true>(readPtrs, writePtrs, numSamples);
+            break;
+        default:
+            processBlock<Lines, false, false>(readPtrs, writePtrs, numSamples);
+            break;
+        }
+    }
+
+    template <typename SampleType>
+    template <int Lines, bool HighPass, bool LowPass>
+    void FeedbackDelayNetwork<SampleType>::processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples)
+    {
+        using V = Vec<SampleType, Lines>;
+
+        FilterChain<SampleType, Lines, HighPass, LowPass> filter;
+        filter.load(m_hpCoeffs, m_lpCoeffs, m_hpHistIn, m_hpHistOut, m_lpHistIn, m_lpHistOut);
+        const V gains = V::load(m_gains);
+
+        // Channel c is fed to and fed from every line i with i % numSlots == c % numSlots
+        const int numChannels = m_numChannels;
+        const int numSlots = std::min(numChannels, Lines);
+        int lineSlot[Lines];
+        for (int i = 0; i < Lines; i++)
+        {
+            lineSlot[i] = i % numSlots;
+        }
+
+        // Every slot sums Lines / numSlots uncorrelated lines
+        const SampleType wet = m_mix * static_cast<SampleType>(std::sqrt(static_cast<double>(numSlots) / Lines));
+        const SampleType dry = SampleType(1) - m_mix;
+
+        unsigned offsets[Lines];
+        for (int i = 0; i < Lines; i++)
+        {
+            offsets[i] = m_lineLengths[i];
+        }
+
+        SampleType *buf = m_buf;
+        const unsigned mask = m_mask;
+        unsigned idx = m_idx;
+
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType lines[Lines];
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType inputs[Lines];
+
+        for (size_t s = 0; s < numSamples; s++)
+        {
+            for (int i = 0; i < Lines; i++)
+            {
+                lines[i] = buf[((idx - offsets[i]) & mask) * Lines + i];
+            }
+            const V out = filter.process(V::load(lines));
+            out.store(lines);
+
+            SampleType slotIn[maxChannels]{};
+            SampleType slotOut[maxChannels]{};
+            for (int c = 0; c < numChannels; c++)
+            {
+                slotIn[c % numSlots] += readPtrs[c][s];
+            }
+            for (int i = 0; i < Lines; i++)
+            {
+                slotOut[lineSlot[i]] += lines[i];
+                inputs[i] = slotIn[lineSlot[i]];
+            }
+
+            (hadamard(out) * gains + V::load(inputs)).store(buf + (idx & mask) * Lines);
+
+            for (int c = 0; c < numChannels; c++)
+            {
+                writePtrs[c][s] = dry * readPtrs[c][s] + wet * slotOut[c % numSlots];
+            }
+            idx++;
+        }
+
+        m_idx = idx;
+        filter.store(m_hpHistIn, m_hpHistOut, m_lpHistIn, m_lpHistOut);
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::setMaxDelayInMs(double maxDelayInMs)
+    {
+        m_requestedMaxDelayInMs.store(maxDelayInMs, std::memory_order_relaxed);
+
+        // The sample rate is only known after prepareToPlay, a released network takes no memory until the next one
+        if (m_sampleRate > 0 && m_storage.getReservedBytes() > 0)
+        {
+            m_storage.request(bufferBytes(maxDelayInMs));
+        }
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::setMaxNumLines(int numLines)
+    {
+        m_requestedMaxLines.store(numLines >= 16 ? 16 : (numLines >= 8 ? 8 : 4), std::memory_order_relaxed);
+        if (m_sampleRate > 0 && m_storage.getReservedBytes() > 0)
+        {
+            m_storage.request(bufferBytes(m_requestedMaxDelayInMs.load(std::memory_order_relaxed)));
+        }
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::setDelayInMs(double delayInMs)
+    {
+        m_delayInMs = delayInMs;
+        updateLineLengths();
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::setNumLines(int numLines)
+    {
+        numLines = numLines >= 16 ? 16 : (numLines >= 8 ? 8 : 4);
+        if (numLines == m_numLines)
+        {
+            return;
+        }
+        // The frame layout changes, so only the frames the new lines read are cleared instead of the whole ring
+        m_numLines = numLines;
+        m_len = static_cast<unsigned>(m_storage.size() / (static_cast<size_t>(m_numLines) * sizeof(SampleType)));
+        m_mask = m_len > 0 ? m_len - 1 : 0;
+        m_idx = 0;
+        m_validFrames = 0;
+        std::fill(m_lpHistIn, m_lpHistIn + maxLines, SampleType(0));
+        std::fill(m_lpHistOut, m_lpHistOut + maxLines, SampleType(0));
+        std::fill(m_hpHistIn, m_hpHistIn + maxLines, SampleType(0));
+        std::fill(m_hpHistOut, m_hpHistOut + maxLines, SampleType(0));
+        updateMaxDelay();
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::setMix(double mix)
+    {
+        m_mix = static_cast<SampleType>(std::min(1.0, std::max(0.0, mix)));
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::setFeedback(double fb)
+    {
+        m_fb = std::min(1.0, std::max(0.0, fb));
+        updateGains();
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::setLowPass(bool active, double freq)
+    {
+        if (active && m_lpActive == false)
+        {
+            std::fill(m_lpHistIn, m_lpHistIn + maxLines, SampleType(0));
+            std::fill(m_lpHistOut, m_lpHistOut + maxLines, SampleType(0));
+        }
+        m_lpActive = active;
+        m_lpCoeffs = OnePoleFilter<SampleType>::makeLPF(freq, m_sampleRate);
+        m_filterStages = makeFilterStages(m_hpActive, m_lpActive);
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::setHighPass(bool active, double freq)
+    {
+        if (active && m_hpActive == false)
+        {
+            std::fill(m_hpHistIn, m_hpHistIn + maxLines, SampleType(0));
+            std::fill(m_hpHistOut, m_hpHistOut + maxLines, SampleType(0));
+        }
+        m_hpActive = active;
+        m_hpCoeffs = OnePoleFilter<SampleType>::makeHPF(freq, m_sampleRate);
+        m_filterStages = makeFilterStages(m_hpActive, m_lpActive);
+    }
+
+    template <typename SampleType>
+    size_t FeedbackDelayNetwork<SampleType>::bufferBytes(double maxDelayInMs) const
+    {
+        // The arena rounds up to a power of two, which keeps the frame count a power of two for every line count
+        const size_t maxDly = std::max(static_cast<size_t>(std::ceil(maxDelayInMs / 1000.0 * m_sampleRate)), static_cast<size_t>(minDelayInSamples));
+        const size_t numLines = static_cast<size_t>(m_requestedMaxLines.load(std::memory_order_relaxed));
+        return (maxDly + 1) * numLines * sizeof(SampleType);
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::updateBuffer()
+    {
+        if (m_storage.update())
+        {
+            attachBuffer();
+        }
+        else if (m_requestedMaxDelayInMs.load(std::memory_order_relaxed) != m_maxDelayInMs)
+        {
+            updateMaxDelay();
+        }
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::attachBuffer()
+    {
+        // A new block starts out silent and writing restarts at its first frame
+        m_buf = static_cast<SampleType *>(m_storage.data());
+        m_len = static_cast<unsigned>(m_storage.size() / (static_cast<size_t>(m_numLines) * sizeof(SampleType)));
+        m_mask = m_len > 0 ? m_len - 1 : 0;
+        m_idx = 0;
+        m_validFrames = m_len;
+        updateMaxDelay();
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::updateMaxDelay()
+    {
+        m_maxDelayInMs = m_requestedMaxDelayInMs.load(std::memory_order_relaxed);
+
+        // Until a larger buffer arrives, the lines are limited to what the current one can hold
+        const unsigned maxDly = static_cast<unsigned>(std::ceil(m_maxDelayInMs / 1000.0 * m_sampleRate));
+        const unsigned maxFit = m_len > 0 ? m_len - 1 : 0;
+        m_maxDelayInSamples = std::min(std::max(maxDly, minDelayInSamples), maxFit);
+        updateLineLengths();
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::updateLineLengths()
+    {
+        const double delayInSamples = std::round(m_delayInMs / 1000.0 * m_sampleRate);
+        unsigned longest = static_cast<unsigned>(std::max(delayInSamples, static_cast<double>(minDelayInSamples)));
+        longest = std::min(longest, m_maxDelayInSamples);
+
+        // Distinct primes are mutually prime, the targets spread the lines evenly on a log scale
+        // between half and all of the longest length, the primes are taken downwards from there
+        unsigned limit = longest;
+        for (int i = m_numLines - 1; i >= 0; i--)
+        {
+            const double target = static_cast<double>(longest) * std::exp2(-static_cast<double>(m_numLines - 1 - i) / m_numLines);
+            m_lineLengths[i] = largestPrimeAtMost(std::min(limit, static_cast<unsigned>(target)));
+            limit = m_lineLengths[i] > 2 ? m_lineLengths[i] - 1 : 2;
+        }
+        for (int i = m_numLines; i < maxLines; i++)
+        {
+            m_lineLengths[i] = m_lineLengths[m_numLines - 1];
+        }
+        updateGains();
+        clearUnwrittenFrames();
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::updateGains()
+    {
+        const double longest = static_cast<double>(std::max(m_lineLengths[m_numLines - 1], 1u));
+        const double norm = 1.0 / std::sqrt(static_cast<double>(m_numLines));
+        for (int i = 0; i < maxLines; i++)
+        {
+            const double g = i < m_numLines ? std::pow(m_fb, static_cast<double>(m_lineLengths[i]) / longest) : 0.0;
+            m_gains[i] = static_cast<SampleType>(g * norm);
+        }
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::clearLines()
+    {
+        if (m_buf != nullptr)
+        {
+            std::fill(m_buf, m_buf + m_storage.size() / sizeof(SampleType), SampleType(0));
+        }
+        std::fill(m_lpHistIn, m_lpHistIn + maxLines, SampleType(0));
+        std::fill(m_lpHistOut, m_lpHistOut + maxLines, SampleType(0));
+        std::fill(m_hpHistIn, m_hpHistIn + maxLines, SampleType(0));
+        std::fill(m_hpHistOut, m_hpHistOut + maxLines, SampleType(0));
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::clearUnwrittenFrames()
+    {
+        // The longest line reads up to that many frames behind the write head
+        const unsigned needed = std::min(m_lineLengths[m_numLines - 1], m_len);
+        if (m_buf == nullptr || needed <= m_validFrames)
+        {
+            return;
+        }
+        const size_t numLines = static_cast<size_t>(m_numLines);
+        unsigned frame = (m_idx - needed) & m_mask;
+        unsigned count = needed - m_validFrames;
+        while (count > 0)
+        {
+            const unsigned n = std::min(count, m_len - frame);
+            std::fill(m_buf + frame * numLines, m_buf + (frame + n) * numLines, SampleType(0));
+            frame = (frame + n) & m_mask;
+            count -= n;
+        }
+        m_validFrames = needed;
+    }
+
+    template <typename SampleType>
+    void FeedbackDelayNetwork<SampleType>::getLevels(size_t numSamples, Levels &wet, Levels &feedback) const
+    {
+        LevelAccumulator wetAcc, fbAcc;
+        if (m_len > 0)
+        {
+            const unsigned start = m_idx - static_cast<unsigned>(numSamples);
+            for (int i = 0; i < m_numLines; i++)
+            {
+                wetAcc.addRing(m_buf, m_len, start - m_lineLengths[i], numSamples, m_numLines, i);
+                fbAcc.addRing(m_buf, m_len, start, numSamples, m_numLines, i);
+            }
+        }
+        wet = wetAcc.get();
+        feedback = fbAcc.get();
+    }
+
+    template class FeedbackDelayNetwork<float>;
+    template class FeedbackDelayNetwork<double>;
+}
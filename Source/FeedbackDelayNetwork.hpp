@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include "AlignedBuffer.hpp"
+#include "DelayArena.hpp"
+#include "FilterChain.hpp"
+#include "OnePoleFilter.hpp"
+#include "Telemetry.hpp"
+
+namespace MckDsp
+{
+    // Feedback delay network of 4, 8 or 16 lines with mutually prime lengths.
+    // The line outputs are damped by one-pole filters and mixed back into the line inputs
+    // through a normalized Walsh-Hadamard matrix, computed as a fast transform across the
+    // SIMD lanes in O(N log N). Channels are spread over the lines round robin.
+    template <typename SampleType>
+    class FeedbackDelayNetwork
+    {
+    public:
+        static constexpr int maxChannels = 8;
+        static constexpr int maxLines = 16;
+        // Shortest longest line, enough primes below it for maxLines distinct lengths
+        static constexpr unsigned minDelayInSamples = 64;
+
+        void prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels);
+
+        // Hands the ring buffer back to the arena, only while audio is stopped
+        void releaseResources();
+
+        // Selects the arena the ring buffer is taken from, only while audio is stopped
+        void setArena(DelayArena &arena) { m_storage.setArena(arena); };
+
+        // Processes numSamples samples of every channel, readPtrs and writePtrs may alias
+        void processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples);
+
+        // Called from one thread other than the audio thread, usually the message thread. A larger buffer is
+        // reserved there, as that may allocate,
+        // and taken over by the audio thread at the start of the next block
+        void setMaxDelayInMs(double maxDelayInMs);
+        double getMaxDelayInMs() { return m_requestedMaxDelayInMs.load(std::memory_order_relaxed); };
+
+        // Length of the longest line, the others are spread down to about half of it.
+        // The lengths jump, the network has no fractional reads to ramp with.
+        void setDelayInMs(double delayInMs);
+
+        // Reserves the ring for up to numLines lines, called like setMaxDelayInMs()
+        void setMaxNumLines(int numLines);
+        int getMaxNumLines() { return m_requestedMaxLines.load(std::memory_order_relaxed); };
+
+        // 4, 8 or 16, a different number of lines clears the network. Lines beyond getMaxNumLines()
+        // share the ring reserved for fewer, so they are shorter until setMaxNumLines() grew it.
+        void setNumLines(int numLines);
+        int getNumLines() { return m_numLines; };
+
+        // Length of line i in samples, the lines are sorted from short to long
+        unsigned getLineLength(int i) { return m_lineLengths[i]; };
+
+        void setMix(double mix);
+
+        // Gain of one round trip through the longest line, shorter lines lose proportionally less,
+        // so all of them decay at the same rate
+        void setFeedback(double fb);
+
+        // Damping of every line, the histories are kept like in MultiChannelDelay
+        void setLowPass(bool active, double freq = 20000.0);
+
+        void setHighPass(bool active, double freq = 10.0);
+
+        int getNumChannels() { return m_numChannels; };
+
+        // Levels of the line outputs and of the signal written into the lines
+        // during the last numSamples samples, read back from the ring buffer after processBlock()
+        void getLevels(size_t numSamples, Levels &wet, Levels &feedback) const;
+
+    private:
+        template <int Lines>
+        void processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples);
+
+        template <int Lines, bool HighPass, bool LowPass>
+        void processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples);
+
+        size_t bufferBytes(double maxDelayInMs) const;
+
+        // Takes over a buffer or maximum delay time queued by setMaxDelayInMs()
+        void updateBuffer();
+
+        void attachBuffer();
+
+        void updateMaxDelay();
+
+        void updateLineLengths();
+
+        void updateGains();
+
+        void clearLines();
+
+        // Clears the frames the lines reach beyond the ones written in the current layout
+        void clearUnwrittenFrames();
+
+        int m_numChannels{0};
+        int m_numLines{4};
+
+        double m_sampleRate{0};
+
+        SampleType m_mix{0};
+        double m_fb{0};
+
+        std::atomic<double> m_requestedMaxDelayInMs{1000.0};
+        std::atomic<int> m_requestedMaxLines{4};
+        double m_maxDelayInMs{1000.0};
+        unsigned m_maxDelayInSamples{0};
+
+        double m_delayInMs{0.0};
+        unsigned m_lineLengths[maxLines]{};
+        // Feedback gain of every line including the 1 / sqrt(N) of the Hadamard matrix
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_gains[maxLines]{};
+
+        typename OnePoleFilter<SampleType>::Coefficients m_lpCoeffs{};
+        typename OnePoleFilter<SampleType>::Coefficients m_hpCoeffs{};
+        bool m_lpActive{false};
+        bool m_hpActive{false};
+        FilterStages m_filterStages{FilterStages::None};
+
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_lpHistIn[maxLines]{};
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_lpHistOut[maxLines]{};
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_hpHistIn[maxLines]{};
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_hpHistOut[maxLines]{};
+
+        // Ring buffer of m_len frames with m_numLines interleaved samples each, sized for
+        // getMaxNumLines() lines, so fewer lines just get longer rings
+        unsigned m_len{0};
+        unsigned m_mask{0};
+        unsigned m_idx{0};
+        // Frames behind the write head that hold the current layout, the others are cleared before a line reaches them
+        unsigned m_validFrames{0};
+        SampleType *m_buf{nullptr};
+        DelayStorage m_storage{};
+    };
+
+    extern template class FeedbackDelayNetwork<float>;
+    extern template class FeedbackDelayNetwork<double>;
+}
@@ -0,0 +1,130 @@
+#include "Fft.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace MckDsp
+{
+    template <typename SampleType>
+    void RealFft<SampleType>::prepare(size_t size)
+    {
+        m_size = std::max<size_t>(size, 4);
+        m_half = m_size / 2;
+
+        m_twRe.allocate(m_half + 1);
+        m_twIm.allocate(m_half + 1);
+        for (size_t k = 0; k <= m_half; k++)
+        {
+            const double w = 2.0 * M_PI * static_cast<double>(k) / static_cast<double>(m_size);
+            m_twRe[k] = static_cast<SampleType>(std::cos(w));
+            m_twIm[k] = static_cast<SampleType>(-std::sin(w));
+        }
+
+        unsigned bits = 0;
+        while ((size_t(1) << bits) < m_half)
+        {
+            bits++;
+        }
+        m_bitReverse.allocate(m_half);
+        for (size_t i = 0; i < m_half; i++)
+        {
+            uint32_t r = 0;
+            for (unsigned b = 0; b < bits; b++)
+            {
+                r |= ((i >> b) & 1u) << (bits - 1 - b);
+            }
+            m_bitReverse[i] = r;
+        }
+
+        m_zRe.allocate(m_half);
+        m_zIm.allocate(m_half);
+    }
+
+    template <typename SampleType>
+    void RealFft<SampleType>::forward(const SampleType *in, SampleType *re, SampleType *im)
+    {
+        // Even samples go to the real, odd samples to the imaginary part
+        for (size_t n = 0; n < m_half; n++)
+        {
+            const uint32_t r = m_bitReverse[n];
+            m_zRe[r] = in[2 * n];
+            m_zIm[r] = in[2 * n + 1];
+        }
+        transform(false);
+
+        // Separates the spectra of the even and odd samples and combines them into bin k
+        const SampleType half = SampleType(0.5);
+        for (size_t k = 0; k <= m_half; k++)
+        {
+            const size_t a = k < m_half ? k : 0;
+            const size_t b = k > 0 ? m_half - k : 0;
+            const SampleType evenRe = half * (m_zRe[a] + m_zRe[b]);
+            const SampleType evenIm = half * (m_zIm[a] - m_zIm[b]);
+            const SampleType oddRe = half * (m_zIm[a] + m_zIm[b]);
+            const SampleType oddIm = half * (m_zRe[b] - m_zRe[a]);
+            re[k] = evenRe + m_twRe[k] * oddRe - m_twIm[k] * oddIm;
+            im[k] = evenIm + m_twRe[k] * oddIm + m_twIm[k] * oddRe;
+        }
+    }
+
+    template <typename SampleType>
+    void RealFft<SampleType>::inverse(const SampleType *re, const SampleType *im, SampleType *out)
+    {
+        // Rebuilds the spectra of the even and odd samples, each scaled by two
+        for (size_t k = 0; k < m_half; k++)
+        {
+            const size_t b = m_half - k;
+            const SampleType evenRe = re[k] + re[b];
+            const SampleType evenIm = (k > 0 ? im[k] : SampleType(0)) - (b < m_half ? im[b] : SampleType(0));
+            const SampleType diffRe = re[k] - re[b];
+            const SampleType diffIm = (k > 0 ? im[k] : SampleType(0)) + (b < m_half ? im[b] : SampleType(0));
+            const SampleType oddRe = diffRe * m_twRe[k] + diffIm * m_twIm[k];
+            const SampleType oddIm = diffIm * m_twRe[k] - diffRe * m_twIm[k];
+            const uint32_t r = m_bitReverse[k];
+            m_zRe[r] = evenRe - oddIm;
+            m_zIm[r] = evenIm + oddRe;
+        }
+        transform(true);
+
+        for (size_t n = 0; n < m_half; n++)
+        {
+            out[2 * n] = m_zRe[n];
+            out[2 * n + 1] = m_zIm[n];
+        }
+    }
+
+    template <typename SampleType>
+    void RealFft<SampleType>::transform(bool inverse)
+    {
+        SampleType *zr = m_zRe.data();
+        SampleType *zi = m_zIm.data();
+        const SampleType sign = inverse ? SampleType(-1) : SampleType(1);
+
+        // Input is in bit reversed order, every stage doubles the length of the sub transforms
+        for (size_t len = 2; len <= m_half; len <<= 1)
+        {
+            const size_t step = m_size / len;
+            const size_t halfLen = len / 2;
+            for (size_t start = 0; start < m_half; start += len)
+            {
+                for (size_t j = 0; j < halfLen; j++)
+                {
+                    const SampleType wr = m_twRe[j * step];
+                    const SampleType wi = sign * m_twIm[j * step];
+                    const size_t a = start + j;
+                    const size_t b = a + halfLen;
+                    const SampleType tr = zr[b] * wr - zi[b] * wi;
+                    const SampleType ti = zr[b] * wi + zi[b] * wr;
+                    zr[b] = zr[a] - tr;
+                    zi[b] = zi[a] - ti;
+                    zr[a] += tr;
+                    zi[a] += ti;
+                }
+            }
+        }
+    }
+
+    template class RealFft<float>;
+    template class RealFft<double>;
+}
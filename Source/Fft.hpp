@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "AlignedBuffer.hpp"
+
+namespace MckDsp
+{
+    // FFT of a real sequence of a fixed power of two size. The sequence is transformed as a
+    // complex one of half the size and split into the bins 0 to size / 2, which are kept as
+    // separate real and imaginary arrays. Neither direction normalizes, so
+    // inverse(forward(x)) returns size * x.
+    template <typename SampleType>
+    class RealFft
+    {
+    public:
+        // Builds the twiddle and bit reversal tables, not real-time safe
+        void prepare(size_t size);
+
+        size_t getSize() const { return m_size; };
+        size_t getNumBins() const { return m_half + 1; };
+
+        // Spectrum of size samples of in, written to getNumBins() bins of re and im
+        void forward(const SampleType *in, SampleType *re, SampleType *im);
+
+        // Sequence of getNumBins() bins of re and im, written to size samples of out.
+        // The imaginary parts of the first and the last bin are ignored.
+        void inverse(const SampleType *re, const SampleType *im, SampleType *out);
+
+    private:
+        // In place radix-2 transform of m_half complex values in m_zRe and m_zIm
+        void transform(bool inverse);
+
+        size_t m_size{0};
+        size_t m_half{0};
+
+        // e^(-2 pi i k / size) for k from 0 to size / 2
+        AlignedBuffer<SampleType> m_twRe{};
+        AlignedBuffer<SampleType> m_twIm{};
+        AlignedBuffer<uint32_t> m_bitReverse{};
+
+        AlignedBuffer<SampleType> m_zRe{};
+        AlignedBuffer<SampleType> m_zIm{};
+    };
+
+    extern template class RealFft<float>;
+    extern template class RealFft<double>;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "OnePoleFilter.hpp"
+#include "SimdVec.hpp"
+
+namespace MckDsp
+{
+    // Active stages of a high pass to low pass chain
+    enum class FilterStages
+    {
+        None = 0,
+        HighPass = 1,
+        LowPass = 2,
+        Both = HighPass | LowPass
+    };
+
+    inline FilterStages makeFilterStages(bool hpActive, bool lpActive)
+    {
+        return static_cast<FilterStages>((hpActive ? 1 : 0) | (lpActive ? 2 : 0));
+    }
+
+    // One-pole high pass followed by a one-pole low pass on N lanes, with the active
+    // stages fixed at compile time. Bypassed stages compile away entirely, active ones
+    // run back to back in a single recurrence step without any per sample branch.
+    // The arithmetic matches OnePoleFilter::processSample.
+    template <typename SampleType, int N, bool HighPass, bool LowPass>
+    struct FilterChain
+    {
+        using V = Vec<SampleType, N>;
+        using Coefficients = typename OnePoleFilter<SampleType>::Coefficients;
+
+        V hpA0, hpA1, hpB1, hpIn, hpOut;
+        V lpA0, lpA1, lpB1, lpIn, lpOut;
+
+        // Histories hold N samples each, aligned like the lanes of V
+        inline void load(const Coefficients &hp, const Coefficients &lp,
+                         const SampleType *hpHistIn, const SampleType *hpHistOut,
+                         const SampleType *lpHistIn, const SampleType *lpHistOut)
+        {
+            if constexpr (HighPass)
+            {
+                hpA0 = V::broadcast(hp.a0);
+                hpA1 = V::broadcast(hp.a1);
+                hpB1 = V::broadcast(hp.b1);
+                hpIn = V::load(hpHistIn);
+                hpOut = V::load(hpHistOut);
+            }
+            if constexpr (LowPass)
+            {
+                lpA0 = V::broadcast(lp.a0);
+                lpA1 = V::broadcast(lp.a1);
+                lpB1 = V::broadcast(lp.b1);
+                lpIn = V::load(lpHistIn);
+                lpOut = V::load(lpHistOut);
+            }
+        }
+
+        inline void store(SampleType *hpHistIn, SampleType *hpHistOut, SampleType *lpHistIn, SampleType *lpHistOut) const
+        {
+            if constexpr (HighPass)
+            {
+                hpIn.store(hpHistIn);
+                hpOut.store(hpHistOut);
+            }
+            if constexpr (LowPass)
+            {
+                lpIn.store(lpHistIn);
+                lpOut.store(lpHistOut);
+            }
+        }
+
+        inline V process(V x)
+        {
+            if constexpr (HighPass)
+            {
+                hpOut = x * hpA0 + hpIn * hpA1 + hpOut * hpB1;
+                hpIn = x;
+                x = hpOut;
+            }
+            if constexpr (LowPass)
+            {
+                lpOut = x * lpA0 + lpIn * lpA1 + lpOut * lpB1;
+                lpIn = x;
+                x = lpOut;
+            }
+            return x;
+        }
+    };
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace MckDsp
+{
+    // Level below which a signal counts as silent, -100 dBFS
+    constexpr double silenceThreshold = 1e-5;
+
+    // Time until the repeats of a unit impulse fall below silenceThreshold, when every repeat
+    // arrives at most delayInMs after the previous one and is scaled by loopGain.
+    // Infinite if the repeats never decay.
+    inline double tailLengthInMs(double delayInMs, double loopGain)
+    {
+        if (loopGain >= 1.0)
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+        double numRepeats = 1.0;
+        if (loopGain > silenceThreshold)
+        {
+            numRepeats += std::ceil(std::log(silenceThreshold) / std::log(loopGain));
+        }
+        return numRepeats * delayInMs;
+    }
+
+    // Decides when a delay line holds nothing but silence, so processing can be skipped.
+    // The line counts as empty once the input and the signal written into the line stayed
+    // below silenceThreshold for as long as the line can delay.
+    class IdleDetector
+    {
+    public:
+        // Number of samples the line can delay, changing it starts counting again
+        void setMemoryLength(size_t numSamples)
+        {
+            if (numSamples != m_memoryLength)
+            {
+                m_memoryLength = numSamples;
+                m_silentSamples = 0;
+            }
+        }
+
+        bool isIdle() const { return m_idle; }
+
+        // Leaves the idle state right away, e.g. when the input is no longer silent
+        void wake()
+        {
+            m_idle = false;
+            m_silentSamples = 0;
+        }
+
+        // Reports a processed span of numSamples samples
+        void update(bool silent, size_t numSamples)
+        {
+            if (silent == false)
+            {
+                m_silentSamples = 0;
+                return;
+            }
+            m_silentSamples += numSamples;
+            if (m_silentSamples > m_memoryLength)
+            {
+                m_idle = true;
+            }
+        }
+
+    private:
+        size_t m_memoryLength{0};
+        size_t m_silentSamples{0};
+        bool m_idle{false};
+    };
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <array>
+#include "SimdVec.hpp"
+
+namespace MckDsp
+{
+    // Read quality of a fractional delay tap, ordered by CPU cost
+    enum class Interpolation
+    {
+        None = 0, // Delay rounded to whole samples
+        Linear,
+        Lagrange, // 4-point, 3rd order Lagrange
+        Hermite,  // 4-point, Catmull-Rom spline
+        Allpass   // 1st order allpass, flat magnitude response
+    };
+
+    // Smallest delay in samples that keeps every interpolation tap behind the write head
+    constexpr double minInterpolatedDelay = 2.0;
+
+    // Frames a ring buffer needs on top of its maximum delay for the trailing taps
+    constexpr unsigned interpolationGuardFrames = 3;
+
+    // Polyphase coefficient tables indexed by the quantized fractional delay.
+    // Entry numPhases holds the coefficients for a fraction of exactly one sample,
+    // so rounding a fraction up never needs a branch.
+    template <typename SampleType>
+    struct InterpolationTable
+    {
+        static constexpr unsigned numPhases = 1024;
+
+        using Taps = std::array<SampleType, 4>;
+        using Table = std::array<Taps, numPhases + 1>;
+
+        // Taps are ordered by delay: x(n - 1), x(n), x(n + 1), x(n + 2)
+        // where n is the integer part of the delay and the fraction points towards x(n + 1)
+        static constexpr Table makeTable(Interpolation mode)
+        {
+            Table t{};
+            for (unsigned p = 0; p <= numPhases; p++)
+            {
+                const double f = static_cast<double>(p) / static_cast<double>(numPhases);
+                double c[4] = {0.0, 1.0 - f, f, 0.0};
+                if (mode == Interpolation::Lagrange)
+                {
+                    c[0] = -f * (f - 1.0) * (f - 2.0) / 6.0;
+                    c[1] = (f + 1.0) * (f - 1.0) * (f - 2.0) / 2.0;
+                    c[2] = -(f + 1.0) * f * (f - 2.0) / 2.0;
+                    c[3] = (f + 1.0) * f * (f - 1.0) / 6.0;
+                }
+                else if (mode == Interpolation::Hermite)
+                {
+                    c[0] = -0.5 * f + f * f - 0.5 * f * f * f;
+                    c[1] = 1.0 - 2.5 * f * f + 1.5 * f * f * f;
+                    c[2] = 0.5 * f + 2.0 * f * f - 1.5 * f * f * f;
+                    c[3] = -0.5 * f * f + 0.5 * f * f * f;
+                }
+                else if (mode == Interpolation::Allpass)
+                {
+                    // Keep the allpass delay within [0.5, 1.5) where its phase delay is flattest,
+                    // fractions below one half borrow one sample from the integer part
+                    const double d = f < 0.5 ? f + 1.0 : f;
+                    c[0] = (1.0 - d) / (1.0 + d);
+                    c[1] = c[2] = c[3] = 0.0;
+                }
+                for (int i = 0; i < 4; i++)
+                {
+                    t[p][i] = static_cast<SampleType>(c[i]);
+                }
+            }
+            return t;
+        }
+
+        static constexpr Table linear = makeTable(Interpolation::Linear);
+        static constexpr Table lagrange = makeTable(Interpolation::Lagrange);
+        static constexpr Table hermite = makeTable(Interpolation::Hermite);
+        static constexpr Table allpass = makeTable(Interpolation::Allpass);
+    };
+
+    // Reads a fractional delay tap from an interleaved ring buffer with Lanes samples per frame.
+    // The fraction is set once per block (or per frame while the delay ramps), the read itself
+    // is a fixed number of masked loads and multiply-adds.
+    template <typename SampleType, int Lanes, Interpolation Mode>
+    struct FractionalReader
+    {
+        using V = Vec<SampleType, Lanes>;
+        using Table = InterpolationTable<SampleType>;
+
+        V c0, c1, c2, c3;
+        V state;
+        unsigned n{0};
+        bool borrow{false};
+
+        // Splits a delay in samples into the integer tap position and the table phase
+        inline void setDelay(double delayInSamples)
+        {
+            if constexpr (Mode == Interpolation::None)
+            {
+                n = static_cast<unsigned>(delayInSamples + 0.5);
+            }
+            else
+            {
+                n = static_cast<unsigned>(delayInSamples);
+                const unsigned phase = static_cast<unsigned>((delayInSamples - static_cast<double>(n)) * Table::numPhases + 0.5);
+                const typename Table::Taps *taps = &Table::linear[phase];
+                if constexpr (Mode == Interpolation::Lagrange)
+                {
+                    taps = &Table::lagrange[phase];
+                }
+                else if constexpr (Mode == Interpolation::Hermite)
+                {
+                    taps = &Table::hermite[phase];
+                }
+                else if constexpr (Mode == Interpolation::Allpass)
+                {
+                    taps = &Table::allpass[phase];
+                    borrow = phase < Table::numPhases / 2;
+                }
+                c0 = V::broadcast((*taps)[0]);
+                c1 = V::broadcast((*taps)[1]);
+                c2 = V::broadcast((*taps)[2]);
+                c3 = V::broadcast((*taps)[3]);
+            }
+        }
+
+        inline V read(const SampleType *ring, unsigned mask, unsigned writeIdx)
+        {
+            auto tap = [&](unsigned delay)
+            { return V::load(ring + static_cast<size_t>((writeIdx - delay) & mask) * Lanes); };
+
+            if constexpr (Mode == Interpolation::None)
+            {
+                return tap(n);
+            }
+            else if constexpr (Mode == Interpolation::Linear)
+            {
+                return tap(n) * c1 + tap(n + 1) * c2;
+            }
+            else if constexpr (Mode == Interpolation::Allpass)
+            {
+                const unsigned m = borrow ? n - 1 : n;
+                state = c0 * (tap(m) - state) + tap(m + 1);
+                return state;
+            }
+            else
+            {
+                return tap(n - 1) * c0 + tap(n) * c1 + tap(n + 1) * c2 + tap(n + 2) * c3;
+            }
+        }
+    };
+
+    // Reads a tap whose delay differs per lane and changes every frame, e.g. under modulation.
+    // Every lane finds its position and coefficients like a FractionalReader with one lane,
+    // the gathered taps are then weighted for all lanes at once.
+    template <typename SampleType, int Lanes, Interpolation Mode>
+    struct ModulatedReader
+    {
+        using V = Vec<SampleType, Lanes>;
+
+        static constexpr int numTaps = Mode == Interpolation::None ? 1 : (Mode == Interpolation::Linear || Mode == Interpolation::Allpass) ? 2 : 4;
+
+        V state;
+
+        inline V read(const SampleType *ring, unsigned mask, unsigned writeIdx, const double *delaysInSamples)
+        {
+            alignas(sizeof(SampleType) * Lanes) SampleType t[numTaps][Lanes];
+            alignas(sizeof(SampleType) * Lanes) SampleType c[4][Lanes];
+            for (int l = 0; l < Lanes; l++)
+            {
+                FractionalReader<SampleType, 1, Mode> lane;
+                lane.setDelay(delaysInSamples[l]);
+
+                // Taps in the order FractionalReader::read() weights them
+                unsigned first = lane.n - 1;
+                if constexpr (Mode == Interpolation::None || Mode == Interpolation::Linear)
+                {
+                    first = lane.n;
+                }
+                else if constexpr (Mode == Interpolation::Allpass)
+                {
+                    first = lane.borrow ? lane.n - 1 : lane.n;
+                }
+                for (int i = 0; i < numTaps; i++)
+                {
+                    t[i][l] = ring[static_cast<size_t>((writeIdx - first - static_cast<unsigned>(i)) & mask) * Lanes + l];
+                }
+                c[0][l] = lane.c0.v;
+                c[1][l] = lane.c1.v;
+                c[2][l] = lane.c2.v;
+                c[3][l] = lane.c3.v;
+            }
+
+            if constexpr (Mode == Interpolation::None)
+            {
+                return V::load(t[0]);
+            }
+            else if constexpr (Mode == Interpolation::Linear)
+            {
+                return V::load(t[0]) * V::load(c[1]) + V::load(t[1]) * V::load(c[2]);
+            }
+            else if constexpr (Mode == Interpolation::Allpass)
+            {
+                state = V::load(c[0]) * (V::load(t[0]) - state) + V::load(t[1]);
+                return state;
+            }
+            else
+            {
+                return V::load(t[0]) * V::load(c[0]) + V::load(t[1]) * V::load(c[1]) + V::load(t[2]) * V::load(c[2]) + V::load(t[3]) * V::load(c[3]);
+            }
+        }
+    };
+}
@@ -0,0 +1,62 @@
+#include "LevelMeter.hpp"
+
+LevelMeter::LevelMeter(const juce::String &name)
+    : m_name(name)
+{
+    // Opaque, so the frequent meter updates never repaint the editor behind them
+    setOpaque(true);
+}
+
+void LevelMeter::setLevels(const MckDsp::Levels &levels)
+{
+    const float peakDb = juce::jlimit(minDb, maxDb, juce::Decibels::gainToDecibels(levels.peak, minDb));
+    const float rmsDb = juce::jlimit(minDb, maxDb, juce::Decibels::gainToDecibels(levels.rms, minDb));
+    const float newPeak = std::max(peakDb, m_peakDb - m_peakFall);
+
+    // Skip the repaint while nothing visible changes, e.g. during silence
+    if (newPeak == m_peakDb && rmsDb == m_rmsDb)
+    {
+        return;
+    }
+    m_peakDb = newPeak;
+    m_rmsDb = rmsDb;
+    repaint();
+}
+
+float LevelMeter::dbToX(float db, float width) const
+{
+    return width * (db - minDb) / (maxDb - minDb);
+}
+
+void LevelMeter::paint(juce::Graphics &g)
+{
+    g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
+
+    auto bounds = getLocalBounds().toFloat();
+
+    g.setColour(juce::Colour::fromRGB(230, 230, 230));
+    g.setFont(juce::Font(bounds.getHeight(), juce::Font::plain));
+    g.drawText(m_name, bounds.removeFromLeft(static_cast<float>(m_nameWidth)), juce::Justification::centredLeft, false);
+
+    g.setColour(juce::Colour::fromRGB(40, 40, 40));
+    g.fillRect(bounds);
+
+    const float w = bounds.getWidth();
+    const float zeroX = bounds.getX() + dbToX(0.0f, w);
+
+    auto rms = bounds.withWidth(dbToX(m_rmsDb, w)).reduced(0.0f, 2.0f);
+    g.setColour(juce::Colour::fromRGB(0, 155, 179));
+    g.fillRect(rms.withRight(std::min(rms.getRight(), zeroX)));
+    if (rms.getRight() > zeroX)
+    {
+        g.setColour(juce::Colours::red);
+        g.fillRect(rms.withLeft(zeroX));
+    }
+
+    const float peakX = bounds.getX() + dbToX(m_peakDb, w);
+    g.setColour(m_peakDb > 0.0f ? juce::Colours::red : juce::Colour::fromRGB(230, 230, 230));
+    g.fillRect(juce::Rectangle<float>(peakX - 1.0f, bounds.getY(), 2.0f, bounds.getHeight()));
+
+    g.setColour(juce::Colour::fromRGB(120, 120, 120));
+    g.drawVerticalLine(static_cast<int>(zeroX), bounds.getY(), bounds.getBottom());
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#include "Telemetry.hpp"
+
+//==============================================================================
+/**
+    Horizontal peak and RMS bar in dBFS with a label on the left.
+    The peak falls back slowly, everything above 0 dBFS is drawn in red.
+ */
+class LevelMeter : public juce::Component
+{
+public:
+  explicit LevelMeter(const juce::String &name);
+
+  // Called from the message thread with the loudest levels since the last call
+  void setLevels(const MckDsp::Levels &levels);
+
+  void paint(juce::Graphics &) override;
+
+  static constexpr float minDb = -60.0f;
+  static constexpr float maxDb = 6.0f;
+
+private:
+  float dbToX(float db, float width) const;
+
+  juce::String m_name;
+
+  float m_peakDb{minDb};
+  float m_rmsDb{minDb};
+
+  // Peak fall back per update, in dB
+  const float m_peakFall = 1.5f;
+  const int m_nameWidth = 32;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LevelMeter)
+};
@@ -0,0 +1,165 @@
+#include "Lfo.hpp"
+#include "SimdVec.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace MckDsp
+{
+    namespace
+    {
+        // Integer hash of the cycle count, mapped to [-1, 1)
+        inline double randomValue(uint32_t x)
+        {
+            x ^= x >> 16;
+            x *= 0x7feb352du;
+            x ^= x >> 15;
+            x *= 0x846ca68bu;
+            x ^= x >> 16;
+            return static_cast<double>(x) / 2147483648.0 - 1.0;
+        }
+    }
+
+    template <typename SampleType>
+    void Lfo<SampleType>::prepareToPlay(double sampleRate, int numLanes)
+    {
+        m_sampleRate = sampleRate;
+        m_lanes = std::max(1, std::min(maxChannels, numLanes));
+        m_cycle = 0;
+        m_phase = 0.0;
+        m_pos = segmentLength;
+        setRate(m_rateInHz);
+    }
+
+    template <typename SampleType>
+    void Lfo<SampleType>::setRate(double rateInHz)
+    {
+        m_rateInHz = std::max(0.0, std::min(rateInHz, maxRateInHz));
+        m_inc = m_sampleRate > 0.0 ? m_rateInHz / m_sampleRate : 0.0;
+    }
+
+    template <typename SampleType>
+    void Lfo<SampleType>::setPhase(double phase, double phaseOffset)
+    {
+        for (int c = 0; c < maxChannels; c++)
+        {
+            m_lanePhase[c] = phase + static_cast<double>(c) * phaseOffset;
+        }
+    }
+
+    template <typename SampleType>
+    void Lfo<SampleType>::generate()
+    {
+        switch (m_lanes)
+        {
+        case 1:
+            generate<1>();
+            break;
+        case 2:
+            generate<2>();
+            break;
+        case 4:
+            generate<4>();
+            break;
+        default:
+            generate<8>();
+            break;
+        }
+
+        const double end = m_phase + static_cast<double>(segmentLength) * m_inc;
+        const double whole = std::floor(end);
+        m_cycle += static_cast<uint32_t>(static_cast<int64_t>(whole));
+        m_phase = end - whole;
+        m_pos = 0;
+    }
+
+    template <typename SampleType>
+    template <int Lanes>
+    void Lfo<SampleType>::generate()
+    {
+        using V = Vec<SampleType, Lanes>;
+
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType a[Lanes];
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType b[Lanes];
+        SampleType *out = m_values;
+
+        // Every lane is split into its cycle count and the phase within the cycle
+        auto position = [this](double p, uint32_t &cycle)
+        {
+            const double whole = std::floor(p);
+            cycle = m_cycle + static_cast<uint32_t>(static_cast<int64_t>(whole));
+            return p - whole;
+        };
+
+        if (m_shape == LfoShape::Sine)
+        {
+            // Rotation of (sin, cos) by one sample, restarted from the exact phase every segment
+            for (int l = 0; l < Lanes; l++)
+            {
+                uint32_t cycle = 0;
+                const double w = 2.0 * M_PI * position(m_phase + m_lanePhase[l], cycle);
+                a[l] = static_cast<SampleType>(std::sin(w));
+                b[l] = static_cast<SampleType>(std::cos(w));
+            }
+            const V cw = V::broadcast(static_cast<SampleType>(std::cos(2.0 * M_PI * m_inc)));
+            const V sw = V::broadcast(static_cast<SampleType>(std::sin(2.0 * M_PI * m_inc)));
+            V s = V::load(a);
+            V c = V::load(b);
+            for (size_t i = 0; i < segmentLength; i++, out += Lanes)
+            {
+                s.store(out);
+                const V sn = s * cw + c * sw;
+                c = c * cw - s * sw;
+                s = sn;
+            }
+        }
+        else
+        {
+            // Straight line from the value at the start of the segment towards the value at its end
+            const double len = static_cast<double>(segmentLength);
+            for (int l = 0; l < Lanes; l++)
+            {
+                const double p = m_phase + m_lanePhase[l];
+                uint32_t cycle0, cycle1;
+                const double phase0 = position(p, cycle0);
+                const double phase1 = position(p + len * m_inc, cycle1);
+                const double v0 = valueAt(cycle0, phase0);
+                const double v1 = valueAt(cycle1, phase1);
+                a[l] = static_cast<SampleType>(v0);
+                b[l] = static_cast<SampleType>((v1 - v0) / len);
+            }
+            V v = V::load(a);
+            const V dv = V::load(b);
+            for (size_t i = 0; i < segmentLength; i++, out += Lanes)
+            {
+                v.store(out);
+                v = v + dv;
+            }
+        }
+    }
+
+    template <typename SampleType>
+    double Lfo<SampleType>::valueAt(uint32_t cycle, double phase) const
+    {
+        switch (m_shape)
+        {
+        case LfoShape::Triangle:
+        {
+            // Rises through zero at the start of a cycle like the sine
+            const double p = phase + 0.75;
+            return 4.0 * std::fabs(p - std::floor(p) - 0.5) - 1.0;
+        }
+        case LfoShape::Random:
+        {
+            const double from = randomValue(cycle);
+            const double to = randomValue(cycle + 1);
+            return from + (to - from) * phase * phase * (3.0 - 2.0 * phase);
+        }
+        default:
+            return std::sin(2.0 * M_PI * phase);
+        }
+    }
+
+    template class Lfo<float>;
+    template class Lfo<double>;
+}
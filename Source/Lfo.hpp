@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "AlignedBuffer.hpp"
+
+namespace MckDsp
+{
+    enum class LfoShape
+    {
+        Sine = 0,
+        Triangle,
+        // Smoothstep between random values at every cycle
+        Random
+    };
+
+    // Low frequency oscillator for up to maxChannels lanes that share shape and rate,
+    // every lane runs at its own phase. Values in [-1, 1] are generated in SIMD a segment
+    // of segmentLength frames at a time: the sine by a recursive rotation, the other shapes
+    // by a straight line between their exact values at the segment ends. Segments start at
+    // fixed positions, so the values do not depend on how the audio is split into blocks.
+    template <typename SampleType>
+    class Lfo
+    {
+    public:
+        static constexpr int maxChannels = 8;
+        static constexpr size_t segmentLength = 32;
+        // Keeps one segment well below a cycle, so the straight lines hold the shapes
+        static constexpr double maxRateInHz = 20.0;
+
+        // numLanes is a power of two of at most maxChannels, the phase restarts at zero
+        void prepareToPlay(double sampleRate, int numLanes);
+
+        void setShape(LfoShape shape) { m_shape = shape; };
+        LfoShape getShape() { return m_shape; };
+
+        void setRate(double rateInHz);
+        double getRate() { return m_rateInHz; };
+
+        // Lane c runs phase + c * phaseOffset cycles ahead of the oscillator
+        void setPhase(double phase, double phaseOffset);
+
+        // Returns the interleaved lanes of the next frame, valid until the next call
+        inline const SampleType *next()
+        {
+            if (m_pos == segmentLength)
+            {
+                generate();
+            }
+            return m_values + (m_pos++) * static_cast<size_t>(m_lanes);
+        }
+
+    private:
+        template <int Lanes>
+        void generate();
+
+        void generate();
+
+        double valueAt(uint32_t cycle, double phase) const;
+
+        int m_lanes{1};
+        double m_sampleRate{0};
+        LfoShape m_shape{LfoShape::Sine};
+        double m_rateInHz{0};
+        // Cycles per sample
+        double m_inc{0};
+
+        // Start of the current segment, cycles are counted for the random values
+        uint32_t m_cycle{0};
+        double m_phase{0};
+        double m_lanePhase[maxChannels]{};
+
+        size_t m_pos{segmentLength};
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_values[segmentLength * maxChannels]{};
+    };
+
+    extern template class Lfo<float>;
+    extern template class Lfo<double>;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace MckDsp
+{
+    // Summary of the recorded blocks, loads are relative to the real-time budget of a block
+    struct LoadStats
+    {
+        uint64_t numBlocks{0};
+        // Blocks above the overrun threshold
+        uint64_t numOverruns{0};
+        double overrunThreshold{0.0};
+        double mean{0.0};
+        double p50{0.0};
+        double p99{0.0};
+        double max{0.0};
+    };
+
+    // Histogram of block loads with logarithmic bins, written by the audio thread and read
+    // from any other thread. Recording is wait-free and never allocates.
+    class LoadProfiler
+    {
+    public:
+        // 16 bins per octave from 2^-16 to 2^4 of the budget, about 4 percent apart
+        static constexpr int binsPerOctave = 16;
+        static constexpr int minOctave = -16;
+        static constexpr int maxOctave = 4;
+        static constexpr int numBins = (maxOctave - minOctave) * binsPerOctave;
+
+        // Only called from the audio thread
+        void record(double load)
+        {
+            if (m_resetRequested.exchange(false, std::memory_order_acquire))
+            {
+                clear();
+            }
+            m_bins[binOf(load)].fetch_add(1, std::memory_order_relaxed);
+            m_sum.store(m_sum.load(std::memory_order_relaxed) + load, std::memory_order_relaxed);
+            if (load > m_max.load(std::memory_order_relaxed))
+            {
+                m_max.store(load, std::memory_order_relaxed);
+            }
+            if (load > m_overrunThreshold.load(std::memory_order_relaxed))
+            {
+                m_overruns.fetch_add(1, std::memory_order_relaxed);
+            }
+            m_count.fetch_add(1, std::memory_order_release);
+        }
+
+        // Share of the budget above which a block counts as an overrun
+        void setOverrunThreshold(double threshold) { m_overrunThreshold.store(threshold, std::memory_order_relaxed); };
+        double getOverrunThreshold() const { return m_overrunThreshold.load(std::memory_order_relaxed); };
+
+        // The histogram is cleared by the audio thread before it records the next block
+        void reset() { m_resetRequested.store(true, std::memory_order_release); };
+
+        uint64_t getBinCount(int bin) const { return m_bins[bin].load(std::memory_order_relaxed); };
+
+        // Geometric centre of a bin, as a share of the budget
+        static double binCentre(int bin)
+        {
+            return std::exp2(minOctave + (bin + 0.5) / binsPerOctave);
+        }
+
+        // Counters are read one by one, so the values may lag a block behind each other
+        LoadStats getStats() const
+        {
+            LoadStats stats;
+            stats.numBlocks = m_count.load(std::memory_order_acquire);
+            stats.numOverruns = m_overruns.load(std::memory_order_relaxed);
+            stats.overrunThreshold = m_overrunThreshold.load(std::memory_order_relaxed);
+            stats.max = m_max.load(std::memory_order_relaxed);
+            if (stats.numBlocks == 0)
+            {
+                return stats;
+            }
+            stats.mean = m_sum.load(std::memory_order_relaxed) / static_cast<double>(stats.numBlocks);
+
+            uint64_t total = 0;
+            for (int b = 0; b < numBins; b++)
+            {
+                total += getBinCount(b);
+            }
+            stats.p50 = percentile(0.5, total, stats.max);
+            stats.p99 = percentile(0.99, total, stats.max);
+            return stats;
+        }
+
+    private:
+        static int binOf(double load)
+        {
+            if (!(load > 0.0))
+            {
+                return 0;
+            }
+            const double pos = (std::log2(load) - minOctave) * binsPerOctave;
+            return static_cast<int>(std::clamp(pos, 0.0, static_cast<double>(numBins - 1)));
+        }
+
+        double percentile(double p, uint64_t total, double max) const
+        {
+            const uint64_t rank = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+            uint64_t sum = 0;
+            for (int b = 0; b < numBins; b++)
+            {
+                sum += getBinCount(b);
+                if (sum >= rank && sum > 0)
+                {
+                    return std::min(binCentre(b), max);
+                }
+            }
+            return max;
+        }
+
+        void clear()
+        {
+            for (auto &bin : m_bins)
+            {
+                bin.store(0, std::memory_order_relaxed);
+            }
+            m_sum.store(0.0, std::memory_order_relaxed);
+            m_max.store(0.0, std::memory_order_relaxed);
+            m_overruns.store(0, std::memory_order_relaxed);
+            m_count.store(0, std::memory_order_relaxed);
+        }
+
+        std::atomic<uint32_t> m_bins[numBins]{};
+        std::atomic<uint64_t> m_count{0};
+        std::atomic<uint64_t> m_overruns{0};
+        std::atomic<double> m_sum{0.0};
+        std::atomic<double> m_max{0.0};
+        std::atomic<double> m_overrunThreshold{0.5};
+        std::atomic<bool> m_resetRequested{false};
+    };
+}
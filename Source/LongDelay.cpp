@@ -0,0 +1,394 @@
+#include "LongDelay.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace MckDsp
+{
+    template <typename SampleType>
+    LongDelay<SampleType>::~LongDelay()
+    {
+        freePages();
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels)
+    {
+        freePages();
+
+        m_numChannels = std::max(1, std::min(maxChannels, numChannels));
+        m_blockSize = static_cast<size_t>(std::max(samplesPerBlock, 1));
+        m_sampleRate = sampleRate;
+        m_pageFrames = static_cast<unsigned>(pageBytes / bytesPerSample(m_format));
+
+        // The page table covers the 60 s limit right away, so it never moves while audio runs
+        m_pages.assign(static_cast<size_t>(pagesFor(maxDelayLimitInMs)) * maxChannels, nullptr);
+
+        // The interpolation taps reach two frames behind and one ahead of a span
+        unsigned decodedLen = 1;
+        while (decodedLen < m_blockSize + interpolationGuardFrames + 1)
+        {
+            decodedLen <<= 1;
+        }
+        m_decoded.allocate(decodedLen);
+        m_decodedMask = decodedLen - 1;
+        m_lineBuf.allocate(m_blockSize);
+
+        std::fill(std::begin(m_apState), std::end(m_apState), SampleType(0));
+        std::fill(std::begin(m_lpHistIn), std::end(m_lpHistIn), SampleType(0));
+        std::fill(std::begin(m_lpHistOut), std::end(m_lpHistOut), SampleType(0));
+        std::fill(std::begin(m_hpHistIn), std::end(m_hpHistIn), SampleType(0));
+        std::fill(std::begin(m_hpHistOut), std::end(m_hpHistOut), SampleType(0));
+        m_idx = 0;
+
+        growTo(pagesFor(m_requestedMaxDelayInMs.load(std::memory_order_relaxed)));
+        updatePages();
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::releaseResources()
+    {
+        freePages();
+        m_pages.clear();
+        m_decoded.allocate(0);
+        m_lineBuf.allocate(0);
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::setArena(DelayArena &arena)
+    {
+        if (&arena != m_arena)
+        {
+            freePages();
+            m_arena = &arena;
+        }
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples)
+    {
+        MCK_TRACE_ZONE("LongDelay::processBlock");
+        updatePages();
+        if (m_len == 0)
+        {
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                if (readPtrs[c] != writePtrs[c])
+                {
+                    std::copy(readPtrs[c], readPtrs[c] + numSamples, writePtrs[c]);
+                }
+            }
+            return;
+        }
+
+        switch (m_interpolation)
+        {
+        case Interpolation::Linear:
+            processBlock<Interpolation::Linear>(readPtrs, writePtrs, numSamples);
+            break;
+        case Interpolation::Lagrange:
+            processBlock<Interpolation::Lagrange>(readPtrs, writePtrs, numSamples);
+            break;
+        case Interpolation::Hermite:
+            processBlock<Interpolation::Hermite>(readPtrs, writePtrs, numSamples);
+            break;
+        case Interpolation::Allpass:
+            processBlock<Interpolation::Allpass>(readPtrs, writePtrs, numSamples);
+            break;
+        default:
+            processBlock<Interpolation::None>(readPtrs, writePtrs, numSamples);
+            break;
+        }
+    }
+
+    template <typename SampleType>
+    template <Interpolation Mode>
+    void LongDelay<SampleType>::processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples)
+    {
+        FractionalReader<SampleType, 1, Mode> reader;
+        reader.setDelay(m_delayInSamples);
+
+        // A span is decoded before any of it is written, so it may not reach the frames it writes
+        const size_t ahead = std::min<size_t>(m_blockSize, reader.n - 1);
+
+        m_wetLevels = LevelAccumulator();
+        m_lineLevels = LevelAccumulator();
+
+        for (size_t offset = 0; offset < numSamples;)
+        {
+            const size_t len = std::min(ahead, numSamples - offset);
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                switch (m_filterStages)
+                {
+                case FilterStages::HighPass:
+                    processSpan<Mode, true, false>(c, reader, readPtrs[c] + offset, writePtrs[c] + offset, len);
+                    break;
+                case FilterStages::LowPass:
+                    processSpan<Mode, false, true>(c, reader, readPtrs[c] + offset, writePtrs[c] + offset, len);
+                    break;
+                case FilterStages::Both:
+                    processSpan<Mode, true, true>(c, reader, readPtrs[c] + offset, writePtrs[c] + offset, len);
+                    break;
+                default:
+                    processSpan<Mode, false, false>(c, reader, readPtrs[c] + offset, writePtrs[c] + offset, len);
+                    break;
+                }
+            }
+            m_idx += static_cast<unsigned>(len);
+            if (m_idx >= m_len)
+            {
+                m_idx -= m_len;
+            }
+            offset += len;
+        }
+    }
+
+    template <typename SampleType>
+    template <Interpolation Mode, bool HighPass, bool LowPass>
+    void LongDelay<SampleType>::processSpan(int c, FractionalReader<SampleType, 1, Mode> reader, const SampleType *readPtr, SampleType *writePtr, size_t numSamples)
+    {
+        // Decoded frame j is the frame written n + 2 - j samples before the span starts,
+        // so a virtual write index of n + 2 + s puts all taps of sample s into the decoded frames
+        const unsigned n = reader.n;
+        SampleType *decoded = m_decoded.data();
+        decode(c, (m_idx + m_len - n - 2) % m_len, decoded, numSamples + interpolationGuardFrames);
+
+        SampleType *line = m_lineBuf.data();
+        const SampleType fb = m_fb;
+        const SampleType wet = m_mix;
+        const SampleType dry = SampleType(1) - m_mix;
+
+        reader.state.v = m_apState[c];
+        FilterChain<SampleType, 1, HighPass, LowPass> chain;
+        chain.load(m_hpCoeffs, m_lpCoeffs, &m_hpHistIn[c], &m_hpHistOut[c], &m_lpHistIn[c], &m_lpHistOut[c]);
+
+        for (size_t s = 0; s < numSamples; s++)
+        {
+            const SampleType dly = reader.read(decoded, m_decodedMask, n + 2 + static_cast<unsigned>(s)).v;
+            const SampleType in = readPtr[s];
+            line[s] = chain.process({fb * dly + in}).v;
+            writePtr[s] = wet * dly + dry * in;
+        }
+
+        chain.store(&m_hpHistIn[c], &m_hpHistOut[c], &m_lpHistIn[c], &m_lpHistOut[c]);
+        m_apState[c] = reader.state.v;
+
+        encode(c, m_idx, line, numSamples);
+
+        // The frames the integer taps read, close enough to the interpolated signal for metering
+        m_wetLevels.add(decoded + 2, numSamples);
+        m_lineLevels.add(line, numSamples);
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::decode(int c, unsigned pos, SampleType *dst, size_t numSamples) const
+    {
+        const size_t bps = bytesPerSample(m_format);
+        while (numSamples > 0)
+        {
+            const unsigned page = pos / m_pageFrames;
+            const unsigned offset = pos - page * m_pageFrames;
+            const size_t len = std::min<size_t>(numSamples, m_pageFrames - offset);
+            const uint8_t *src = static_cast<const uint8_t *>(DelayArena::data(m_pages[static_cast<size_t>(page) * maxChannels + c]));
+            decodeSamples(m_format, src + offset * bps, dst, len);
+            dst += len;
+            numSamples -= len;
+            pos += static_cast<unsigned>(len);
+            if (pos >= m_len)
+            {
+                pos = 0;
+            }
+        }
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::encode(int c, unsigned pos, const SampleType *src, size_t numSamples)
+    {
+        const size_t bps = bytesPerSample(m_format);
+        while (numSamples > 0)
+        {
+            const unsigned page = pos / m_pageFrames;
+            const unsigned offset = pos - page * m_pageFrames;
+            const size_t len = std::min<size_t>(numSamples, m_pageFrames - offset);
+            uint8_t *dst = static_cast<uint8_t *>(DelayArena::data(m_pages[static_cast<size_t>(page) * maxChannels + c]));
+            encodeSamples(m_format, src, dst + offset * bps, len, m_dither[c]);
+            src += len;
+            numSamples -= len;
+            pos += static_cast<unsigned>(len);
+            if (pos >= m_len)
+            {
+                pos = 0;
+            }
+        }
+    }
+
+    template <typename SampleType>
+    unsigned LongDelay<SampleType>::pagesFor(double maxDelayInMs) const
+    {
+        const double ms = std::min(maxDelayInMs, maxDelayLimitInMs);
+        const size_t frames = static_cast<size_t>(std::ceil(ms / 1000.0 * m_sampleRate)) + m_blockSize + interpolationGuardFrames;
+        return static_cast<unsigned>((frames + m_pageFrames - 1) / m_pageFrames);
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::growTo(unsigned numPages)
+    {
+        const unsigned current = m_publishedPages.load(std::memory_order_relaxed);
+        numPages = std::min(numPages, static_cast<unsigned>(m_pages.size() / maxChannels));
+        if (numPages <= current)
+        {
+            return;
+        }
+        for (unsigned p = current; p < numPages; p++)
+        {
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                m_pages[static_cast<size_t>(p) * maxChannels + c] = m_arena->acquire(pageBytes);
+            }
+        }
+        m_publishedPages.store(numPages, std::memory_order_release);
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::freePages()
+    {
+        for (auto &page : m_pages)
+        {
+            if (page != nullptr)
+            {
+                m_arena->release(page);
+                page = nullptr;
+            }
+        }
+        m_publishedPages.store(0, std::memory_order_relaxed);
+        m_numPages = 0;
+        m_len = 0;
+        m_idx = 0;
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::updatePages()
+    {
+        const unsigned numPages = m_publishedPages.load(std::memory_order_acquire);
+        if (numPages != m_numPages)
+        {
+            // The new pages are silent and follow the old ones, so the recent past stays where it is.
+            // Only times reaching behind the write position of the old line jump into the new pages.
+            m_numPages = numPages;
+            m_len = numPages * m_pageFrames;
+            updateMaxDelay();
+        }
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::updateMaxDelay()
+    {
+        const size_t reserved = m_blockSize + interpolationGuardFrames;
+        m_maxDelayInSamples = m_len > reserved ? m_len - static_cast<unsigned>(reserved) : 0;
+        setDelayInMs(m_delayInMs);
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::setMaxDelayInMs(double maxDelayInMs)
+    {
+        maxDelayInMs = std::max(0.0, std::min(maxDelayInMs, maxDelayLimitInMs));
+        m_requestedMaxDelayInMs.store(maxDelayInMs, std::memory_order_relaxed);
+        if (m_sampleRate > 0.0 && !m_pages.empty())
+        {
+            growTo(pagesFor(maxDelayInMs));
+        }
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::setFormat(SampleFormat format)
+    {
+        if (format == m_format)
+        {
+            return;
+        }
+        m_format = format;
+        if (m_sampleRate > 0.0 && !m_pages.empty())
+        {
+            freePages();
+            m_pageFrames = static_cast<unsigned>(pageBytes / bytesPerSample(m_format));
+            m_pages.assign(static_cast<size_t>(pagesFor(maxDelayLimitInMs)) * maxChannels, nullptr);
+            growTo(pagesFor(m_requestedMaxDelayInMs.load(std::memory_order_relaxed)));
+            updatePages();
+        }
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::setDelayInMs(double delayInMs)
+    {
+        // The requested time is kept, so it is reached once the line has grown far enough
+        m_delayInMs = std::min(delayInMs, maxDelayLimitInMs);
+        m_delayInSamples = std::max(minInterpolatedDelay, std::min(m_delayInMs / 1000.0 * m_sampleRate, static_cast<double>(m_maxDelayInSamples)));
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::setInterpolation(Interpolation mode)
+    {
+        if (mode != m_interpolation)
+        {
+            std::fill(std::begin(m_apState), std::end(m_apState), SampleType(0));
+            m_interpolation = mode;
+        }
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::setMix(double mix)
+    {
+        m_mix = static_cast<SampleType>(std::min(1.0, std::max(0.0, mix)));
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::setFeedback(double fb)
+    {
+        m_fb = static_cast<SampleType>(std::min(1.0, std::max(0.0, fb)));
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::setLowPass(bool active, double freq)
+    {
+        if (active && m_lpActive == false)
+        {
+            std::fill(std::begin(m_lpHistIn), std::end(m_lpHistIn), SampleType(0));
+            std::fill(std::begin(m_lpHistOut), std::end(m_lpHistOut), SampleType(0));
+        }
+        m_lpActive = active;
+        m_lpCoeffs = OnePoleFilter<SampleType>::makeLPF(freq, m_sampleRate);
+        m_filterStages = makeFilterStages(m_hpActive, m_lpActive);
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::setHighPass(bool active, double freq)
+    {
+        if (active && m_hpActive == false)
+        {
+            std::fill(std::begin(m_hpHistIn), std::end(m_hpHistIn), SampleType(0));
+            std::fill(std::begin(m_hpHistOut), std::end(m_hpHistOut), SampleType(0));
+        }
+        m_hpActive = active;
+        m_hpCoeffs = OnePoleFilter<SampleType>::makeHPF(freq, m_sampleRate);
+        m_filterStages = makeFilterStages(m_hpActive, m_lpActive);
+    }
+
+    template <typename SampleType>
+    size_t LongDelay<SampleType>::getStorageBytes() const
+    {
+        return static_cast<size_t>(m_publishedPages.load(std::memory_order_relaxed)) * static_cast<size_t>(m_numChannels) * pageBytes;
+    }
+
+    template <typename SampleType>
+    void LongDelay<SampleType>::getLevels(size_t numSamples, Levels &wet, Levels &feedback) const
+    {
+        (void)numSamples;
+        wet = m_wetLevels.get();
+        feedback = m_lineLevels.get();
+    }
+
+    template class LongDelay<float>;
+    template class LongDelay<double>;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include "AlignedBuffer.hpp"
+#include "CompactSamples.hpp"
+#include "DelayArena.hpp"
+#include "FilterChain.hpp"
+#include "Interpolation.hpp"
+#include "OnePoleFilter.hpp"
+#include "Telemetry.hpp"
+
+namespace MckDsp
+{
+    // Delay for multi-second to minute long times with the line stored in a compact sample format.
+    // Every channel is split into pages that are taken from the arena as the maximum time grows,
+    // so memory follows the longest time actually used instead of the 60 s limit.
+    // The signal path matches DelayModule, filters sit in front of the line.
+    template <typename SampleType>
+    class LongDelay
+    {
+    public:
+        static constexpr int maxChannels = 8;
+        static constexpr double maxDelayLimitInMs = 60000.0;
+        // One page holds pageBytes bytes of a single channel
+        static constexpr size_t pageBytes = size_t(1) << 17;
+
+        LongDelay() = default;
+        ~LongDelay();
+
+        LongDelay(const LongDelay &) = delete;
+        LongDelay &operator=(const LongDelay &) = delete;
+
+        void prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels);
+
+        // Hands all pages back to the arena, only while audio is stopped
+        void releaseResources();
+
+        // Selects the arena the pages are taken from, only while audio is stopped
+        void setArena(DelayArena &arena);
+
+        // Processes numSamples samples of every channel, readPtrs and writePtrs may alias
+        void processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples);
+
+        // May be called from any thread but the audio thread, though not concurrently with prepareToPlay()
+        // or setFormat(). Missing pages are taken from the arena on the calling thread and used from the next
+        // block on. The line only grows, releaseResources() gives the memory back.
+        void setMaxDelayInMs(double maxDelayInMs);
+        double getMaxDelayInMs() { return m_requestedMaxDelayInMs.load(std::memory_order_relaxed); };
+
+        // Discards the line and rebuilds it in the new format, only while audio is stopped
+        void setFormat(SampleFormat format);
+        SampleFormat getFormat() { return m_format; };
+
+        void setDelayInMs(double delayInMs);
+
+        // Selects how fractional delay times are read from the decoded line
+        void setInterpolation(Interpolation mode);
+        Interpolation getInterpolation() { return m_interpolation; };
+
+        void setMix(double mix);
+
+        void setFeedback(double fb);
+
+        void setLowPass(bool active, double freq = 20000.0);
+
+        void setHighPass(bool active, double freq = 10.0);
+
+        int getNumChannels() { return m_numChannels; };
+
+        // Sample memory currently held by the line, as seen by the calling thread
+        size_t getStorageBytes() const;
+
+        // Levels of the delayed signal and of the signal written into the line during the last
+        // processBlock() call, numSamples has to match the length of that call
+        void getLevels(size_t numSamples, Levels &wet, Levels &feedback) const;
+
+    private:
+        template <Interpolation Mode>
+        void processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples);
+
+        // Runs numSamples samples of channel c, numSamples must not exceed the integer delay minus one
+        template <Interpolation Mode, bool HighPass, bool LowPass>
+        void processSpan(int c, FractionalReader<SampleType, 1, Mode> reader, const SampleType *readPtr, SampleType *writePtr, size_t numSamples);
+
+        // Frames in the line between pos and pos + numSamples, wrapping at the end of the line
+        void decode(int c, unsigned pos, SampleType *dst, size_t numSamples) const;
+        void encode(int c, unsigned pos, const SampleType *src, size_t numSamples);
+
+        unsigned pagesFor(double maxDelayInMs) const;
+
+        // Takes pages from the arena until the line holds numPages pages per channel
+        void growTo(unsigned numPages);
+
+        void freePages();
+
+        // Takes over pages published by setMaxDelayInMs()
+        void updatePages();
+
+        void updateMaxDelay();
+
+        int m_numChannels{0};
+        size_t m_blockSize{0};
+        double m_sampleRate{0};
+
+        SampleType m_mix{0};
+        SampleType m_fb{0};
+
+        std::atomic<double> m_requestedMaxDelayInMs{4000.0};
+        unsigned m_maxDelayInSamples{0};
+
+        double m_delayInMs{0.0};
+        double m_delayInSamples{minInterpolatedDelay};
+
+        Interpolation m_interpolation{Interpolation::None};
+        SampleType m_apState[maxChannels]{};
+
+        typename OnePoleFilter<SampleType>::Coefficients m_lpCoeffs{};
+        typename OnePoleFilter<SampleType>::Coefficients m_hpCoeffs{};
+        bool m_lpActive{false};
+        bool m_hpActive{false};
+        FilterStages m_filterStages{FilterStages::None};
+
+        SampleType m_lpHistIn[maxChannels]{};
+        SampleType m_lpHistOut[maxChannels]{};
+        SampleType m_hpHistIn[maxChannels]{};
+        SampleType m_hpHistOut[maxChannels]{};
+
+        SampleFormat m_format{SampleFormat::Pcm24};
+        Dither m_dither[maxChannels]{};
+        // Frames per page for the current format
+        unsigned m_pageFrames{0};
+
+        // Page p of channel c is m_pages[p * maxChannels + c]. Slots up to m_publishedPages are
+        // filled before the count is published and never move until releaseResources()
+        std::vector<DelayArena::Block *> m_pages{};
+        std::atomic<unsigned> m_publishedPages{0};
+        DelayArena *m_arena{&DelayArena::shared()};
+
+        // Owned by the audio thread, the line holds m_len = m_numPages * m_pageFrames frames
+        unsigned m_numPages{0};
+        unsigned m_len{0};
+        unsigned m_idx{0};
+
+        // Decoded frames of the current span and the signal written back into the line
+        AlignedBuffer<SampleType> m_decoded{};
+        unsigned m_decodedMask{0};
+        AlignedBuffer<SampleType> m_lineBuf{};
+
+        LevelAccumulator m_wetLevels{};
+        LevelAccumulator m_lineLevels{};
+    };
+
+    extern template class LongDelay<float>;
+    extern template class LongDelay<double>;
+}
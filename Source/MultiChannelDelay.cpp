@@ -0,0 +1,609 @@
+#include "MultiChannelDelay.hpp"
+#include "Trace.hpp"
+#include "SimdVec.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace MckDsp
+{
+    namespace
+    {
+        // Per frame math of the delay, every lane of V holds one channel
+        template <typename SampleType, int Lanes, bool HighPass, bool LowPass>
+        struct FrameKernel
+        {
+            using V = Vec<SampleType, Lanes>;
+
+            V fb, wet, dry;
+            FilterChain<SampleType, Lanes, HighPass, LowPass> filter;
+
+            // Returns the sample that is written back into the delay line
+            inline V feedback(const V &in, const V &dly)
+            {
+                return filter.process(fb * dly + in);
+            }
+
+            inline V mix(const V &in, const V &dly)
+            {
+                return wet * dly + dry * in;
+            }
+        };
+
+        int lanesForChannels(int numChannels)
+        {
+            int lanes = 1;
+            while (lanes < numChannels)
+            {
+                lanes <<= 1;
+            }
+            return lanes;
+        }
+    }
+
+    template <typename SampleType>
+    MultiChannelDelay<SampleType>::~MultiChannelDelay()
+    {
+        delete m_pendingConvolver.exchange(nullptr);
+        delete m_retiredConvolver.exchange(nullptr);
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels)
+    {
+        m_numChannels = std::max(1, std::min(maxChannels, numChannels));
+        m_lanes = lanesForChannels(m_numChannels);
+        m_blockSize = static_cast<size_t>(std::max(samplesPerBlock, 1));
+        m_sampleRate = sampleRate;
+
+        m_frames.allocate(m_blockSize * m_lanes);
+
+        resetFilters(m_lpHistIn, m_lpHistOut);
+        resetFilters(m_hpHistIn, m_hpHistOut);
+        std::fill(m_apState, m_apState + maxChannels, SampleType(0));
+        m_lfo.prepareToPlay(sampleRate, m_lanes);
+        m_modDepthInSamples = m_modDepthInMs / 1000.0 * sampleRate;
+
+        // Audio is stopped, so a queued response is taken over right away and sized for the new lanes
+        if (auto *pending = m_pendingConvolver.exchange(nullptr))
+        {
+            m_convolver.reset(pending);
+        }
+        delete m_retiredConvolver.exchange(nullptr);
+        if (m_convolver != nullptr)
+        {
+            if (m_convolver->getNumLanes() != m_lanes)
+            {
+                m_convolver->setNumLanes(m_lanes);
+            }
+            m_convolver->reset();
+        }
+        m_convIn.allocate(convolutionLatency * m_lanes);
+        m_convOut.allocate(convolutionLatency * m_lanes);
+        m_convPos = 0;
+
+        // Keeps the current block if it is large enough, e.g. for a lower sample rate or fewer channels
+        m_storage.prepare(bufferBytes(m_requestedMaxDelayInMs.load(std::memory_order_relaxed)));
+        attachBuffer();
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::releaseResources()
+    {
+        m_storage.release();
+        attachBuffer();
+        m_frames.allocate(0);
+        m_convolver.reset();
+        delete m_pendingConvolver.exchange(nullptr);
+        delete m_retiredConvolver.exchange(nullptr);
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples)
+    {
+        MCK_TRACE_ZONE("MultiChannelDelay::processBlock");
+        updateBuffer();
+        updateConvolver();
+        if (m_len == 0)
+        {
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                if (readPtrs[c] != writePtrs[c])
+                {
+                    std::copy(readPtrs[c], readPtrs[c] + numSamples, writePtrs[c]);
+                }
+            }
+            return;
+        }
+
+        SampleType *frames = m_frames.data();
+        const size_t lanes = static_cast<size_t>(m_lanes);
+
+        for (size_t offset = 0; offset < numSamples; offset += m_blockSize)
+        {
+            const size_t len = std::min(m_blockSize, numSamples - offset);
+
+            {
+                MCK_TRACE_ZONE("Interleave");
+                for (int c = 0; c < m_numChannels; c++)
+                {
+                    const SampleType *readPtr = readPtrs[c] + offset;
+                    for (size_t s = 0; s < len; s++)
+                    {
+                        frames[s * lanes + c] = readPtr[s];
+                    }
+                }
+            }
+
+            {
+                // The filters run inside the delay kernel, so they share its zone
+                MCK_TRACE_ZONE("Delay+Filter");
+                switch (m_lanes)
+                {
+                case 1:
+                    processFrames<1>(frames, len);
+                    break;
+                case 2:
+                    processFrames<2>(frames, len);
+                    break;
+                case 4:
+                    processFrames<4>(frames, len);
+                    break;
+                default:
+                    processFrames<8>(frames, len);
+                    break;
+                }
+            }
+
+            MCK_TRACE_ZONE("Deinterleave");
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                SampleType *writePtr = writePtrs[c] + offset;
+                for (size_t s = 0; s < len; s++)
+                {
+                    writePtr[s] = frames[s * lanes + c];
+                }
+            }
+        }
+    }
+
+    template <typename SampleType>
+    template <int Lanes>
+    void MultiChannelDelay<SampleType>::processFrames(SampleType *frames, size_t numFrames)
+    {
+        switch (m_interpolation)
+        {
+        case Interpolation::Linear:
+            processFrames<Lanes, Interpolation::Linear>(frames, numFrames);
+            break;
+        case Interpolation::Lagrange:
+            processFrames<Lanes, Interpolation::Lagrange>(frames, numFrames);
+            break;
+        case Interpolation::Hermite:
+            processFrames<Lanes, Interpolation::Hermite>(frames, numFrames);
+            break;
+        case Interpolation::Allpass:
+            processFrames<Lanes, Interpolation::Allpass>(frames, numFrames);
+            break;
+        default:
+            processFrames<Lanes, Interpolation::None>(frames, numFrames);
+            break;
+        }
+    }
+
+    template <typename SampleType>
+    template <int Lanes, Interpolation Mode>
+    void MultiChannelDelay<SampleType>::processFrames(SampleType *frames, size_t numFrames)
+    {
+        // The filter stages only change with the lpactive/hpactive settings, so they are picked once per block
+        switch (m_filterStages)
+        {
+        case FilterStages::HighPass:
+            processFrames<Lanes, Mode, true, false>(frames, numFrames);
+            break;
+        case FilterStages::LowPass:
+            processFrames<Lanes, Mode, false, true>(frames, numFrames);
+            break;
+        case FilterStages::Both:
+            processFrames<Lanes, Mode, true, true>(frames, numFrames);
+            break;
+        default:
+            processFrames<Lanes, Mode, false, false>(frames, numFrames);
+            break;
+        }
+    }
+
+    template <typename SampleType>
+    template <int Lanes, Interpolation Mode, bool HighPass, bool LowPass>
+    void MultiChannelDelay<SampleType>::processFrames(SampleType *frames, size_t numFrames)
+    {
+        if (convolving())
+        {
+            processConvolvedFrames<Lanes, Mode, HighPass, LowPass>(frames, numFrames);
+            return;
+        }
+
+        using V = Vec<SampleType, Lanes>;
+
+        FrameKernel<SampleType, Lanes, HighPass, LowPass> k;
+        k.fb = V::broadcast(m_fb);
+        k.wet = V::broadcast(m_mix);
+        k.dry = V::broadcast(SampleType(1) - m_mix);
+        k.filter.load(m_hpCoeffs, m_lpCoeffs, m_hpHistIn, m_hpHistOut, m_lpHistIn, m_lpHistOut);
+
+        FractionalReader<SampleType, Lanes, Mode> reader;
+        reader.state = V::load(m_apState);
+
+        SampleType *buf = m_buf;
+
+        if (m_modDepthInSamples > 0.0)
+        {
+            // Under modulation every lane of every frame reads from its own position
+            ModulatedReader<SampleType, Lanes, Mode> modReader;
+            modReader.state = reader.state;
+            const double maxDelay = static_cast<double>(m_maxDelayInSamples);
+            double delays[Lanes];
+            for (size_t s = 0; s < numFrames * Lanes; s += Lanes)
+            {
+                double centre = m_delayInSamples;
+                if (m_rampPos < m_rampLen)
+                {
+                    centre = m_rampStartInSamples + static_cast<double>(m_rampPos++) * m_rampIncInSamples;
+                }
+                const SampleType *mod = m_lfo.next();
+                for (int l = 0; l < Lanes; l++)
+                {
+                    delays[l] = std::max(minInterpolatedDelay, std::min(centre + m_modDepthInSamples * static_cast<double>(mod[l]), maxDelay));
+                }
+
+                const V in = V::load(frames + s);
+                const V dly = modReader.read(buf, m_mask, m_idx, delays);
+                k.feedback(in, dly).store(buf + m_idx * Lanes);
+                k.mix(in, dly).store(frames + s);
+
+                m_idx = (m_idx + 1) & m_mask;
+            }
+
+            k.filter.store(m_hpHistIn, m_hpHistOut, m_lpHistIn, m_lpHistOut);
+            modReader.state.store(m_apState);
+            return;
+        }
+
+        // While the delay time ramps, every frame reads from its own position
+        while (m_rampPos < m_rampLen && numFrames > 0)
+        {
+            reader.setDelay(m_rampStartInSamples + static_cast<double>(m_rampPos) * m_rampIncInSamples);
+
+            const V in = V::load(frames);
+            const V dly = reader.read(buf, m_mask, m_idx);
+            k.feedback(in, dly).store(buf + m_idx * Lanes);
+            k.mix(in, dly).store(frames);
+
+            m_idx = (m_idx + 1) & m_mask;
+            frames += Lanes;
+            numFrames--;
+            m_rampPos++;
+        }
+
+        reader.setDelay(m_delayInSamples);
+
+        if constexpr (Mode == Interpolation::None)
+        {
+            // Constant delay time, split into spans in which neither head wraps
+            while (numFrames > 0)
+            {
+                const unsigned readIdx = (m_idx - reader.n) & m_mask;
+                const size_t len = std::min<size_t>(numFrames, std::min(m_len - m_idx, m_len - readIdx));
+
+                const SampleType *dlyPtr = buf + readIdx * Lanes;
+                SampleType *bufPtr = buf + m_idx * Lanes;
+
+                for (size_t s = 0; s < len * Lanes; s += Lanes)
+                {
+                    const V in = V::load(frames + s);
+                    const V dly = V::load(dlyPtr + s);
+                    k.feedback(in, dly).store(bufPtr + s);
+                    k.mix(in, dly).store(frames + s);
+                }
+
+                m_idx = (m_idx + static_cast<unsigned>(len)) & m_mask;
+                frames += len * Lanes;
+                numFrames -= len;
+            }
+        }
+        else
+        {
+            // Constant fraction, the coefficients stay in registers for the whole block
+            for (size_t s = 0; s < numFrames * Lanes; s += Lanes)
+            {
+                const V in = V::load(frames + s);
+                const V dly = reader.read(buf, m_mask, m_idx);
+                k.feedback(in, dly).store(buf + m_idx * Lanes);
+                k.mix(in, dly).store(frames + s);
+
+                m_idx = (m_idx + 1) & m_mask;
+            }
+        }
+
+        k.filter.store(m_hpHistIn, m_hpHistOut, m_lpHistIn, m_lpHistOut);
+        reader.state.store(m_apState);
+    }
+
+    template <typename SampleType>
+    template <int Lanes, Interpolation Mode, bool HighPass, bool LowPass>
+    void MultiChannelDelay<SampleType>::processConvolvedFrames(SampleType *frames, size_t numFrames)
+    {
+        using V = Vec<SampleType, Lanes>;
+
+        FrameKernel<SampleType, Lanes, HighPass, LowPass> k;
+        k.fb = V::broadcast(m_fb);
+        k.wet = V::broadcast(m_mix);
+        k.dry = V::broadcast(SampleType(1) - m_mix);
+        k.filter.load(m_hpCoeffs, m_lpCoeffs, m_hpHistIn, m_hpHistOut, m_lpHistIn, m_lpHistOut);
+
+        // The ramp, the modulation and the latency all move the read position, so every lane of
+        // every frame reads from its own position. The FFTs outweigh the gathers by far.
+        ModulatedReader<SampleType, Lanes, Mode> reader;
+        reader.state = V::load(m_apState);
+
+        SampleType *buf = m_buf;
+        SampleType *convIn = m_convIn.data();
+        SampleType *convOut = m_convOut.data();
+        const double latency = static_cast<double>(convolutionLatency);
+        const double maxDelay = static_cast<double>(m_maxDelayInSamples);
+        const bool modulated = m_modDepthInSamples > 0.0;
+        double delays[Lanes];
+
+        for (size_t s = 0; s < numFrames * Lanes; s += Lanes)
+        {
+            double centre = m_delayInSamples;
+            if (m_rampPos < m_rampLen)
+            {
+                centre = m_rampStartInSamples + static_cast<double>(m_rampPos++) * m_rampIncInSamples;
+            }
+            centre -= latency;
+            const SampleType *mod = modulated ? m_lfo.next() : nullptr;
+            for (int l = 0; l < Lanes; l++)
+            {
+                const double delay = modulated ? centre + m_modDepthInSamples * static_cast<double>(mod[l]) : centre;
+                delays[l] = std::max(minInterpolatedDelay, std::min(delay, maxDelay));
+            }
+
+            // The line receives the convolution of what was fed back one partition ago
+            const V in = V::load(frames + s);
+            const V dly = reader.read(buf, m_mask, m_idx, delays);
+            k.feedback(in, dly).store(convIn + m_convPos * Lanes);
+            V::load(convOut + m_convPos * Lanes).store(buf + m_idx * Lanes);
+            k.mix(in, dly).store(frames + s);
+
+            m_idx = (m_idx + 1) & m_mask;
+            if (++m_convPos == convolutionLatency)
+            {
+                m_convolver->process(convIn, convOut);
+                m_convPos = 0;
+            }
+        }
+
+        k.filter.store(m_hpHistIn, m_hpHistOut, m_lpHistIn, m_lpHistOut);
+        reader.state.store(m_apState);
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setMaxDelayInMs(double maxDelayInMs)
+    {
+        m_requestedMaxDelayInMs.store(maxDelayInMs, std::memory_order_relaxed);
+
+        // The frame layout is only known after prepareToPlay
+        if (m_lanes > 0)
+        {
+            m_storage.request(bufferBytes(maxDelayInMs));
+        }
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setDelayInMs(double delayInMs, size_t rampLength)
+    {
+        delayInMs = std::min(delayInMs, m_maxDelayInMs);
+        double delayInSamples = std::max(minInterpolatedDelay, std::min(delayInMs / 1000.0 * m_sampleRate, static_cast<double>(m_maxDelayInSamples)));
+
+        if (rampLength > 0 && delayInSamples != m_delayInSamples)
+        {
+            // Ramp in samples with one increment per block, the per frame work is a multiply add
+            m_rampStartInSamples = currentDelayInSamples();
+            m_rampIncInSamples = (delayInSamples - m_rampStartInSamples) / static_cast<double>(rampLength);
+            m_rampPos = 0;
+            m_rampLen = rampLength;
+        }
+        else
+        {
+            m_rampPos = m_rampLen = 0;
+        }
+
+        m_delayInMs = delayInMs;
+        m_delayInSamples = delayInSamples;
+    }
+
+    template <typename SampleType>
+    double MultiChannelDelay<SampleType>::currentDelayInSamples() const
+    {
+        if (m_rampPos < m_rampLen)
+        {
+            return m_rampStartInSamples + static_cast<double>(m_rampPos) * m_rampIncInSamples;
+        }
+        return m_delayInSamples;
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setModulation(LfoShape shape, double rateInHz, double depthInMs, double phase, double phaseOffset)
+    {
+        m_lfo.setShape(shape);
+        m_lfo.setRate(rateInHz);
+        m_lfo.setPhase(phase, phaseOffset);
+        m_modDepthInMs = std::max(0.0, depthInMs);
+        m_modDepthInSamples = m_modDepthInMs / 1000.0 * m_sampleRate;
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setImpulseResponse(const float *ir, size_t length)
+    {
+        auto *convolver = new PartitionedConvolver<SampleType>();
+        convolver->prepare(ir, length, m_lanes);
+
+        // Frees the response the audio thread replaced last, and one it never got to take over
+        delete m_retiredConvolver.exchange(nullptr);
+        delete m_pendingConvolver.exchange(convolver);
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setConvolution(bool active)
+    {
+        // Starts from silence instead of the input of the last time it ran
+        if (active && m_convActive == false)
+        {
+            if (m_convolver != nullptr)
+            {
+                m_convolver->reset();
+            }
+            m_convOut.clear();
+            m_convPos = 0;
+        }
+        m_convActive = active;
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::updateConvolver()
+    {
+        // Waits with the swap until the previously replaced response has been freed
+        if (m_pendingConvolver.load(std::memory_order_relaxed) == nullptr ||
+            m_retiredConvolver.load(std::memory_order_acquire) != nullptr)
+        {
+            return;
+        }
+        PartitionedConvolver<SampleType> *pending = m_pendingConvolver.exchange(nullptr, std::memory_order_acquire);
+        m_retiredConvolver.store(m_convolver.release(), std::memory_order_release);
+        m_convolver.reset(pending);
+        m_convOut.clear();
+        m_convPos = 0;
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setInterpolation(Interpolation mode)
+    {
+        if (mode != m_interpolation)
+        {
+            std::fill(m_apState, m_apState + maxChannels, SampleType(0));
+            m_interpolation = mode;
+        }
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setMix(double mix)
+    {
+        m_mix = static_cast<SampleType>(std::min(1.0, std::max(0.0, mix)));
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setFeedback(double fb)
+    {
+        m_fb = static_cast<SampleType>(std::min(1.0, std::max(0.0, fb)));
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setLowPass(bool active, double freq)
+    {
+        // Bypassed stages don't run, so they start from silence when switched on again
+        if (active && m_lpActive == false)
+        {
+            resetFilters(m_lpHistIn, m_lpHistOut);
+        }
+        m_lpActive = active;
+        m_lpCoeffs = OnePoleFilter<SampleType>::makeLPF(freq, m_sampleRate);
+        m_filterStages = makeFilterStages(m_hpActive, m_lpActive);
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::setHighPass(bool active, double freq)
+    {
+        if (active && m_hpActive == false)
+        {
+            resetFilters(m_hpHistIn, m_hpHistOut);
+        }
+        m_hpActive = active;
+        m_hpCoeffs = OnePoleFilter<SampleType>::makeHPF(freq, m_sampleRate);
+        m_filterStages = makeFilterStages(m_hpActive, m_lpActive);
+    }
+
+    template <typename SampleType>
+    size_t MultiChannelDelay<SampleType>::bufferBytes(double maxDelayInMs) const
+    {
+        // The arena rounds up to a power of two, which keeps the frame count a power of two as well
+        const size_t maxDly = static_cast<size_t>(std::ceil(maxDelayInMs / 1000.0 * m_sampleRate));
+        return (maxDly + interpolationGuardFrames) * static_cast<size_t>(m_lanes) * sizeof(SampleType);
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::updateBuffer()
+    {
+        if (m_storage.update())
+        {
+            attachBuffer();
+        }
+        else if (m_requestedMaxDelayInMs.load(std::memory_order_relaxed) != m_maxDelayInMs)
+        {
+            updateMaxDelay();
+        }
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::attachBuffer()
+    {
+        // A new block starts out silent and writing restarts at its first frame
+        m_buf = static_cast<SampleType *>(m_storage.data());
+        m_len = m_lanes > 0 ? static_cast<unsigned>(m_storage.size() / (static_cast<size_t>(m_lanes) * sizeof(SampleType))) : 0;
+        m_mask = m_len > 0 ? m_len - 1 : 0;
+        m_idx = 0;
+        updateMaxDelay();
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::updateMaxDelay()
+    {
+        m_maxDelayInMs = m_requestedMaxDelayInMs.load(std::memory_order_relaxed);
+
+        // Until a larger buffer arrives, the delay is limited to what the current one can hold
+        const unsigned maxDly = static_cast<unsigned>(std::ceil(m_maxDelayInMs / 1000.0 * m_sampleRate));
+        const unsigned maxFit = m_len > interpolationGuardFrames ? m_len - interpolationGuardFrames : 0;
+        m_maxDelayInSamples = std::min(maxDly, maxFit);
+        m_delayInSamples = std::max(minInterpolatedDelay, std::min(m_delayInSamples, static_cast<double>(m_maxDelayInSamples)));
+        m_rampPos = m_rampLen = 0;
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::getLevels(size_t numSamples, Levels &wet, Levels &feedback) const
+    {
+        LevelAccumulator wetAcc, fbAcc;
+        if (m_len > 0)
+        {
+            const unsigned start = m_idx - static_cast<unsigned>(numSamples);
+            const double latency = convolving() ? static_cast<double>(convolutionLatency) : 0.0;
+            const unsigned delay = static_cast<unsigned>(std::max(minInterpolatedDelay, m_delayInSamples - latency) + 0.5);
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                wetAcc.addRing(m_buf, m_len, start - delay, numSamples, m_lanes, c);
+                fbAcc.addRing(m_buf, m_len, start, numSamples, m_lanes, c);
+            }
+        }
+        wet = wetAcc.get();
+        feedback = fbAcc.get();
+    }
+
+    template <typename SampleType>
+    void MultiChannelDelay<SampleType>::resetFilters(SampleType *histIn, SampleType *histOut)
+    {
+        std::fill(histIn, histIn + maxChannels, SampleType(0));
+        std::fill(histOut, histOut + maxChannels, SampleType(0));
+    }
+
+    template class MultiChannelDelay<float>;
+    template class MultiChannelDelay<double>;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include "AlignedBuffer.hpp"
+#include "DelayArena.hpp"
+#include "FilterChain.hpp"
+#include "Interpolation.hpp"
+#include "Lfo.hpp"
+#include "OnePoleFilter.hpp"
+#include "PartitionedConvolver.hpp"
+#include "Telemetry.hpp"
+
+namespace MckDsp
+{
+    // Delay line for up to maxChannels channels that share the same settings.
+    // All channels are stored interleaved in one aligned ring buffer, and the
+    // feedback, filter and mix math of every channel runs side by side in SIMD lanes.
+    template <typename SampleType>
+    class MultiChannelDelay
+    {
+    public:
+        static constexpr int maxChannels = 8;
+
+        // The convolution output arrives one partition late, reads move closer by as much
+        static constexpr size_t convolutionLatency = PartitionedConvolver<SampleType>::partitionSize;
+
+        MultiChannelDelay() = default;
+        ~MultiChannelDelay();
+
+        void prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels);
+
+        // Hands the ring buffer back to the arena and drops the impulse response, only while audio is stopped
+        void releaseResources();
+
+        // Selects the arena the ring buffer is taken from, only while audio is stopped
+        void setArena(DelayArena &arena) { m_storage.setArena(arena); };
+
+        // Processes numSamples samples of every channel, readPtrs and writePtrs may alias
+        void processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples);
+
+        // Called from one thread other than the audio thread, usually the message thread. A larger buffer is
+        // reserved there, as that may allocate,
+        // and taken over by the audio thread at the start of the next block
+        void setMaxDelayInMs(double maxDelayInMs);
+        double getMaxDelayInMs() { return m_requestedMaxDelayInMs.load(std::memory_order_relaxed); };
+
+        // Moves the delay time linearly to delayInMs over the next rampLength samples,
+        // starting from wherever a previous ramp currently is
+        void setDelayInMs(double delayInMs, size_t rampLength = 0);
+
+        // Selects how fractional delay times are read from the ring buffer
+        void setInterpolation(Interpolation mode);
+        Interpolation getInterpolation() { return m_interpolation; };
+
+        // Moves the read position of every channel around the delay time by up to depthInMs,
+        // a depth of zero turns the modulation off. Channel c runs phase + c * phaseOffset
+        // cycles ahead in the LFO, ramps move the centre of the modulation.
+        void setModulation(LfoShape shape, double rateInHz, double depthInMs, double phase = 0.0, double phaseOffset = 0.0);
+
+        void setMix(double mix);
+
+        void setFeedback(double fb);
+
+        // Frequency changes keep the filter history, so they can change between blocks without clicks.
+        // A bypassed stage costs nothing and starts from silence when it is switched on again.
+        void setLowPass(bool active, double freq = 20000.0);
+
+        void setHighPass(bool active, double freq = 10.0);
+
+        // Convolves the signal written into the line with length samples of ir, so every repeat
+        // takes on its colour once more. The spectra are built on the calling thread, which must not
+        // be the audio thread, and the next block takes them over. A length of zero removes the response.
+        void setImpulseResponse(const float *ir, size_t length);
+
+        // While the convolution runs, the line is read convolutionLatency samples closer to the
+        // write head to keep the repeats in time, so shorter delay times grow to that latency
+        void setConvolution(bool active);
+
+        int getNumChannels() { return m_numChannels; };
+
+        // Levels of the delayed signal and of the signal written into the line during the
+        // last numSamples samples, read back from the ring buffer after processBlock()
+        void getLevels(size_t numSamples, Levels &wet, Levels &feedback) const;
+
+    private:
+        template <int Lanes>
+        void processFrames(SampleType *frames, size_t numFrames);
+
+        template <int Lanes, Interpolation Mode>
+        void processFrames(SampleType *frames, size_t numFrames);
+
+        template <int Lanes, Interpolation Mode, bool HighPass, bool LowPass>
+        void processFrames(SampleType *frames, size_t numFrames);
+
+        template <int Lanes, Interpolation Mode, bool HighPass, bool LowPass>
+        void processConvolvedFrames(SampleType *frames, size_t numFrames);
+
+        size_t bufferBytes(double maxDelayInMs) const;
+
+        // Takes over a buffer or maximum delay time queued by setMaxDelayInMs()
+        void updateBuffer();
+
+        void attachBuffer();
+
+        void updateMaxDelay();
+
+        // Takes over a response queued by setImpulseResponse(), the replaced one is freed off the audio thread
+        void updateConvolver();
+
+        inline bool convolving() const
+        {
+            return m_convActive && m_convolver != nullptr && m_convolver->getLength() > 0 && m_convolver->getNumLanes() == m_lanes;
+        }
+
+        double currentDelayInSamples() const;
+
+        void resetFilters(SampleType *histIn, SampleType *histOut);
+
+        int m_numChannels{0};
+        int m_lanes{0};
+        size_t m_blockSize{0};
+
+        double m_sampleRate{0};
+
+        SampleType m_mix{0};
+        SampleType m_fb{0};
+
+        std::atomic<double> m_requestedMaxDelayInMs{1000.0};
+        double m_maxDelayInMs{1000.0};
+        unsigned m_maxDelayInSamples{0};
+
+        double m_delayInMs{0.0};
+        double m_delayInSamples{minInterpolatedDelay};
+
+        Interpolation m_interpolation{Interpolation::None};
+
+        double m_rampStartInSamples{0.0};
+        double m_rampIncInSamples{0.0};
+        size_t m_rampPos{0};
+        size_t m_rampLen{0};
+
+        Lfo<SampleType> m_lfo{};
+        double m_modDepthInMs{0.0};
+        double m_modDepthInSamples{0.0};
+
+        typename OnePoleFilter<SampleType>::Coefficients m_lpCoeffs{};
+        typename OnePoleFilter<SampleType>::Coefficients m_hpCoeffs{};
+        bool m_lpActive{false};
+        bool m_hpActive{false};
+        FilterStages m_filterStages{FilterStages::None};
+
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_lpHistIn[maxChannels]{};
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_lpHistOut[maxChannels]{};
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_hpHistIn[maxChannels]{};
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_hpHistOut[maxChannels]{};
+        alignas(AlignedBuffer<SampleType>::alignment) SampleType m_apState[maxChannels]{};
+
+        // Ring buffer of m_len frames with m_lanes interleaved samples each
+        unsigned m_len{0};
+        unsigned m_mask{0};
+        unsigned m_idx{0};
+        SampleType *m_buf{nullptr};
+        DelayStorage m_storage{};
+
+        // Interleaved copy of the current block, holds up to m_blockSize frames
+        AlignedBuffer<SampleType> m_frames{};
+
+        // Owned by the audio thread, the other two only pass responses between the threads
+        std::unique_ptr<PartitionedConvolver<SampleType>> m_convolver{};
+        std::atomic<PartitionedConvolver<SampleType> *> m_pendingConvolver{nullptr};
+        std::atomic<PartitionedConvolver<SampleType> *> m_retiredConvolver{nullptr};
+        bool m_convActive{false};
+
+        // Partition of convolution input being collected and the output written meanwhile
+        AlignedBuffer<SampleType> m_convIn{};
+        AlignedBuffer<SampleType> m_convOut{};
+        size_t m_convPos{0};
+    };
+
+    extern template class MultiChannelDelay<float>;
+    extern template class MultiChannelDelay<double>;
+}
@@ -0,0 +1,394 @@
+#include "MultiTapDelay.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace MckDsp
+{
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels)
+    {
+        m_numChannels = std::max(1, std::min(maxChannels, numChannels));
+        m_blockSize = static_cast<size_t>(std::max(samplesPerBlock, 1));
+        m_sampleRate = sampleRate;
+
+        m_tapBuf.allocate(m_blockSize);
+        m_fbSum.allocate(m_blockSize);
+        m_outSum.allocate(m_blockSize);
+
+        resetState();
+
+        m_storage.prepare(bufferBytes(m_requestedMaxDelayInMs.load(std::memory_order_relaxed)));
+        attachBuffer();
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::releaseResources()
+    {
+        m_storage.release();
+        attachBuffer();
+        m_tapBuf.allocate(0);
+        m_fbSum.allocate(0);
+        m_outSum.allocate(0);
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples)
+    {
+        MCK_TRACE_ZONE("MultiTapDelay::processBlock");
+        updateBuffer();
+        if (m_len == 0)
+        {
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                if (readPtrs[c] != writePtrs[c])
+                {
+                    std::copy(readPtrs[c], readPtrs[c] + numSamples, writePtrs[c]);
+                }
+            }
+            return;
+        }
+
+        switch (m_interpolation)
+        {
+        case Interpolation::Linear:
+            processBlock<Interpolation::Linear>(readPtrs, writePtrs, numSamples);
+            break;
+        case Interpolation::Lagrange:
+            processBlock<Interpolation::Lagrange>(readPtrs, writePtrs, numSamples);
+            break;
+        case Interpolation::Hermite:
+            processBlock<Interpolation::Hermite>(readPtrs, writePtrs, numSamples);
+            break;
+        case Interpolation::Allpass:
+            processBlock<Interpolation::Allpass>(readPtrs, writePtrs, numSamples);
+            break;
+        default:
+            processBlock<Interpolation::None>(readPtrs, writePtrs, numSamples);
+            break;
+        }
+    }
+
+    template <typename SampleType>
+    template <Interpolation Mode>
+    void MultiTapDelay<SampleType>::processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples)
+    {
+        const SampleType fb = m_fb;
+        const SampleType wet = m_mix;
+        const SampleType dry = SampleType(1) - m_mix;
+        const bool stereo = m_numChannels == 2;
+
+        SampleType *tapBuf = m_tapBuf.data();
+        SampleType *fbSum = m_fbSum.data();
+        SampleType *outSum = m_outSum.data();
+
+        m_wetLevels = LevelAccumulator();
+
+        // Taps are read a whole sub-block ahead, which is safe as long as no tap
+        // reaches into samples that are written within the same sub-block
+        for (size_t offset = 0; offset < numSamples;)
+        {
+            const size_t len = std::min(m_subBlockSize, numSamples - offset);
+
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                SampleType *ring = m_buf + static_cast<size_t>(c) * m_len;
+
+                std::fill(fbSum, fbSum + len, SampleType(0));
+                std::fill(outSum, outSum + len, SampleType(0));
+
+                for (int i = 0; i < m_numTaps; i++)
+                {
+                    const int t = m_order[i];
+                    const TapState &tap = m_taps[t];
+
+                    FractionalReader<SampleType, 1, Mode> reader;
+                    reader.state.v = m_apState[t][c];
+                    reader.setDelay(tap.delayInSamples);
+                    readTap<Mode>(reader, ring, tapBuf, len);
+                    m_apState[t][c] = reader.state.v;
+
+                    const SampleType outGain = stereo ? tap.gain * tap.panGain[c] : tap.gain;
+                    switch (tap.filterStages)
+                    {
+                    case FilterStages::HighPass:
+                        accumulateTap<true, false>(t, c, tapBuf, fbSum, outSum, outGain, len);
+                        break;
+                    case FilterStages::LowPass:
+                        accumulateTap<false, true>(t, c, tapBuf, fbSum, outSum, outGain, len);
+                        break;
+                    case FilterStages::Both:
+                        accumulateTap<true, true>(t, c, tapBuf, fbSum, outSum, outGain, len);
+                        break;
+                    default:
+                        accumulateTap<false, false>(t, c, tapBuf, fbSum, outSum, outGain, len);
+                        break;
+                    }
+                }
+
+                m_wetLevels.add(outSum, len);
+
+                const SampleType *readPtr = readPtrs[c] + offset;
+                SampleType *writePtr = writePtrs[c] + offset;
+                for (size_t s = 0; s < len; s++)
+                {
+                    const SampleType in = readPtr[s];
+                    ring[(m_idx + s) & m_mask] = in + fb * fbSum[s];
+                    writePtr[s] = dry * in + wet * outSum[s];
+                }
+            }
+
+            m_idx = (m_idx + static_cast<unsigned>(len)) & m_mask;
+            offset += len;
+        }
+    }
+
+    template <typename SampleType>
+    template <bool HighPass, bool LowPass>
+    void MultiTapDelay<SampleType>::accumulateTap(int t, int c, const SampleType *tapBuf, SampleType *fbSum, SampleType *outSum, SampleType outGain, size_t numSamples)
+    {
+        const TapState &tap = m_taps[t];
+        const SampleType gain = tap.gain;
+
+        FilterChain<SampleType, 1, HighPass, LowPass> chain;
+        chain.load(tap.hpCoeffs, tap.lpCoeffs, &m_hpHistIn[t][c], &m_hpHistOut[t][c], &m_lpHistIn[t][c], &m_lpHistOut[t][c]);
+
+        for (size_t s = 0; s < numSamples; s++)
+        {
+            const SampleType y = chain.process({tapBuf[s]}).v;
+            fbSum[s] += gain * y;
+            outSum[s] += outGain * y;
+        }
+
+        chain.store(&m_hpHistIn[t][c], &m_hpHistOut[t][c], &m_lpHistIn[t][c], &m_lpHistOut[t][c]);
+    }
+
+    template <typename SampleType>
+    template <Interpolation Mode>
+    void MultiTapDelay<SampleType>::readTap(FractionalReader<SampleType, 1, Mode> &reader, const SampleType *ring, SampleType *dst, size_t numSamples)
+    {
+        if constexpr (Mode == Interpolation::None)
+        {
+            // Plain copy, split where the read head wraps
+            unsigned readIdx = (m_idx - reader.n) & m_mask;
+            while (numSamples > 0)
+            {
+                const size_t len = std::min<size_t>(numSamples, m_len - readIdx);
+                std::copy(ring + readIdx, ring + readIdx + len, dst);
+                readIdx = (readIdx + static_cast<unsigned>(len)) & m_mask;
+                dst += len;
+                numSamples -= len;
+            }
+        }
+        else
+        {
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                dst[s] = reader.read(ring, m_mask, m_idx + static_cast<unsigned>(s)).v;
+            }
+        }
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::setMaxDelayInMs(double maxDelayInMs)
+    {
+        m_requestedMaxDelayInMs.store(maxDelayInMs, std::memory_order_relaxed);
+
+        // The channel count is only known after prepareToPlay
+        if (m_numChannels > 0)
+        {
+            m_storage.request(bufferBytes(maxDelayInMs));
+        }
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::setNumTaps(int numTaps)
+    {
+        m_numTaps = std::max(1, std::min(maxTaps, numTaps));
+        updateOrder();
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::setTap(int index, const Tap &tap)
+    {
+        if (index < 0 || index >= maxTaps)
+        {
+            return;
+        }
+        m_settings[index] = tap;
+        updateTap(index);
+        updateOrder();
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::setInterpolation(Interpolation mode)
+    {
+        if (mode != m_interpolation)
+        {
+            std::fill(&m_apState[0][0], &m_apState[0][0] + maxTaps * maxChannels, SampleType(0));
+            m_interpolation = mode;
+            updateOrder();
+        }
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::setMix(double mix)
+    {
+        m_mix = static_cast<SampleType>(std::min(1.0, std::max(0.0, mix)));
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::setFeedback(double fb)
+    {
+        m_fb = static_cast<SampleType>(std::min(1.0, std::max(0.0, fb)));
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::getLevels(size_t numSamples, Levels &wet, Levels &feedback) const
+    {
+        LevelAccumulator fbAcc;
+        if (m_len > 0)
+        {
+            const unsigned start = m_idx - static_cast<unsigned>(numSamples);
+            for (int c = 0; c < m_numChannels; c++)
+            {
+                fbAcc.addRing(m_buf + static_cast<size_t>(c) * m_len, m_len, start, numSamples, 1, 0);
+            }
+        }
+        wet = m_wetLevels.get();
+        feedback = fbAcc.get();
+    }
+
+    template <typename SampleType>
+    size_t MultiTapDelay<SampleType>::bufferBytes(double maxDelayInMs) const
+    {
+        const size_t maxDly = static_cast<size_t>(std::ceil(maxDelayInMs / 1000.0 * m_sampleRate));
+        size_t len = 1;
+        while (len < maxDly + interpolationGuardFrames)
+        {
+            len <<= 1;
+        }
+        return len * static_cast<size_t>(m_numChannels) * sizeof(SampleType);
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::updateBuffer()
+    {
+        if (m_storage.update())
+        {
+            attachBuffer();
+        }
+        else if (m_requestedMaxDelayInMs.load(std::memory_order_relaxed) != m_maxDelayInMs)
+        {
+            updateMaxDelay();
+        }
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::attachBuffer()
+    {
+        // The arena may hand out more than asked for, every channel gets the largest power of two that fits
+        const size_t channelBytes = m_numChannels > 0 ? m_storage.size() / static_cast<size_t>(m_numChannels) : 0;
+        unsigned len = 0;
+        if (channelBytes >= sizeof(SampleType))
+        {
+            len = 1;
+            while (static_cast<size_t>(len) * 2 * sizeof(SampleType) <= channelBytes)
+            {
+                len <<= 1;
+            }
+        }
+
+        m_buf = static_cast<SampleType *>(m_storage.data());
+        m_len = len;
+        m_mask = m_len > 0 ? m_len - 1 : 0;
+        m_idx = 0;
+        updateMaxDelay();
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::updateMaxDelay()
+    {
+        m_maxDelayInMs = m_requestedMaxDelayInMs.load(std::memory_order_relaxed);
+
+        // Until a larger buffer arrives, the taps are limited to what the current one can hold
+        const unsigned maxDly = static_cast<unsigned>(std::ceil(m_maxDelayInMs / 1000.0 * m_sampleRate));
+        const unsigned maxFit = m_len > interpolationGuardFrames ? m_len - interpolationGuardFrames : 0;
+        m_maxDelayInSamples = std::min(maxDly, maxFit);
+
+        for (int t = 0; t < maxTaps; t++)
+        {
+            updateTap(t);
+        }
+        updateOrder();
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::updateTap(int index)
+    {
+        const Tap &tap = m_settings[index];
+        TapState &state = m_taps[index];
+
+        const double timeInMs = std::min(tap.timeInMs, m_maxDelayInMs);
+        state.delayInSamples = std::max(minInterpolatedDelay, std::min(timeInMs / 1000.0 * m_sampleRate, static_cast<double>(m_maxDelayInSamples)));
+        state.gain = static_cast<SampleType>(tap.gain);
+
+        // Balance law, the centre keeps both channels at unity
+        const double pan = std::min(1.0, std::max(-1.0, tap.pan));
+        state.panGain[0] = static_cast<SampleType>(std::min(1.0, 1.0 - pan));
+        state.panGain[1] = static_cast<SampleType>(std::min(1.0, 1.0 + pan));
+
+        // Bypassed filters are skipped entirely, so they start from silence when switched on again
+        const bool lpWasActive = (static_cast<int>(state.filterStages) & static_cast<int>(FilterStages::LowPass)) != 0;
+        const bool hpWasActive = (static_cast<int>(state.filterStages) & static_cast<int>(FilterStages::HighPass)) != 0;
+        if (tap.lpActive && lpWasActive == false)
+        {
+            std::fill(m_lpHistIn[index], m_lpHistIn[index] + maxChannels, SampleType(0));
+            std::fill(m_lpHistOut[index], m_lpHistOut[index] + maxChannels, SampleType(0));
+        }
+        if (tap.hpActive && hpWasActive == false)
+        {
+            std::fill(m_hpHistIn[index], m_hpHistIn[index] + maxChannels, SampleType(0));
+            std::fill(m_hpHistOut[index], m_hpHistOut[index] + maxChannels, SampleType(0));
+        }
+        state.lpCoeffs = OnePoleFilter<SampleType>::makeLPF(tap.lpFreq, m_sampleRate);
+        state.hpCoeffs = OnePoleFilter<SampleType>::makeHPF(tap.hpFreq, m_sampleRate);
+        state.filterStages = makeFilterStages(tap.hpActive, tap.lpActive);
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::updateOrder()
+    {
+        // Insertion sort, at most maxTaps entries and no allocation on the audio thread
+        for (int i = 0; i < m_numTaps; i++)
+        {
+            const int t = i;
+            int j = i;
+            while (j > 0 && m_taps[m_order[j - 1]].delayInSamples > m_taps[t].delayInSamples)
+            {
+                m_order[j] = m_order[j - 1];
+                j--;
+            }
+            m_order[j] = t;
+        }
+
+        // The nearest interpolation tap sits one sample after the integer delay
+        const double minDelay = m_taps[m_order[0]].delayInSamples;
+        const size_t ahead = static_cast<size_t>(minDelay) - (m_interpolation == Interpolation::None ? 0 : 1);
+        m_subBlockSize = std::max<size_t>(1, std::min(m_blockSize, ahead));
+    }
+
+    template <typename SampleType>
+    void MultiTapDelay<SampleType>::resetState()
+    {
+        std::fill(&m_lpHistIn[0][0], &m_lpHistIn[0][0] + maxTaps * maxChannels, SampleType(0));
+        std::fill(&m_lpHistOut[0][0], &m_lpHistOut[0][0] + maxTaps * maxChannels, SampleType(0));
+        std::fill(&m_hpHistIn[0][0], &m_hpHistIn[0][0] + maxTaps * maxChannels, SampleType(0));
+        std::fill(&m_hpHistOut[0][0], &m_hpHistOut[0][0] + maxTaps * maxChannels, SampleType(0));
+        std::fill(&m_apState[0][0], &m_apState[0][0] + maxTaps * maxChannels, SampleType(0));
+    }
+
+    template class MultiTapDelay<float>;
+    template class MultiTapDelay<double>;
+}
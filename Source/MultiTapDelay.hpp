@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include "AlignedBuffer.hpp"
+#include "DelayArena.hpp"
+#include "FilterChain.hpp"
+#include "Interpolation.hpp"
+#include "OnePoleFilter.hpp"
+#include "Telemetry.hpp"
+
+namespace MckDsp
+{
+    constexpr int maxDelayTaps = 16;
+
+    // Settings of one read head of a MultiTapDelay
+    struct DelayTap
+    {
+        double timeInMs{250.0};
+        double gain{1.0};
+        // -1 is left, 1 is right, only applies to stereo
+        double pan{0.0};
+        bool lpActive{false};
+        double lpFreq{20000.0};
+        bool hpActive{false};
+        double hpFreq{10.0};
+
+        bool operator!=(const DelayTap &other) const
+        {
+            return timeInMs != other.timeInMs || gain != other.gain || pan != other.pan ||
+                   lpActive != other.lpActive || lpFreq != other.lpFreq || hpActive != other.hpActive || hpFreq != other.hpFreq;
+        }
+    };
+
+    // Delay with one write head and up to maxTaps read heads per channel.
+    // All taps of a channel read from the same ring buffer. The sum of all taps is fed back
+    // into the line, so the tap gains should add up to at most one for decaying repeats.
+    template <typename SampleType>
+    class MultiTapDelay
+    {
+    public:
+        static constexpr int maxTaps = maxDelayTaps;
+        static constexpr int maxChannels = 8;
+
+        using Tap = DelayTap;
+
+        void prepareToPlay(double sampleRate, int samplesPerBlock, int numChannels);
+
+        // Hands the ring buffer back to the arena, only while audio is stopped
+        void releaseResources();
+
+        // Selects the arena the ring buffer is taken from, only while audio is stopped
+        void setArena(DelayArena &arena) { m_storage.setArena(arena); };
+
+        // Processes numSamples samples of every channel, readPtrs and writePtrs may alias
+        void processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples);
+
+        // Called from one thread other than the audio thread, usually the message thread. A larger buffer is
+        // reserved there, as that may allocate,
+        // and taken over by the audio thread at the start of the next block
+        void setMaxDelayInMs(double maxDelayInMs);
+        double getMaxDelayInMs() { return m_requestedMaxDelayInMs.load(std::memory_order_relaxed); };
+
+        // Only the first numTaps taps are read
+        void setNumTaps(int numTaps);
+        int getNumTaps() { return m_numTaps; };
+
+        void setTap(int index, const Tap &tap);
+        const Tap &getTap(int index) { return m_settings[index]; };
+
+        // Selects how fractional tap times are read from the ring buffer
+        void setInterpolation(Interpolation mode);
+        Interpolation getInterpolation() { return m_interpolation; };
+
+        void setMix(double mix);
+
+        void setFeedback(double fb);
+
+        int getNumChannels() { return m_numChannels; };
+
+        // Levels of the summed taps and of the signal written into the lines during the last
+        // processBlock() call, numSamples has to match the length of that call
+        void getLevels(size_t numSamples, Levels &wet, Levels &feedback) const;
+
+    private:
+        // Per tap values derived from the settings and the sample rate
+        struct TapState
+        {
+            double delayInSamples{minInterpolatedDelay};
+            SampleType gain{0};
+            SampleType panGain[2]{1, 1};
+            typename OnePoleFilter<SampleType>::Coefficients lpCoeffs{};
+            typename OnePoleFilter<SampleType>::Coefficients hpCoeffs{};
+            FilterStages filterStages{FilterStages::None};
+        };
+
+        template <Interpolation Mode>
+        void processBlock(const SampleType *const *readPtrs, SampleType *const *writePtrs, size_t numSamples);
+
+        // Adds the filtered tap t of channel c to the feedback and output sums
+        template <bool HighPass, bool LowPass>
+        void accumulateTap(int t, int c, const SampleType *tapBuf, SampleType *fbSum, SampleType *outSum, SampleType outGain, size_t numSamples);
+
+        template <Interpolation Mode>
+        void readTap(FractionalReader<SampleType, 1, Mode> &reader, const SampleType *ring, SampleType *dst, size_t numSamples);
+
+        size_t bufferBytes(double maxDelayInMs) const;
+
+        // Takes over a buffer or maximum delay time queued by setMaxDelayInMs()
+        void updateBuffer();
+
+        void attachBuffer();
+
+        void updateMaxDelay();
+
+        void updateTap(int index);
+
+        // Sorts the active taps by delay and derives the longest block that can be read ahead
+        void updateOrder();
+
+        void resetState();
+
+        int m_numChannels{0};
+        size_t m_blockSize{0};
+
+        double m_sampleRate{0};
+
+        SampleType m_mix{0};
+        SampleType m_fb{0};
+
+        std::atomic<double> m_requestedMaxDelayInMs{1000.0};
+        double m_maxDelayInMs{1000.0};
+        unsigned m_maxDelayInSamples{0};
+
+        Interpolation m_interpolation{Interpolation::None};
+
+        int m_numTaps{1};
+        Tap m_settings[maxTaps]{};
+        TapState m_taps[maxTaps]{};
+
+        // Active taps ordered by delay, so consecutive reads walk neighbouring memory
+        int m_order[maxTaps]{};
+
+        // Every tap reads behind the write head for this many samples
+        size_t m_subBlockSize{1};
+
+        SampleType m_lpHistIn[maxTaps][maxChannels]{};
+        SampleType m_lpHistOut[maxTaps][maxChannels]{};
+        SampleType m_hpHistIn[maxTaps][maxChannels]{};
+        SampleType m_hpHistOut[maxTaps][maxChannels]{};
+        SampleType m_apState[maxTaps][maxChannels]{};
+
+        // m_numChannels ring buffers of m_len samples each, stored one after the other
+        unsigned m_len{0};
+        unsigned m_mask{0};
+        unsigned m_idx{0};
+        SampleType *m_buf{nullptr};
+        DelayStorage m_storage{};
+
+        // Scratch for the current tap and the tap sums of one channel, m_blockSize samples each
+        AlignedBuffer<SampleType> m_tapBuf{};
+        AlignedBuffer<SampleType> m_fbSum{};
+        AlignedBuffer<SampleType> m_outSum{};
+
+        // The tap sums only exist per sub-block, so they are metered while processing
+        LevelAccumulator m_wetLevels{};
+    };
+
+    extern template class MultiTapDelay<float>;
+    extern template class MultiTapDelay<double>;
+}
@@ -7,45 +7,91 @@
 namespace MckDsp
 {
 
-    void OnePoleFilter::prepareToPlay(double sampleRate, int samplesPerBlock)
+    template <typename SampleType>
+    void OnePoleFilter<SampleType>::prepareToPlay(double sampleRate, int samplesPerBlock)
     {
+        (void)samplesPerBlock;
         m_sampleRate = sampleRate;
+        reset();
     }
 
-    double OnePoleFilter::processSample(double in)
+    template <typename SampleType>
+    SampleType OnePoleFilter<SampleType>::processSample(SampleType in)
     {
+        if (m_bypass)
+        {
+            return in;
+        }
         m_histOut = in * m_a0 + m_histIn * m_a1 + m_histOut * m_b1;
         m_histIn = in;
-        return m_bypass ? in : m_histOut;
+        return m_histOut;
     }
     
-    void OnePoleFilter::setLPF(double freq)
+    template <typename SampleType>
+    typename OnePoleFilter<SampleType>::Coefficients OnePoleFilter<SampleType>::makeLPF(double freq, double sampleRate)
     {
         freq = std::max(10.0, std::min(20000.0, freq));
         freq = freq * 2.0 * M_PI;
 
-        double w = 2.0 * m_sampleRate;
+        // Coefficients are always derived in double precision and then rounded once
+        Coefficients c;
+        double w = 2.0 * sampleRate;
         double n = 1.0 / (freq + w);
-        m_a0 = m_a1 = freq * n;
-        m_b1 = (w - freq) * n;
+        c.a0 = c.a1 = static_cast<SampleType>(freq * n);
+        c.b1 = static_cast<SampleType>((w - freq) * n);
+        return c;
     }
 
-    void OnePoleFilter::setHPF(double freq)
+    template <typename SampleType>
+    typename OnePoleFilter<SampleType>::Coefficients OnePoleFilter<SampleType>::makeHPF(double freq, double sampleRate)
     {
         freq = std::max(10.0, std::min(20000.0, freq));
         freq = freq * 2.0 * M_PI;
 
-        double w = 2.0 * m_sampleRate;
+        Coefficients c;
+        double w = 2.0 * sampleRate;
         double n = 1.0 / (freq + w);
-        m_a0 = w * n;
-        m_a1 = -m_a0;
-        m_b1 = (w - freq) * n;
+        c.a0 = static_cast<SampleType>(w * n);
+        c.a1 = -c.a0;
+        c.b1 = static_cast<SampleType>((w - freq) * n);
+        return c;
     }
 
-    void OnePoleFilter::setBypass(bool bypass)
+    template <typename SampleType>
+    void OnePoleFilter<SampleType>::setLPF(double freq)
     {
-        m_histIn = 0.0;
-        m_histOut = 0.0;
+        auto c = makeLPF(freq, m_sampleRate);
+        m_a0 = c.a0;
+        m_a1 = c.a1;
+        m_b1 = c.b1;
+    }
+
+    template <typename SampleType>
+    void OnePoleFilter<SampleType>::setHPF(double freq)
+    {
+        auto c = makeHPF(freq, m_sampleRate);
+        m_a0 = c.a0;
+        m_a1 = c.a1;
+        m_b1 = c.b1;
+    }
+
+    template <typename SampleType>
+    void OnePoleFilter<SampleType>::setBypass(bool bypass)
+    {
+        if (m_bypass && bypass == false)
+        {
+            reset();
+        }
         m_bypass = bypass;
     }
+
+    template <typename SampleType>
+    void OnePoleFilter<SampleType>::reset()
+    {
+        m_histIn = 0;
+        m_histOut = 0;
+    }
+
+    template class OnePoleFilter<float>;
+    template class OnePoleFilter<double>;
 }
\ No newline at end of file
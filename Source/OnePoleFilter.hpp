@@ -1,33 +1,48 @@
 #pragma once
 
 namespace MckDsp {
+    template <typename SampleType>
     class OnePoleFilter {
         public:
+            struct Coefficients {
+                SampleType a0 { 1 };
+                SampleType a1 { 0 };
+                SampleType b1 { 0 };
+            };
+
+            static Coefficients makeLPF(double freq, double sampleRate);
+
+            static Coefficients makeHPF(double freq, double sampleRate);
+
             void prepareToPlay(double sampleRate, int samplesPerBlock);
 
-            double processSample(double in);
+            SampleType processSample(SampleType in);
 
             void setLPF(double freq);
 
             void setHPF(double freq);
 
+            // A bypassed filter costs nothing and starts from silence when it is switched on again
             void setBypass(bool bypass);
 
+            void reset();
+
         private:
             double m_sampleRate { 0 };
 
-            double m_history { 0.0 };
-            
-            double m_histIn { 0.0 };
+            SampleType m_histIn { 0 };
 
-            double m_histOut { 0.0 };
+            SampleType m_histOut { 0 };
 
-            double m_a0 { 1.0 };
+            SampleType m_a0 { 1 };
 
-            double m_a1 { 0.0 };
+            SampleType m_a1 { 0 };
 
-            double m_b1 { 0.0 };
+            SampleType m_b1 { 0 };
 
             bool m_bypass { false };
     };
-}
\ No newline at end of file
+
+    extern template class OnePoleFilter<float>;
+    extern template class OnePoleFilter<double>;
+}
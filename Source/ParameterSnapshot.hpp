@@ -0,0 +1,149 @@
+#pragma once
+
+#include "CompactSamples.hpp"
+#include "Interpolation.hpp"
+#include "Lfo.hpp"
+#include "MultiTapDelay.hpp"
+
+namespace MckDsp
+{
+    // Plain copy of the user facing delay parameters
+    struct DelayParameters
+    {
+        double timeInMs{250.0};
+        double feedback{0.25};
+        double mix{0.5};
+        bool lpActive{false};
+        double lpFreq{1000.0};
+        bool hpActive{false};
+        double hpFreq{1000.0};
+        Interpolation interpolation{Interpolation::Linear};
+        bool multiTap{false};
+        int numTaps{4};
+        DelayTap taps[maxDelayTaps]{};
+        bool longDelay{false};
+        double longTimeInMs{4000.0};
+        SampleFormat longFormat{SampleFormat::Pcm24};
+        bool fdn{false};
+        int fdnLines{8};
+        LfoShape modShape{LfoShape::Sine};
+        double modRateInHz{0.5};
+        double modDepthInMs{0.0};
+        // Between adjacent channels, in cycles
+        double modPhase{0.25};
+        // Convolution of the feedback path with the loaded impulse response
+        bool convActive{false};
+    };
+
+    // Keeps the parameter set of the previous block and reports which values changed,
+    // so the audio thread only recomputes coefficients for parameters that moved.
+    class ParameterSnapshot
+    {
+    public:
+        enum Dirty : unsigned
+        {
+            Time = 1 << 0,
+            Feedback = 1 << 1,
+            Mix = 1 << 2,
+            LowPass = 1 << 3,
+            HighPass = 1 << 4,
+            // Set on the first update after invalidate(), everything has to be applied immediately
+            Reset = 1 << 5,
+            Interp = 1 << 6,
+            Mode = 1 << 7,
+            // Which taps changed is reported by getDirtyTaps()
+            Taps = 1 << 8,
+            // Time or storage format of the long delay
+            Long = 1 << 9,
+            // Shape, rate, depth or phase of the delay time modulation
+            Modulation = 1 << 10,
+            Convolution = 1 << 11,
+            All = Time | Feedback | Mix | LowPass | HighPass | Reset | Interp | Mode | Taps | Long | Modulation | Convolution
+        };
+
+        // Forces the next update() to report every parameter as dirty
+        void invalidate() { m_valid = false; }
+
+        // Stores the new parameter set and returns the Dirty flags of all values that changed
+        unsigned update(const DelayParameters &params)
+        {
+            unsigned dirty = 0;
+            m_dirtyTaps = 0;
+            if (m_valid == false)
+            {
+                dirty = All;
+                m_dirtyTaps = (1u << maxDelayTaps) - 1;
+                m_valid = true;
+            }
+            else
+            {
+                if (params.timeInMs != m_params.timeInMs)
+                {
+                    dirty |= Time;
+                }
+                if (params.feedback != m_params.feedback)
+                {
+                    dirty |= Feedback;
+                }
+                if (params.mix != m_params.mix)
+                {
+                    dirty |= Mix;
+                }
+                if (params.lpActive != m_params.lpActive || params.lpFreq != m_params.lpFreq)
+                {
+                    dirty |= LowPass;
+                }
+                if (params.hpActive != m_params.hpActive || params.hpFreq != m_params.hpFreq)
+                {
+                    dirty |= HighPass;
+                }
+                if (params.interpolation != m_params.interpolation)
+                {
+                    dirty |= Interp;
+                }
+                if (params.multiTap != m_params.multiTap || params.numTaps != m_params.numTaps ||
+                    params.longDelay != m_params.longDelay || params.fdn != m_params.fdn ||
+                    params.fdnLines != m_params.fdnLines)
+                {
+                    dirty |= Mode;
+                }
+                if (params.longTimeInMs != m_params.longTimeInMs || params.longFormat != m_params.longFormat)
+                {
+                    dirty |= Long;
+                }
+                if (params.modShape != m_params.modShape || params.modRateInHz != m_params.modRateInHz ||
+                    params.modDepthInMs != m_params.modDepthInMs || params.modPhase != m_params.modPhase)
+                {
+                    dirty |= Modulation;
+                }
+                if (params.convActive != m_params.convActive)
+                {
+                    dirty |= Convolution;
+                }
+                for (int t = 0; t < maxDelayTaps; t++)
+                {
+                    if (params.taps[t] != m_params.taps[t])
+                    {
+                        m_dirtyTaps |= 1u << t;
+                    }
+                }
+                if (m_dirtyTaps != 0)
+                {
+                    dirty |= Taps;
+                }
+            }
+            m_params = params;
+            return dirty;
+        }
+
+        const DelayParameters &get() const { return m_params; }
+
+        // Bit t is set if tap t changed in the last update()
+        unsigned getDirtyTaps() const { return m_dirtyTaps; }
+
+    private:
+        DelayParameters m_params{};
+        unsigned m_dirtyTaps{0};
+        bool m_valid{false};
+    };
+}
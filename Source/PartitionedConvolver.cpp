@@ -0,0 +1,119 @@
+#include "PartitionedConvolver.hpp"
+
+#include <algorithm>
+
+namespace MckDsp
+{
+    template <typename SampleType>
+    void PartitionedConvolver<SampleType>::prepare(const float *ir, size_t length, int numLanes)
+    {
+        m_ir.assign(ir, ir + std::min(length, maxLength));
+
+        const size_t fftSize = 2 * partitionSize;
+        m_fft.prepare(fftSize);
+        m_numBins = m_fft.getNumBins();
+        const size_t lineLength = AlignedBuffer<SampleType>::alignment / sizeof(SampleType);
+        m_stride = (m_numBins + lineLength - 1) / lineLength * lineLength;
+        m_numPartitions = std::max<size_t>(1, (m_ir.size() + partitionSize - 1) / partitionSize);
+
+        // Each partition sits in the first half of an otherwise silent window, so the last
+        // partitionSize samples of the circular convolution are the linear one
+        m_irRe.allocate(m_numPartitions * m_stride);
+        m_irIm.allocate(m_numPartitions * m_stride);
+        m_time.allocate(fftSize);
+        const SampleType scale = SampleType(1) / static_cast<SampleType>(fftSize);
+        for (size_t p = 0; p < m_numPartitions; p++)
+        {
+            m_time.clear();
+            const size_t start = p * partitionSize;
+            const size_t end = std::min(start + partitionSize, m_ir.size());
+            for (size_t i = start; i < end; i++)
+            {
+                m_time[i - start] = static_cast<SampleType>(m_ir[i]) * scale;
+            }
+            m_fft.forward(m_time.data(), m_irRe.data() + p * m_stride, m_irIm.data() + p * m_stride);
+        }
+
+        m_accRe.allocate(m_stride);
+        m_accIm.allocate(m_stride);
+        setNumLanes(numLanes);
+    }
+
+    template <typename SampleType>
+    void PartitionedConvolver<SampleType>::setNumLanes(int numLanes)
+    {
+        m_lanes = std::max(1, std::min(maxChannels, numLanes));
+        const size_t lanes = static_cast<size_t>(m_lanes);
+        m_fdlRe.allocate(lanes * m_numPartitions * m_stride);
+        m_fdlIm.allocate(lanes * m_numPartitions * m_stride);
+        m_window.allocate(lanes * 2 * partitionSize);
+        m_head = 0;
+        m_filled = 0;
+    }
+
+    template <typename SampleType>
+    void PartitionedConvolver<SampleType>::reset()
+    {
+        // Spectra older than m_filled partitions are skipped, so only the windows need clearing
+        m_window.clear();
+        m_filled = 0;
+    }
+
+    template <typename SampleType>
+    void PartitionedConvolver<SampleType>::process(const SampleType *in, SampleType *out)
+    {
+        const size_t lanes = static_cast<size_t>(m_lanes);
+        const size_t numPartitions = m_numPartitions;
+        const size_t stride = m_stride;
+        m_filled = std::min(m_filled + 1, numPartitions);
+
+        SampleType *accRe = m_accRe.data();
+        SampleType *accIm = m_accIm.data();
+
+        for (size_t l = 0; l < lanes; l++)
+        {
+            // Slides the window by one partition and appends the new input of this lane
+            SampleType *window = m_window.data() + l * 2 * partitionSize;
+            std::copy(window + partitionSize, window + 2 * partitionSize, window);
+            for (size_t s = 0; s < partitionSize; s++)
+            {
+                window[partitionSize + s] = in[s * lanes + l];
+            }
+
+            SampleType *fdlRe = m_fdlRe.data() + l * numPartitions * stride;
+            SampleType *fdlIm = m_fdlIm.data() + l * numPartitions * stride;
+            m_fft.forward(window, fdlRe + m_head * stride, fdlIm + m_head * stride);
+
+            // Partition p of the response meets the input spectrum from p partitions ago
+            std::fill(accRe, accRe + stride, SampleType(0));
+            std::fill(accIm, accIm + stride, SampleType(0));
+            size_t slot = m_head;
+            for (size_t p = 0; p < m_filled; p++)
+            {
+                const SampleType *hr = m_irRe.data() + p * stride;
+                const SampleType *hi = m_irIm.data() + p * stride;
+                const SampleType *xr = fdlRe + slot * stride;
+                const SampleType *xi = fdlIm + slot * stride;
+                // The padding bins are zero, running over them keeps the loop free of a remainder
+                for (size_t k = 0; k < stride; k++)
+                {
+                    accRe[k] += hr[k] * xr[k] - hi[k] * xi[k];
+                    accIm[k] += hr[k] * xi[k] + hi[k] * xr[k];
+                }
+                slot = slot > 0 ? slot - 1 : numPartitions - 1;
+            }
+
+            SampleType *time = m_time.data();
+            m_fft.inverse(accRe, accIm, time);
+            for (size_t s = 0; s < partitionSize; s++)
+            {
+                out[s * lanes + l] = time[partitionSize + s];
+            }
+        }
+
+        m_head = m_head + 1 < numPartitions ? m_head + 1 : 0;
+    }
+
+    template class PartitionedConvolver<float>;
+    template class PartitionedConvolver<double>;
+}
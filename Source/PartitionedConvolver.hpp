@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "AlignedBuffer.hpp"
+#include "Fft.hpp"
+
+namespace MckDsp
+{
+    // Uniformly partitioned overlap-save convolution of up to maxChannels interleaved lanes with
+    // one impulse response. The response is cut into partitions of partitionSize samples whose
+    // spectra are computed once. Every partition of input then costs one forward and one inverse
+    // FFT per lane plus a multiply-add over the stored input spectra, the frequency domain delay
+    // line, so every partition takes the same time. The output lags the input by partitionSize samples.
+    template <typename SampleType>
+    class PartitionedConvolver
+    {
+    public:
+        static constexpr int maxChannels = 8;
+        static constexpr size_t partitionSize = 64;
+        // Longer responses are cut, about 1.4 s at 48 kHz
+        static constexpr size_t maxLength = 1 << 16;
+
+        // Builds the partition spectra of length samples of ir for numLanes lanes, not real-time safe
+        void prepare(const float *ir, size_t length, int numLanes);
+
+        // Rebuilds the state for another lane count with the current response, not real-time safe
+        void setNumLanes(int numLanes);
+
+        int getNumLanes() const { return m_lanes; };
+        size_t getLength() const { return m_ir.size(); };
+        size_t getNumPartitions() const { return m_numPartitions; };
+
+        // Forgets all input so far, real-time safe
+        void reset();
+
+        // Convolves partitionSize interleaved frames of in. out receives the convolution up to the
+        // last frame of in, it belongs partitionSize frames later. in and out must not alias.
+        void process(const SampleType *in, SampleType *out);
+
+    private:
+        int m_lanes{0};
+        std::vector<float> m_ir{};
+
+        RealFft<SampleType> m_fft{};
+        size_t m_numBins{0};
+        // Bins of one spectrum, padded to whole cache lines
+        size_t m_stride{0};
+        size_t m_numPartitions{0};
+
+        // Partition spectra of the response, already scaled for the unnormalized inverse FFT
+        AlignedBuffer<SampleType> m_irRe{};
+        AlignedBuffer<SampleType> m_irIm{};
+
+        // Input spectra of the last m_numPartitions partitions of every lane, m_head is the newest.
+        // Only the m_filled newest ones hold input since the last reset()
+        AlignedBuffer<SampleType> m_fdlRe{};
+        AlignedBuffer<SampleType> m_fdlIm{};
+        size_t m_head{0};
+        size_t m_filled{0};
+
+        // Previous and current partition of every lane, transformed together
+        AlignedBuffer<SampleType> m_window{};
+
+        AlignedBuffer<SampleType> m_accRe{};
+        AlignedBuffer<SampleType> m_accIm{};
+        AlignedBuffer<SampleType> m_time{};
+    };
+
+    extern template class PartitionedConvolver<float>;
+    extern template class PartitionedConvolver<double>;
+}
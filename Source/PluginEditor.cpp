@@ -11,16 +11,32 @@
 
 #include <cstdio>
 
+//==============================================================================
+MckDelayAudioProcessorEditor::Logo::Logo()
+{
+    if (auto svgXml = juce::XmlDocument::parse(BinaryData::mckaudio_logo_svg))
+    {
+        drawable = juce::Drawable::createFromSVG(*svgXml);
+    }
+}
+
 //==============================================================================
 MckDelayAudioProcessorEditor::MckDelayAudioProcessorEditor(MckDelayAudioProcessor &p)
     : AudioProcessorEditor(&p), audioProcessor(p)
 {
     p.setEditor(this);
 
+    // Everything is painted, so the host never has to paint behind the editor
+    setOpaque(true);
+
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
     int w = 3 * dialSize + 4 * colGap;
-    int h = headerHeight + dialSize + labelHeight + 2 * rowGap;
+    int h = headerHeight + dialSize + labelHeight + 2 * rowGap + 4 * (meterHeight + rowGap) + buttonHeight + 2 * rowGap;
+    if (p.wrapperType == juce::AudioProcessor::wrapperType_Standalone)
+    {
+        h += buttonHeight + rowGap;
+    }
     setSize(w, h);
     // setResizeLimits(200, 100, 1200, 900);
     //setResizable(true, true);
@@ -32,7 +48,7 @@ MckDelayAudioProcessorEditor::MckDelayAudioProcessorEditor(MckDelayAudioProcesso
     controls.resize(3);
     controls[0].name = "Time";
     controls[0].value = 300.0;
-    controls[0].minVal = 100.0;
+    controls[0].minVal = 1.0;
     controls[0].maxVal = 1000.0;
     controls[0].stepVal = 1.0;
     controls[0].unit = " ms";
@@ -89,11 +105,50 @@ MckDelayAudioProcessorEditor::MckDelayAudioProcessorEditor(MckDelayAudioProcesso
     fbSlider.setValue(static_cast<double>(audioProcessor.getFeedback()));
     mixSlider.setValue(static_cast<double>(audioProcessor.getMix()));
 
+    meters = {&inputMeter, &wetMeter, &fbMeter};
+    for (auto &meter : meters)
+    {
+        addAndMakeVisible(*meter);
+    }
+
+    loadLabel.setFont(juce::Font(meterHeight, juce::Font::plain));
+    loadLabel.setColour(juce::Label::textColourId, juce::Colour::fromRGB(230, 230, 230));
+    loadLabel.setJustificationType(juce::Justification::centredLeft);
+    loadLabel.setColour(juce::Label::backgroundColourId, getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
+    loadLabel.setOpaque(true);
+    addAndMakeVisible(loadLabel);
+
+    const auto irFile = audioProcessor.getImpulseResponseFile();
+    if (irFile != juce::File{})
+    {
+        irButton.setButtonText("IR: " + irFile.getFileNameWithoutExtension());
+    }
+    irButton.onClick = [this] { chooseImpulseResponse(); };
+    addAndMakeVisible(irButton);
+
+    if (audioProcessor.wrapperType == juce::AudioProcessor::wrapperType_Standalone)
+    {
+        profileButton.onClick = [this] { saveLoadProfile(); };
+        addAndMakeVisible(profileButton);
+        if (MckDsp::Trace::enabled)
+        {
+            traceButton.onClick = [this] { saveTrace(); };
+            addAndMakeVisible(traceButton);
+        }
+    }
+
+    // The audio thread only measures while an editor is listening
+    audioProcessor.setTelemetryEnabled(true);
+    startTimerHz(meterRate);
+
     resized();
 }
 
 MckDelayAudioProcessorEditor::~MckDelayAudioProcessorEditor()
 {
+    stopTimer();
+    audioProcessor.setTelemetryEnabled(false);
+
     setLookAndFeel(nullptr);
 
     for (auto &slider : sliders)
@@ -107,11 +162,39 @@ MckDelayAudioProcessorEditor::~MckDelayAudioProcessorEditor()
 //==============================================================================
 void MckDelayAudioProcessorEditor::paint(juce::Graphics &g)
 {
+    MCK_TRACE_ZONE("Editor::paint");
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
 
-    auto bounds = getLocalBounds();
-    auto w = bounds.getWidth();
+    // Slider and meter repaints only clip a small region, which mostly misses the header
+    auto header = getLocalBounds().withHeight(headerHeight);
+    if (g.clipRegionIntersects(header))
+    {
+        auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+        if (headerImage.isNull() || scale != headerScale)
+        {
+            renderHeader(scale);
+        }
+        g.drawImage(headerImage, header.toFloat());
+    }
+
+    // g.setColour (juce::Colours::white);
+    // g.setFont (15.0f);
+    // g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
+}
+
+void MckDelayAudioProcessorEditor::renderHeader(float scale)
+{
+    auto w = getWidth();
+    headerScale = scale;
+    headerImage = juce::Image(juce::Image::ARGB,
+                              std::max(1, juce::roundToInt(w * scale)),
+                              std::max(1, juce::roundToInt(headerHeight * scale)), true);
+
+    juce::Graphics g(headerImage);
+    g.addTransform(juce::AffineTransform::scale(scale));
+
+    auto bounds = juce::Rectangle<int>(0, 0, w, headerHeight);
     bounds.setHeight(headerHeight - 2 * headerGap);
     g.setColour(juce::Colour::fromRGB(0, 155, 179));
     g.fillRect(bounds);
@@ -119,26 +202,22 @@ void MckDelayAudioProcessorEditor::paint(juce::Graphics &g)
     bounds.setHeight(headerGap);
     g.fillRect(bounds);
 
-    // XML Stuff
-    auto svgBounds = getLocalBounds().toFloat();
-    svgBounds.setTop(2.0f * headerGap);
-    svgBounds.setHeight(headerHeight - (2.0f + 4.0f) * headerGap);
-    svgBounds.setLeft(8.0f);
-    svgBounds.setWidth(w - 16.0f);
-    //svgBounds.setWidth(svgBounds.getHeight() * 4.0f);
-    auto svgXml = XmlDocument::parse(BinaryData::mckaudio_logo_svg);
-    auto svgDrawable = Drawable::createFromSVG(*svgXml);
-    svgDrawable->setTransformToFit(svgBounds, RectanglePlacement::xLeft || RectanglePlacement::yTop);
-    svgDrawable->draw(g, 1.0f);
-    
-
-    // g.setColour (juce::Colours::white);
-    // g.setFont (15.0f);
-    // g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
+    if (logo->drawable != nullptr)
+    {
+        auto svgBounds = juce::Rectangle<float>(0.0f, 0.0f, static_cast<float>(w), static_cast<float>(headerHeight));
+        svgBounds.setTop(2.0f * headerGap);
+        svgBounds.setHeight(headerHeight - (2.0f + 4.0f) * headerGap);
+        svgBounds.setLeft(8.0f);
+        svgBounds.setWidth(w - 16.0f);
+        logo->drawable->setTransformToFit(svgBounds, RectanglePlacement::xLeft || RectanglePlacement::yTop);
+        logo->drawable->draw(g, 1.0f);
+    }
 }
 
 void MckDelayAudioProcessorEditor::resized()
 {
+    headerImage = {};
+
     // This is generally where you'll want to lay out the positions of any
     // subcomponents in your editor..
 
@@ -166,6 +245,28 @@ void MckDelayAudioProcessorEditor::resized()
     }
     labelBox.performLayout(bounds.toFloat());
 
+    bounds = getLocalBounds().reduced(colGap, 0);
+    bounds.setTop(headerHeight + dialSize + labelHeight + 3 * rowGap);
+    for (auto &meter : meters)
+    {
+        meter->setBounds(bounds.removeFromTop(meterHeight));
+        bounds.removeFromTop(rowGap);
+    }
+    loadLabel.setBounds(bounds.removeFromTop(meterHeight));
+    bounds.removeFromTop(rowGap);
+    irButton.setBounds(bounds.removeFromTop(buttonHeight).removeFromLeft(2 * dialSize));
+    bounds.removeFromTop(rowGap);
+    if (profileButton.isVisible())
+    {
+        auto row = bounds.removeFromTop(buttonHeight);
+        profileButton.setBounds(row.removeFromRight(2 * dialSize));
+        if (traceButton.isVisible())
+        {
+            row.removeFromRight(colGap);
+            traceButton.setBounds(row.removeFromRight(2 * dialSize));
+        }
+    }
+
     /*
         juce::Grid grid;
         using Track = juce::Grid::TrackInfo;
@@ -183,6 +284,98 @@ void MckDelayAudioProcessorEditor::resized()
         grid.performLayout(bounds);*/
 }
 
+void MckDelayAudioProcessorEditor::timerCallback()
+{
+    MCK_TRACE_THREAD("Message");
+    MCK_TRACE_ZONE("Editor::timerCallback");
+    // Several blocks arrive per timer tick, show the loudest of them
+    MckDsp::TelemetryFrame frame;
+    MckDsp::Levels input, wet, fb;
+    float load = 0.0f;
+    int numFrames = 0;
+    while (audioProcessor.popTelemetry(frame))
+    {
+        input.peak = std::max(input.peak, frame.input.peak);
+        input.rms = std::max(input.rms, frame.input.rms);
+        wet.peak = std::max(wet.peak, frame.wet.peak);
+        wet.rms = std::max(wet.rms, frame.wet.rms);
+        fb.peak = std::max(fb.peak, frame.feedback.peak);
+        fb.rms = std::max(fb.rms, frame.feedback.rms);
+        load = std::max(load, frame.blockLoad);
+        numFrames++;
+    }
+
+    inputMeter.setLevels(input);
+    wetMeter.setLevels(wet);
+    fbMeter.setLevels(fb);
+
+    if (numFrames > 0)
+    {
+        auto stats = audioProcessor.getLoadProfiler().getStats();
+        loadLabel.setText("CPU " + juce::String(100.0f * load, 1) + "%"
+                          + " p50 " + juce::String(100.0 * stats.p50, 1) + "%"
+                          + " p99 " + juce::String(100.0 * stats.p99, 1) + "%"
+                          + " max " + juce::String(100.0 * stats.max, 1) + "%"
+                          + " over " + juce::String(static_cast<juce::int64>(stats.numOverruns)),
+                          juce::NotificationType::dontSendNotification);
+    }
+}
+
+void MckDelayAudioProcessorEditor::chooseImpulseResponse()
+{
+    irChooser = std::make_unique<juce::FileChooser>(
+        "Load impulse response",
+        audioProcessor.getImpulseResponseFile().getParentDirectory(),
+        "*.wav;*.aif;*.aiff;*.flac");
+    irChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                           [this](const juce::FileChooser &chooser)
+                           {
+                               auto file = chooser.getResult();
+                               if (file != juce::File{} && audioProcessor.loadImpulseResponse(file))
+                               {
+                                   irButton.setButtonText("IR: " + file.getFileNameWithoutExtension());
+                               }
+                           });
+}
+
+void MckDelayAudioProcessorEditor::saveLoadProfile()
+{
+    auto json = audioProcessor.getLoadProfileJson();
+    profileChooser = std::make_unique<juce::FileChooser>(
+        "Save load profile",
+        juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("MckDelayLoad.json"),
+        "*.json");
+    profileChooser->launchAsync(juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles |
+                                    juce::FileBrowserComponent::warnAboutOverwriting,
+                                [json](const juce::FileChooser &chooser)
+                                {
+                                    auto file = chooser.getResult();
+                                    if (file != juce::File{})
+                                    {
+                                        file.replaceWithText(json);
+                                    }
+                                });
+}
+
+void MckDelayAudioProcessorEditor::saveTrace()
+{
+    auto json = MckDsp::Trace::toChromeJson();
+    traceChooser = std::make_unique<juce::FileChooser>(
+        "Save trace",
+        juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("MckDelayTrace.json"),
+        "*.json");
+    traceChooser->launchAsync(juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles |
+                                  juce::FileBrowserComponent::warnAboutOverwriting,
+                              [json](const juce::FileChooser &chooser)
+                              {
+                                  auto file = chooser.getResult();
+                                  if (file != juce::File{})
+                                  {
+                                      file.replaceWithText(json);
+                                  }
+                              });
+}
+
 void MckDelayAudioProcessorEditor::sliderValueChanged(juce::Slider *slider)
 {
     if (slider == &timeSlider)
@@ -12,6 +12,7 @@
 
 #include "PluginProcessor.hpp"
 #include "Control.hpp"
+#include "LevelMeter.hpp"
 #include "BwLookAndFeel.hpp"
 #include "MckLookAndFeel.hpp"
 
@@ -23,7 +24,8 @@
 /**
  */
 class MckDelayAudioProcessorEditor : public juce::AudioProcessorEditor,
-                                     public juce::Slider::Listener
+                                     public juce::Slider::Listener,
+                                     private juce::Timer
 {
 public:
   MckDelayAudioProcessorEditor(MckDelayAudioProcessor &);
@@ -49,6 +51,24 @@ public:
 private:
   void sliderValueChanged(juce::Slider *slider) override;
 
+  // Drains the telemetry queue of the processor and updates the meters
+  void timerCallback() override;
+
+  // Rasterizes the header with the logo for the given display scale
+  void renderHeader(float scale);
+
+  // The logo is parsed once and shared by all editors of the process
+  struct Logo
+  {
+    Logo();
+    std::unique_ptr<juce::Drawable> drawable;
+  };
+  juce::SharedResourcePointer<Logo> logo;
+
+  // Rebuilt on resize or when the editor moves to a display with another scale
+  juce::Image headerImage;
+  float headerScale{0.0f};
+
   // This reference is provided as a quick way for your editor to
   // access the processor object that created it.
   MckDelayAudioProcessor &audioProcessor;
@@ -68,6 +88,28 @@ private:
   std::vector<juce::Slider *> sliders;
   std::vector<juce::Label *> labels;
 
+  LevelMeter inputMeter{"IN"};
+  LevelMeter wetMeter{"WET"};
+  LevelMeter fbMeter{"FB"};
+  juce::Label loadLabel;
+
+  // Picks the impulse response of the convolution in the feedback path, shows the name of the loaded one
+  juce::TextButton irButton{"Load IR"};
+  std::unique_ptr<juce::FileChooser> irChooser;
+  void chooseImpulseResponse();
+
+  // Writes the load profile of the processor to a JSON file, only shown in the Standalone build
+  juce::TextButton profileButton{"Save Profile"};
+  std::unique_ptr<juce::FileChooser> profileChooser;
+  void saveLoadProfile();
+
+  // Writes the recorded trace zones as Chrome trace JSON, only shown in a Standalone build with MCK_DELAY_TRACE
+  juce::TextButton traceButton{"Save Trace"};
+  std::unique_ptr<juce::FileChooser> traceChooser;
+  void saveTrace();
+
+  std::vector<LevelMeter *> meters;
+
   const int headerHeight = 40;
   const int headerGap = 2;
   const int dialSize = 80;
@@ -76,6 +118,9 @@ private:
   const int fontSize = 20;
   const int rowGap = 4;
   const int colGap = 8;
+  const int meterHeight = 12;
+  const int meterRate = 30;
+  const int buttonHeight = 20;
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MckDelayAudioProcessorEditor)
 };
@@ -22,6 +22,20 @@ MckDelayAudioProcessor::MckDelayAudioProcessor()
       )
 #endif
 {
+#if !MCK_DELAY_SHARED_ARENA
+    for (int g = 0; g < maxGroups; g++)
+    {
+        m_float[g].delay.setArena(m_arena);
+        m_float[g].multiTap.setArena(m_arena);
+        m_float[g].longDelay.setArena(m_arena);
+        m_float[g].fdn.setArena(m_arena);
+        m_double[g].delay.setArena(m_arena);
+        m_double[g].multiTap.setArena(m_arena);
+        m_double[g].longDelay.setArena(m_arena);
+        m_double[g].fdn.setArena(m_arena);
+    }
+#endif
+
     juce::AudioParameterFloatAttributes freqAttr;
     freqAttr.withLabel("Hz");
     juce::NormalisableRange<float> freqRange(20.0f, 20000.0f, 0.1f, 0.5f);
@@ -34,6 +48,46 @@ MckDelayAudioProcessor::MckDelayAudioProcessor()
     addParameter(lpFreq = new juce::AudioParameterFloat("lpfreq", "Low Pass Frequency", freqRange, 1000, freqAttr));
     addParameter(hpActive = new juce::AudioParameterBool("hpactive", "High Pass Active", false));
     addParameter(hpFreq = new juce::AudioParameterFloat("hpfreq", "High Pass Frequency", freqRange, 1000, freqAttr));
+    addParameter(interp = new juce::AudioParameterChoice("interp", "Interpolation", juce::StringArray{"Off", "Linear", "Lagrange", "Hermite", "Allpass"}, 1));
+    addParameter(mode = new juce::AudioParameterChoice("mode", "Mode", juce::StringArray{"Single", "Multi-Tap", "Long", "FDN"}, 0));
+    addParameter(numTaps = new juce::AudioParameterInt("taps", "Taps", 1, MckDsp::maxDelayTaps, 4));
+    addParameter(longTime = new juce::AudioParameterInt("longtime", "Long Time", getMinTime(), static_cast<int>(MckDsp::LongDelay<float>::maxDelayLimitInMs), 4000, juce::AudioParameterIntAttributes().withLabel("ms")));
+    addParameter(longFormat = new juce::AudioParameterChoice("longformat", "Long Format", juce::StringArray{"Float 32", "PCM 24", "PCM 16"}, 1));
+    addParameter(fdnLines = new juce::AudioParameterChoice("fdnlines", "FDN Lines", juce::StringArray{"4", "8", "16"}, 1));
+
+    // Delay time modulation of the single line, off at zero depth
+    juce::NormalisableRange<float> rateRange(0.05f, static_cast<float>(MckDsp::Lfo<float>::maxRateInHz), 0.01f);
+    rateRange.setSkewForCentre(1.0f);
+    addParameter(modShape = new juce::AudioParameterChoice("modshape", "Mod Shape", juce::StringArray{"Sine", "Triangle", "Random"}, 0));
+    addParameter(modRate = new juce::AudioParameterFloat("modrate", "Mod Rate", rateRange, 0.5f, juce::AudioParameterFloatAttributes().withLabel("Hz")));
+    addParameter(modDepth = new juce::AudioParameterFloat("moddepth", "Mod Depth", juce::NormalisableRange<float>(0.0f, 10.0f, 0.01f), 0.0f, juce::AudioParameterFloatAttributes().withLabel("ms")));
+    addParameter(modPhase = new juce::AudioParameterInt("modphase", "Mod Phase", 0, 180, 90, juce::AudioParameterIntAttributes().withLabel("deg")));
+    // Convolution of the single line's feedback path with the loaded impulse response
+    addParameter(convActive = new juce::AudioParameterBool("convactive", "Convolution", false));
+    addParameter(automation = new juce::AudioParameterChoice("automation", "Automation", juce::StringArray{"Block", "Sample"}, 0));
+
+    // Effect and general purpose controllers
+    m_controllers[12] = time;
+    m_controllers[13] = feedback;
+    m_controllers[14] = mix;
+    m_controllers[15] = lpFreq;
+    m_controllers[16] = hpFreq;
+    m_controllers[17] = longTime;
+
+    // Taps default to an even pattern whose levels add up to one
+    for (int t = 0; t < MckDsp::maxDelayTaps; t++)
+    {
+        juce::String id = "tap" + juce::String(t + 1);
+        juce::String name = "Tap " + juce::String(t + 1) + " ";
+        int defaultTime = std::min(getMaxTime(), 125 * (t + 1));
+        addParameter(taps[t].time = new juce::AudioParameterInt(id + "time", name + "Time", 1, getMaxTime(), defaultTime, juce::AudioParameterIntAttributes().withLabel("ms")));
+        addParameter(taps[t].level = new juce::AudioParameterInt(id + "level", name + "Level", 0, 100, 25, juce::AudioParameterIntAttributes().withLabel("%")));
+        addParameter(taps[t].pan = new juce::AudioParameterInt(id + "pan", name + "Pan", -100, 100, 0));
+        addParameter(taps[t].lpActive = new juce::AudioParameterBool(id + "lpactive", name + "Low Pass Active", false));
+        addParameter(taps[t].lpFreq = new juce::AudioParameterFloat(id + "lpfreq", name + "Low Pass Frequency", freqRange, 1000, freqAttr));
+        addParameter(taps[t].hpActive = new juce::AudioParameterBool(id + "hpactive", name + "High Pass Active", false));
+        addParameter(taps[t].hpFreq = new juce::AudioParameterFloat(id + "hpfreq", name + "High Pass Frequency", freqRange, 1000, freqAttr));
+    }
     
     /*
     juce::AudioParameterFloatAttributes freqAttr;
@@ -50,10 +104,26 @@ MckDelayAudioProcessor::MckDelayAudioProcessor()
     juce::NormalisableRange<float> freqRange(20.0, 20000.0, [](float rangeStart, float rangeEnd, float valueToRemap) -> float { return 20.0f * std::pow(10.0f, 3.0f * valueToRemap); }, [](float rangeStart, float rangeEnd, float valueToRemap) -> float { return std::log10(valueToRemap/20.0f) / 3.0f; });
     */
 
+    // The binary state lists the parameters in this order, keyed by the hashes of their IDs
+    for (auto *param : getParameters())
+    {
+        if (auto *ranged = dynamic_cast<juce::RangedAudioParameter *>(param))
+        {
+            m_stateLookup.emplace_back(MckDsp::stateId(ranged->getParameterID().toStdString()), static_cast<int>(m_stateParams.size()));
+            m_stateIds.push_back(m_stateLookup.back().first);
+            m_stateParams.push_back(ranged);
+        }
+    }
+    std::sort(m_stateLookup.begin(), m_stateLookup.end());
+    jassert(std::adjacent_find(m_stateLookup.begin(), m_stateLookup.end(), [](const auto &a, const auto &b)
+                               { return a.first == b.first; }) == m_stateLookup.end());
+
+    loadUserBank();
 }
 
 MckDelayAudioProcessor::~MckDelayAudioProcessor()
 {
+    cancelPendingUpdate();
 }
 
 //==============================================================================
@@ -91,31 +161,114 @@ bool MckDelayAudioProcessor::isMidiEffect() const
 
 double MckDelayAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // The filters only take energy out of the loop, so they are left out of the estimate
+    const double fb = static_cast<double>(*feedback) / 100.0;
+    double tailInMs = 0.0;
+    switch (mode->getIndex())
+    {
+    case 0:
+        // The modulation stretches the line by up to its depth, the convolution smears every repeat by its length
+        tailInMs = MckDsp::tailLengthInMs(static_cast<double>(*time) + static_cast<double>(*modDepth) +
+                                              (*convActive ? m_irLengthInMs.load(std::memory_order_relaxed) : 0.0),
+                                          fb);
+        break;
+    case 1:
+    {
+        // Every tap feeds back, a repeat takes at most as long as the longest tap
+        double maxTimeInMs = 0.0;
+        double gain = 0.0;
+        for (int t = 0; t < *numTaps; t++)
+        {
+            maxTimeInMs = std::max(maxTimeInMs, static_cast<double>(*taps[t].time));
+            gain += static_cast<double>(*taps[t].level) / 100.0;
+        }
+        tailInMs = MckDsp::tailLengthInMs(maxTimeInMs, fb * gain);
+        break;
+    }
+    case 2:
+        tailInMs = MckDsp::tailLengthInMs(static_cast<double>(*longTime), fb);
+        break;
+    default:
+        // The FDN lines lose the feedback gain per length of the longest line
+        tailInMs = MckDsp::tailLengthInMs(static_cast<double>(*time), fb);
+        break;
+    }
+    return tailInMs / 1000.0;
 }
 
 int MckDelayAudioProcessor::getNumPrograms()
 {
-    return 1; // NB: some hosts don't cope very well if you tell them there are 0 programs,
-              // so this should be at least 1, even if you're not really implementing programs.
+    // The factory bank always holds at least the initial preset
+    return static_cast<int>(getFactoryBank().getNumPresets() + m_userBank.getNumPresets());
 }
 
 int MckDelayAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return m_currentProgram;
 }
 
 void MckDelayAudioProcessor::setCurrentProgram(int index)
 {
+    const auto &factory = getFactoryBank();
+    const int numFactory = static_cast<int>(factory.getNumPresets());
+    if (index < 0 || index >= getNumPrograms())
+    {
+        return;
+    }
+    // A lookup in the index of a mapped bank, nothing is parsed
+    applyState(index < numFactory ? factory.getState(static_cast<size_t>(index)) : m_userBank.getState(static_cast<size_t>(index - numFactory)));
+    m_currentProgram = index;
 }
 
 const juce::String MckDelayAudioProcessor::getProgramName(int index)
 {
-    return {};
+    const auto &factory = getFactoryBank();
+    const int numFactory = static_cast<int>(factory.getNumPresets());
+    if (index < 0 || index >= getNumPrograms())
+    {
+        return {};
+    }
+    const auto name = index < numFactory ? factory.getName(static_cast<size_t>(index)) : m_userBank.getName(static_cast<size_t>(index - numFactory));
+    return juce::String::fromUTF8(name.data(), static_cast<int>(name.size()));
 }
 
 void MckDelayAudioProcessor::changeProgramName(int index, const juce::String &newName)
 {
+    // Factory presets keep their names
+    const int user = index - static_cast<int>(getFactoryBank().getNumPresets());
+    if (user < 0 || user >= static_cast<int>(m_userBank.getNumPresets()))
+    {
+        return;
+    }
+    auto writer = copyUserBank();
+    writer.setName(static_cast<size_t>(user), newName.toStdString());
+    writeUserBank(writer);
+}
+
+bool MckDelayAudioProcessor::saveUserPreset(const juce::String &name)
+{
+    auto writer = copyUserBank();
+    juce::MemoryBlock state;
+    getStateInformation(state);
+    writer.add(name.toStdString(), state.getData(), state.getSize());
+    if (!writeUserBank(writer))
+    {
+        return false;
+    }
+    m_currentProgram = getNumPrograms() - 1;
+    updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true));
+    return true;
+}
+
+MckDsp::PresetBankWriter MckDelayAudioProcessor::copyUserBank() const
+{
+    MckDsp::PresetBankWriter writer;
+    for (size_t i = 0; i < m_userBank.getNumPresets(); i++)
+    {
+        const auto state = m_userBank.getState(i);
+        writer.add(m_userBank.getName(i), state.getData(), state.getSize());
+    }
+    return writer;
 }
 
 //==============================================================================
@@ -123,19 +276,134 @@ void MckDelayAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBloc
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
+    MCK_TRACE_ZONE("prepareToPlay");
 
-    numChannels = getTotalNumInputChannels();
-    m_delays.resize(numChannels);
-    for (auto &dly : m_delays) {
-        dly.prepareToPlay(sampleRate, samplesPerBlock);
+    numChannels = std::min(getTotalNumInputChannels(), getTotalNumOutputChannels());
+    m_sampleRate = sampleRate;
+    m_samplesPerBlock = samplesPerBlock;
+    m_loadProfiler.reset();
+
+    m_numGroups = std::max(1, (static_cast<int>(numChannels) + groupChannels - 1) / groupChannels);
+
+    // Only the engines of the selected mode take memory, handleAsyncUpdate() switches them later on
+    m_engineMode.store(mode->getIndex(), std::memory_order_relaxed);
+    prepareEngines();
+    applyImpulseResponse();
+
+    // The audio thread takes part in the work, so one group is left for it
+    m_pool.stop();
+    if (m_numGroups >= minParallelGroups)
+    {
+        const int numCores = static_cast<int>(std::thread::hardware_concurrency());
+        m_pool.start(std::min({m_numGroups - 1, maxPoolWorkers, numCores - 1}), 1000.0 * samplesPerBlock / sampleRate);
+
+        // The audio thread waits for the groups the workers took, which must not be preempted by ordinary threads meanwhile
+        if (m_pool.getNumRealtimeWorkers() < m_pool.getNumWorkers())
+        {
+            m_pool.stop();
+        }
     }
 
 }
 
+void MckDelayAudioProcessor::prepareEngines()
+{
+    const int engineMode = m_engineMode.load(std::memory_order_relaxed);
+    const double sampleRate = m_sampleRate;
+    const int samplesPerBlock = m_samplesPerBlock;
+
+    // The long line is sized for the current long time up front, later growth happens in handleAsyncUpdate()
+    const auto format = static_cast<MckDsp::SampleFormat>(longFormat->getIndex());
+    const double longTimeInMs = static_cast<double>(*longTime);
+    auto prepare = [&](auto &engines)
+    {
+        for (int g = 0; g < maxGroups; g++)
+        {
+            auto &e = engines[g];
+            const bool used = g < m_numGroups;
+            const int groupSize = std::max(1, std::min(groupChannels, static_cast<int>(numChannels) - g * groupChannels));
+            if (used && engineMode == 0)
+            {
+                e.delay.prepareToPlay(sampleRate, samplesPerBlock, groupSize);
+            }
+            else
+            {
+                e.delay.releaseResources();
+            }
+            if (used && engineMode == 1)
+            {
+                e.multiTap.prepareToPlay(sampleRate, samplesPerBlock, groupSize);
+            }
+            else
+            {
+                e.multiTap.releaseResources();
+            }
+            if (used && engineMode == 2)
+            {
+                e.longDelay.setFormat(format);
+                e.longDelay.setMaxDelayInMs(longTimeInMs);
+                e.longDelay.prepareToPlay(sampleRate, samplesPerBlock, groupSize);
+            }
+            else
+            {
+                e.longDelay.releaseResources();
+            }
+            if (used && engineMode == 3)
+            {
+                e.fdn.setMaxNumLines(4 << fdnLines->getIndex());
+                e.fdn.prepareToPlay(sampleRate, samplesPerBlock, groupSize);
+            }
+            else
+            {
+                e.fdn.releaseResources();
+            }
+        }
+    };
+    auto release = [](auto &engines)
+    {
+        for (auto &e : engines)
+        {
+            e.delay.releaseResources();
+            e.multiTap.releaseResources();
+            e.longDelay.releaseResources();
+            e.fdn.releaseResources();
+        }
+    };
+    if (isUsingDoublePrecision())
+    {
+        release(m_float);
+        prepare(m_double);
+    }
+    else
+    {
+        release(m_double);
+        prepare(m_float);
+    }
+
+    // The new engines only know the settings they were given before, so everything is applied again
+    m_params.invalidate();
+}
+
 void MckDelayAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+
+    m_pool.stop();
+
+    // The buffers go back to the arena, a following prepareToPlay with the same settings gets them again
+    auto release = [](auto &engines)
+    {
+        for (auto &e : engines)
+        {
+            e.delay.releaseResources();
+            e.multiTap.releaseResources();
+            e.longDelay.releaseResources();
+            e.fdn.releaseResources();
+        }
+    };
+    release(m_float);
+    release(m_double);
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -145,11 +413,8 @@ bool MckDelayAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts)
     juce::ignoreUnused(layouts);
     return true;
 #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono() && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Every channel has its own delay line, so any discrete, surround or ambisonic layout up to maxBusChannels works
+    if (layouts.getMainOutputChannelSet().isDisabled() || layouts.getMainOutputChannelSet().size() > maxBusChannels)
         return false;
 
         // This checks if the input layout matches the output layout
@@ -164,8 +429,21 @@ bool MckDelayAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts)
 #endif
 
 void MckDelayAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages)
+{
+    processDelay(buffer, midiMessages, m_float);
+}
+
+void MckDelayAudioProcessor::processBlock(juce::AudioBuffer<double> &buffer, juce::MidiBuffer &midiMessages)
+{
+    processDelay(buffer, midiMessages, m_double);
+}
+
+template <typename SampleType>
+void MckDelayAudioProcessor::processDelay(juce::AudioBuffer<SampleType> &buffer, const juce::MidiBuffer &midiMessages, std::array<Engines<SampleType>, maxGroups> &engines)
 {
     juce::ScopedNoDenormals noDenormals;
+    MCK_TRACE_THREAD("Audio");
+    MCK_TRACE_ZONE("processBlock");
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -174,27 +452,541 @@ void MckDelayAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer, juce
     }
 
     size_t len = buffer.getNumSamples();
-    double wetMix = static_cast<double>(*mix) / 100.0;
-    double wetFb = ((double)*feedback) / 100.0;
-    double timeCoeff = (static_cast<double>(*time) - m_oldTime) / static_cast<double>(len);
 
-    for (size_t channel = 0; channel < std::min(totalNumInputChannels, totalNumOutputChannels); ++channel)
+    const bool telemetry = m_telemetryEnabled.load(std::memory_order_relaxed);
+    MckDsp::TelemetryFrame frame;
+    if (telemetry)
+    {
+        MckDsp::LevelAccumulator input;
+        for (int c = 0; c < totalNumInputChannels; c++)
+        {
+            input.add(buffer.getReadPointer(c), len);
+        }
+        frame.input = input.get();
+    }
+
+    // Everything from here on counts towards the load of the block
+    const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+
+    // Any signal at the input wakes an idle line before the block is processed
+    SampleType inputPeak = 0;
+    for (int c = 0; c < totalNumInputChannels; c++)
+    {
+        inputPeak = std::max(inputPeak, buffer.getMagnitude(c, 0, static_cast<int>(len)));
+    }
+    const bool inputSilent = inputPeak < static_cast<SampleType>(MckDsp::silenceThreshold);
+    if (inputSilent == false)
+    {
+        m_idle.wake();
+    }
+
+    MckDsp::DelayParameters params;
+    MckDsp::LevelAccumulator wetLevels;
+    MckDsp::LevelAccumulator feedbackLevels;
+
+    // Reads the parameters and hands the changed ones to the engines of every group
+    auto update = [&](size_t rampLength)
+    {
+        MCK_TRACE_ZONE("ParameterSnapshot");
+        // Another mode only holds memory once handleAsyncUpdate() prepared it, the current one keeps running meanwhile
+        if (mode->getIndex() != m_engineMode.load(std::memory_order_relaxed))
+        {
+            triggerAsyncUpdate();
+        }
+        params = readParameters();
+        const unsigned dirty = m_params.update(params);
+        for (int g = 0; g < m_numGroups; g++)
+        {
+            applyParameters(params, dirty, rampLength, g, engines[g]);
+        }
+    };
+
+    const int numBufferChannels = std::min(buffer.getNumChannels(), m_numGroups * groupChannels);
+    SampleType *channels[maxGroups * groupChannels]{};
+    MckDsp::Levels groupWet[maxGroups]{};
+    MckDsp::Levels groupFb[maxGroups]{};
+    // The line levels are only needed for the meters and while the input is silent
+    const bool measure = telemetry || inputSilent;
+    size_t partLength = 0;
+
+    // Runs the current part of group g through the selected engine, on the audio thread or a worker
+    auto processGroup = [&](size_t g)
+    {
+        MCK_TRACE_ZONE("ChannelGroup");
+        auto &e = engines[g];
+        SampleType *const *ptrs = channels + g * groupChannels;
+        if (params.multiTap)
+        {
+            e.multiTap.processBlock(ptrs, ptrs, partLength);
+            if (measure)
+            {
+                e.multiTap.getLevels(partLength, groupWet[g], groupFb[g]);
+            }
+        }
+        else if (params.longDelay)
+        {
+            e.longDelay.processBlock(ptrs, ptrs, partLength);
+            if (measure)
+            {
+                e.longDelay.getLevels(partLength, groupWet[g], groupFb[g]);
+            }
+        }
+        else if (params.fdn)
+        {
+            e.fdn.processBlock(ptrs, ptrs, partLength);
+            if (measure)
+            {
+                e.fdn.getLevels(partLength, groupWet[g], groupFb[g]);
+            }
+        }
+        else
+        {
+            e.delay.processBlock(ptrs, ptrs, partLength);
+            if (measure)
+            {
+                e.delay.getLevels(partLength, groupWet[g], groupFb[g]);
+            }
+        }
+    };
+
+    // Runs numSamples samples from offset on through all groups
+    auto run = [&](size_t offset, size_t numSamples)
+    {
+        if (m_idle.isIdle())
+        {
+            // The line is empty, only the dry part of the input remains
+            for (int c = 0; c < numBufferChannels; c++)
+            {
+                buffer.applyGain(c, static_cast<int>(offset), static_cast<int>(numSamples), static_cast<SampleType>(1.0 - params.mix));
+            }
+            wetLevels.add(MckDsp::Levels{}, numSamples);
+            feedbackLevels.add(MckDsp::Levels{}, numSamples);
+            return;
+        }
+
+        for (int c = 0; c < numBufferChannels; c++)
+        {
+            channels[c] = buffer.getWritePointer(c) + offset;
+        }
+        partLength = numSamples;
+        m_pool.run(static_cast<size_t>(m_numGroups), processGroup);
+
+        MckDsp::LevelAccumulator fbPart;
+        if (measure)
+        {
+            for (int g = 0; g < m_numGroups; g++)
+            {
+                wetLevels.add(groupWet[g], numSamples);
+                feedbackLevels.add(groupFb[g], numSamples);
+                fbPart.add(groupFb[g], numSamples);
+            }
+        }
+
+        // Once nothing but silence was written for the whole line, every later read returns silence as well
+        auto &first = engines[0];
+        double maxDelayInMs = first.delay.getMaxDelayInMs();
+        if (params.multiTap)
+        {
+            maxDelayInMs = first.multiTap.getMaxDelayInMs();
+        }
+        else if (params.longDelay)
+        {
+            maxDelayInMs = first.longDelay.getMaxDelayInMs();
+        }
+        else if (params.fdn)
+        {
+            maxDelayInMs = first.fdn.getMaxDelayInMs();
+        }
+        m_idle.setMemoryLength(static_cast<size_t>(std::ceil(maxDelayInMs * m_sampleRate / 1000.0)) + static_cast<size_t>(m_samplesPerBlock));
+        m_idle.update(inputSilent && fbPart.get().peak < static_cast<float>(MckDsp::silenceThreshold), numSamples);
+    };
+
+    if (automation->getIndex() == 0)
+    {
+        // Controllers are only mapped with sample accurate automation, the delay time ramps across the block
+        update(len);
+        run(0, len);
+    }
+    else
+    {
+        // The block is only split where a controller changes a parameter. Parts that start at a controller
+        // event jump to its value, the first part ramps to the values read at the block start like Block does
+        size_t pos = 0;
+        bool atController = false;
+        for (const auto metadata : midiMessages)
+        {
+            const auto msg = metadata.getMessage();
+            if (!msg.isController() || m_controllers[msg.getControllerNumber()] == nullptr)
+            {
+                continue;
+            }
+            const size_t at = std::min(len, std::max(pos, static_cast<size_t>(std::max(metadata.samplePosition, 0))));
+            if (at > pos)
+            {
+                update(atController ? 0 : at - pos);
+                run(pos, at - pos);
+                pos = at;
+            }
+            applyController(msg.getControllerNumber(), msg.getControllerValue());
+            atController = true;
+        }
+        if (pos < len)
+        {
+            update(atController ? 0 : len - pos);
+            run(pos, len - pos);
+        }
+    }
+
+    const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    const double load = len > 0 ? seconds * m_sampleRate / static_cast<double>(len) : 0.0;
+    m_loadProfiler.record(load);
+
+    if (telemetry)
+    {
+        frame.blockTimeInUs = static_cast<float>(seconds * 1e6);
+        frame.blockLoad = static_cast<float>(load);
+        frame.numSamples = static_cast<uint32_t>(len);
+        frame.wet = wetLevels.get();
+        frame.feedback = feedbackLevels.get();
+        // Never waits for the editor, frames are dropped while the queue is full
+        m_telemetry.push(frame);
+    }
+}
+
+MckDsp::DelayParameters MckDelayAudioProcessor::readParameters() const
+{
+    MckDsp::DelayParameters params;
+    params.timeInMs = static_cast<double>(*time);
+    params.feedback = static_cast<double>(*feedback) / 100.0;
+    params.mix = static_cast<double>(*mix) / 100.0;
+    params.lpActive = *lpActive;
+    params.lpFreq = static_cast<double>(*lpFreq);
+    params.hpActive = *hpActive;
+    params.hpFreq = static_cast<double>(*hpFreq);
+    params.interpolation = static_cast<MckDsp::Interpolation>(interp->getIndex());
+    const int engineMode = m_engineMode.load(std::memory_order_relaxed);
+    params.multiTap = engineMode == 1;
+    params.numTaps = *numTaps;
+    params.longDelay = engineMode == 2;
+    params.longTimeInMs = static_cast<double>(*longTime);
+    params.longFormat = static_cast<MckDsp::SampleFormat>(longFormat->getIndex());
+    params.fdn = engineMode == 3;
+    params.fdnLines = 4 << fdnLines->getIndex();
+    params.modShape = static_cast<MckDsp::LfoShape>(modShape->getIndex());
+    params.modRateInHz = static_cast<double>(*modRate);
+    params.modDepthInMs = static_cast<double>(*modDepth);
+    params.modPhase = static_cast<double>(*modPhase) / 360.0;
+    params.convActive = *convActive;
+    for (int t = 0; t < MckDsp::maxDelayTaps; t++)
+    {
+        auto &tap = params.taps[t];
+        tap.timeInMs = static_cast<double>(*taps[t].time);
+        tap.gain = static_cast<double>(*taps[t].level) / 100.0;
+        tap.pan = static_cast<double>(*taps[t].pan) / 100.0;
+        tap.lpActive = *taps[t].lpActive;
+        tap.lpFreq = static_cast<double>(*taps[t].lpFreq);
+        tap.hpActive = *taps[t].hpActive;
+        tap.hpFreq = static_cast<double>(*taps[t].hpFreq);
+    }
+    return params;
+}
+
+template <typename SampleType>
+void MckDelayAudioProcessor::applyParameters(const MckDsp::DelayParameters &params, unsigned dirty, size_t rampLength, int group, Engines<SampleType> &engines)
+{
+    auto &delay = engines.delay;
+    auto &multiTap = engines.multiTap;
+    auto &longDelay = engines.longDelay;
+    auto &fdn = engines.fdn;
+
+    // Only touch the engine for parameters that changed since the last update
+    if (dirty & MckDsp::ParameterSnapshot::Mix)
+    {
+        delay.setMix(params.mix);
+        multiTap.setMix(params.mix);
+        longDelay.setMix(params.mix);
+        fdn.setMix(params.mix);
+    }
+    if (dirty & MckDsp::ParameterSnapshot::Feedback)
+    {
+        delay.setFeedback(params.feedback);
+        multiTap.setFeedback(params.feedback);
+        longDelay.setFeedback(params.feedback);
+        fdn.setFeedback(params.feedback);
+    }
+    if (dirty & MckDsp::ParameterSnapshot::LowPass)
+    {
+        delay.setLowPass(params.lpActive, params.lpFreq);
+        longDelay.setLowPass(params.lpActive, params.lpFreq);
+        fdn.setLowPass(params.lpActive, params.lpFreq);
+    }
+    if (dirty & MckDsp::ParameterSnapshot::HighPass)
+    {
+        delay.setHighPass(params.hpActive, params.hpFreq);
+        longDelay.setHighPass(params.hpActive, params.hpFreq);
+        fdn.setHighPass(params.hpActive, params.hpFreq);
+    }
+    if (dirty & MckDsp::ParameterSnapshot::Interp)
+    {
+        delay.setInterpolation(params.interpolation);
+        multiTap.setInterpolation(params.interpolation);
+        longDelay.setInterpolation(params.interpolation);
+    }
+    if (dirty & MckDsp::ParameterSnapshot::Mode)
+    {
+        multiTap.setNumTaps(params.numTaps);
+        fdn.setNumLines(params.fdnLines);
+        // More lines than the ring was reserved for are shorter until handleAsyncUpdate() grew it
+        if (params.fdnLines > fdn.getMaxNumLines())
+        {
+            triggerAsyncUpdate();
+        }
+        // The newly selected line may still hold a signal
+        m_idle.wake();
+    }
+    if (dirty & MckDsp::ParameterSnapshot::Taps)
+    {
+        unsigned dirtyTaps = m_params.getDirtyTaps();
+        for (int t = 0; t < MckDsp::maxDelayTaps; t++)
+        {
+            if (dirtyTaps & (1u << t))
+            {
+                multiTap.setTap(t, params.taps[t]);
+            }
+        }
+    }
+    if (dirty & MckDsp::ParameterSnapshot::Time)
+    {
+        // Jump right after prepareToPlay
+        delay.setDelayInMs(params.timeInMs, (dirty & MckDsp::ParameterSnapshot::Reset) ? 0 : rampLength);
+        // The FDN has no fractional reads, its line lengths jump
+        fdn.setDelayInMs(params.timeInMs);
+    }
+    if (dirty & MckDsp::ParameterSnapshot::Modulation)
+    {
+        // The phases continue across groups, so channel 9 is one offset behind channel 8
+        const double firstPhase = static_cast<double>(group * groupChannels) * params.modPhase;
+        delay.setModulation(params.modShape, params.modRateInHz, params.modDepthInMs, firstPhase, params.modPhase);
+    }
+    if (dirty & MckDsp::ParameterSnapshot::Convolution)
+    {
+        delay.setConvolution(params.convActive);
+    }
+    if (dirty & MckDsp::ParameterSnapshot::Long)
+    {
+        longDelay.setDelayInMs(params.longTimeInMs);
+        // Pages and format changes need memory, the line keeps running at its current length meanwhile
+        if (params.longTimeInMs > longDelay.getMaxDelayInMs() || params.longFormat != longDelay.getFormat())
+        {
+            triggerAsyncUpdate();
+        }
+    }
+}
+
+bool MckDelayAudioProcessor::loadImpulseResponse(const juce::File &file)
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->numChannels == 0 || reader->sampleRate <= 0.0)
     {
-        auto *readPtr = buffer.getReadPointer(channel);
-        auto *writePtr = buffer.getWritePointer(channel);
+        return false;
+    }
 
-        m_delays[channel].setMix(wetMix);
-        m_delays[channel].setFeedback(wetFb);
-        m_delays[channel].setLowPass(*lpActive, static_cast<double>(*lpFreq));
-        m_delays[channel].setHighPass(*hpActive, static_cast<double>(*hpFreq));
+    // Enough for the longest response the convolution takes even after resampling down by four
+    const int length = static_cast<int>(std::min<juce::int64>(reader->lengthInSamples, 4 * MckDsp::PartitionedConvolver<float>::maxLength));
+    const int numFileChannels = static_cast<int>(reader->numChannels);
+    juce::AudioBuffer<float> buffer(numFileChannels, length);
+    reader->read(&buffer, 0, length, 0, true, true);
 
-        for (size_t s = 0; s < len; s++) {
-            m_delays[channel].setDelayInMs(m_oldTime + static_cast<double>(s) * timeCoeff);
-            writePtr[s] = m_delays[channel].processSample(readPtr[s]);
+    std::vector<float> samples(static_cast<size_t>(length), 0.0f);
+    for (int c = 0; c < numFileChannels; c++)
+    {
+        const float *src = buffer.getReadPointer(c);
+        for (int i = 0; i < length; i++)
+        {
+            samples[static_cast<size_t>(i)] += src[i] / static_cast<float>(numFileChannels);
         }
     }
 
-    m_oldTime = static_cast<double>(*time);
+    {
+        const juce::ScopedLock lock(m_irLock);
+        m_irFile = file;
+        m_irSamples = std::move(samples);
+        m_irSampleRate = reader->sampleRate;
+    }
+    applyImpulseResponse();
+    return true;
+}
+
+juce::File MckDelayAudioProcessor::getImpulseResponseFile() const
+{
+    const juce::ScopedLock lock(m_irLock);
+    return m_irFile;
+}
+
+void MckDelayAudioProcessor::clearImpulseResponse()
+{
+    {
+        const juce::ScopedLock lock(m_irLock);
+        m_irFile = juce::File{};
+        m_irSamples.clear();
+        m_irSampleRate = 0.0;
+    }
+    applyImpulseResponse();
+}
+
+void MckDelayAudioProcessor::applyImpulseResponse()
+{
+    const juce::ScopedLock lock(m_irLock);
+    if (m_sampleRate <= 0.0)
+    {
+        return;
+    }
+
+    // Resampled with the gain of every sample scaled by the ratio, so the response keeps its level
+    std::vector<float> ir = m_irSamples;
+    const double ratio = m_irSampleRate / m_sampleRate;
+    if (!m_irSamples.empty() && ratio != 1.0)
+    {
+        ir.assign(static_cast<size_t>(std::ceil(static_cast<double>(m_irSamples.size()) / ratio)), 0.0f);
+        juce::LagrangeInterpolator resampler;
+        resampler.process(ratio, m_irSamples.data(), ir.data(), static_cast<int>(ir.size()), static_cast<int>(m_irSamples.size()), 0);
+        juce::FloatVectorOperations::multiply(ir.data(), static_cast<float>(ratio), static_cast<int>(ir.size()));
+    }
+    const size_t length = std::min(ir.size(), MckDsp::PartitionedConvolver<float>::maxLength);
+    m_irLengthInMs.store(static_cast<double>(length) / m_sampleRate * 1000.0, std::memory_order_relaxed);
+
+    // Only the single line convolves, prepareEngines() hands the response over when it gets selected
+    if (m_engineMode.load(std::memory_order_relaxed) != 0)
+    {
+        return;
+    }
+
+    for (int g = 0; g < m_numGroups; g++)
+    {
+        if (isUsingDoublePrecision())
+        {
+            m_double[g].delay.setImpulseResponse(ir.data(), length);
+        }
+        else
+        {
+            m_float[g].delay.setImpulseResponse(ir.data(), length);
+        }
+    }
+}
+
+void MckDelayAudioProcessor::applyController(int number, int value)
+{
+    // Host listeners may lock or allocate, so the audio thread only sets the value and the host hears about it in handleAsyncUpdate()
+    m_controllers[number]->setValue(static_cast<float>(value) / 127.0f);
+    m_pendingControllers[static_cast<size_t>(number >> 6)].fetch_or(uint64_t(1) << (number & 63), std::memory_order_release);
+    triggerAsyncUpdate();
+}
+
+void MckDelayAudioProcessor::handleAsyncUpdate()
+{
+    for (size_t w = 0; w < m_pendingControllers.size(); w++)
+    {
+        const uint64_t pending = m_pendingControllers[w].exchange(0, std::memory_order_acquire);
+        for (int b = 0; b < 64; b++)
+        {
+            if (pending & (uint64_t(1) << b))
+            {
+                auto *param = m_controllers[w * 64 + static_cast<size_t>(b)];
+                param->setValueNotifyingHost(param->getValue());
+            }
+        }
+    }
+
+    // Preparing the engines of another mode takes memory from the arena, so the audio thread must not run meanwhile
+    const int engineMode = mode->getIndex();
+    if (engineMode != m_engineMode.load(std::memory_order_relaxed) && m_sampleRate > 0.0)
+    {
+        suspendProcessing(true);
+        m_engineMode.store(engineMode, std::memory_order_relaxed);
+        prepareEngines();
+        suspendProcessing(false);
+        applyImpulseResponse();
+    }
+
+    const auto format = static_cast<MckDsp::SampleFormat>(longFormat->getIndex());
+    const double longTimeInMs = static_cast<double>(*longTime);
+
+    // The lines are rebuilt from scratch on a format change, so the audio thread must not run meanwhile
+    if (format != m_float[0].longDelay.getFormat() || format != m_double[0].longDelay.getFormat())
+    {
+        suspendProcessing(true);
+        for (int g = 0; g < maxGroups; g++)
+        {
+            m_float[g].longDelay.setFormat(format);
+            m_double[g].longDelay.setFormat(format);
+        }
+        suspendProcessing(false);
+    }
+    for (int g = 0; g < maxGroups; g++)
+    {
+        if (longTimeInMs > m_float[g].longDelay.getMaxDelayInMs())
+        {
+            m_float[g].longDelay.setMaxDelayInMs(longTimeInMs);
+        }
+        if (longTimeInMs > m_double[g].longDelay.getMaxDelayInMs())
+        {
+            m_double[g].longDelay.setMaxDelayInMs(longTimeInMs);
+        }
+    }
+
+    // Only prepared networks take the larger ring, the audio thread picks it up like a longer time
+    const int numLines = 4 << fdnLines->getIndex();
+    for (int g = 0; g < maxGroups; g++)
+    {
+        if (numLines > m_float[g].fdn.getMaxNumLines())
+        {
+            m_float[g].fdn.setMaxNumLines(numLines);
+        }
+        if (numLines > m_double[g].fdn.getMaxNumLines())
+        {
+            m_double[g].fdn.setMaxNumLines(numLines);
+        }
+    }
+}
+
+juce::String MckDelayAudioProcessor::getLoadProfileJson() const
+{
+    auto stats = m_loadProfiler.getStats();
+
+    auto root = std::make_unique<juce::DynamicObject>();
+    root->setProperty("plugin", getName());
+    root->setProperty("sampleRate", m_sampleRate);
+    root->setProperty("samplesPerBlock", m_samplesPerBlock);
+    root->setProperty("doublePrecision", isUsingDoublePrecision());
+    root->setProperty("channels", static_cast<int>(numChannels));
+    root->setProperty("workers", m_pool.getNumWorkers());
+    root->setProperty("mode", mode->getCurrentChoiceName());
+    root->setProperty("blocks", static_cast<juce::int64>(stats.numBlocks));
+    root->setProperty("overruns", static_cast<juce::int64>(stats.numOverruns));
+    root->setProperty("overrunThreshold", stats.overrunThreshold);
+    root->setProperty("mean", stats.mean);
+    root->setProperty("p50", stats.p50);
+    root->setProperty("p99", stats.p99);
+    root->setProperty("max", stats.max);
+
+    // Only the occupied bins, each with its centre load and block count
+    juce::Array<juce::var> histogram;
+    for (int b = 0; b < MckDsp::LoadProfiler::numBins; b++)
+    {
+        auto count = m_loadProfiler.getBinCount(b);
+        if (count > 0)
+        {
+            auto bin = std::make_unique<juce::DynamicObject>();
+            bin->setProperty("load", MckDsp::LoadProfiler::binCentre(b));
+            bin->setProperty("blocks", static_cast<juce::int64>(count));
+            histogram.add(juce::var(bin.release()));
+        }
+    }
+    root->setProperty("histogram", histogram);
+
+    return juce::JSON::toString(juce::var(root.release()));
 }
 
 //==============================================================================
@@ -211,50 +1003,209 @@ juce::AudioProcessorEditor *MckDelayAudioProcessor::createEditor()
 //==============================================================================
 void MckDelayAudioProcessor::getStateInformation(juce::MemoryBlock &destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
-
-    std::unique_ptr<juce::XmlElement> xml(new juce::XmlElement("MckDelay"));
-    xml->setAttribute("time", (double)*time);
-    xml->setAttribute("feedback", (double)*feedback);
-    xml->setAttribute("mix", (double)*mix);
-    xml->setAttribute("lpactive", (double)*lpActive);
-    xml->setAttribute("lpfreq", (double)*lpFreq);
-    xml->setAttribute("hpactive", (double)*hpActive);
-    xml->setAttribute("hpfreq", (double)*hpFreq);
-    copyXmlToBinary(*xml, destData);
+    // Plain parameter values in a fixed binary layout, hosts snapshot many instances at once
+    std::vector<MckDsp::StateValue> values(m_stateParams.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        values[i].id = m_stateIds[i];
+        values[i].value = m_stateParams[i]->convertFrom0to1(m_stateParams[i]->getValue());
+    }
+    destData.setSize(MckDsp::stateSize(values.size()));
+    MckDsp::writeState(values.data(), values.size(), m_currentProgram, destData.getData());
 
-    // juce::MemoryOutputStream(destData, true).writeInt(*time);
-    // juce::MemoryOutputStream(destData, true).writeInt(*mix);
-    // juce::MemoryOutputStream(destData, true).writeInt(*feedback);
+    // Readers of the binary state skip what follows the values
+    const auto irPath = getImpulseResponseFile().getFullPathName();
+    if (irPath.isNotEmpty())
+    {
+        destData.append(irPath.toRawUTF8(), irPath.getNumBytesAsUTF8());
+    }
 }
 
 void MckDelayAudioProcessor::setStateInformation(const void *data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
-    // *time = juce::MemoryInputStream(data, static_cast<size_t>(sizeInBytes), false).readInt();
-    // *mix = juce::MemoryInputStream(data, static_cast<size_t>(sizeInBytes), false).readInt();
-    // *feedback = juce::MemoryInputStream(data, static_cast<size_t>(sizeInBytes), false).readInt();
+    MckDsp::StateView state;
+    if (state.open(data, static_cast<size_t>(std::max(sizeInBytes, 0))))
+    {
+        applyState(state);
+        m_currentProgram = juce::jlimit(0, getNumPrograms() - 1, static_cast<int>(state.getProgram()));
+
+        // The state decides about the response as well, one without a path or with a missing file runs without
+        const size_t extra = static_cast<size_t>(sizeInBytes) - state.getSize();
+        const juce::File irFile = extra > 0 ? juce::File(juce::String::fromUTF8(static_cast<const char *>(data) + state.getSize(), static_cast<int>(extra)))
+                                            : juce::File{};
+        if (irFile != getImpulseResponseFile() && (irFile == juce::File{} || !loadImpulseResponse(irFile)))
+        {
+            clearImpulseResponse();
+        }
+        return;
+    }
 
     std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
+    if (xmlState.get() != nullptr && xmlState->hasTagName("MckDelay"))
+    {
+        applyXmlState(*xmlState);
+
+        // XML states predate impulse responses, so they run without one like a binary state without a path
+        clearImpulseResponse();
+    }
+}
+
+void MckDelayAudioProcessor::applyState(const MckDsp::StateView &state)
+{
+    std::vector<bool> restored(m_stateParams.size(), false);
+    for (size_t i = 0; i < state.getNumValues(); i++)
+    {
+        const auto value = state.getValue(i);
 
-    if (xmlState.get() != nullptr)
+        // States of this version list the parameters in order, only older ones need the search
+        int index = -1;
+        if (i < m_stateIds.size() && m_stateIds[i] == value.id)
+        {
+            index = static_cast<int>(i);
+        }
+        else
+        {
+            const auto it = std::lower_bound(m_stateLookup.begin(), m_stateLookup.end(), std::make_pair(value.id, 0));
+            if (it != m_stateLookup.end() && it->first == value.id)
+            {
+                index = it->second;
+            }
+        }
+        if (index >= 0)
+        {
+            auto *param = m_stateParams[static_cast<size_t>(index)];
+            param->setValueNotifyingHost(param->convertTo0to1(value.value));
+            restored[static_cast<size_t>(index)] = true;
+        }
+    }
+
+    for (size_t i = 0; i < m_stateParams.size(); i++)
     {
-        if (xmlState->hasTagName("MckDelay"))
+        if (!restored[i])
         {
-            *time = xmlState->getIntAttribute("time", 250);
-            *feedback = xmlState->getIntAttribute("feedback", 25);
-            *mix = xmlState->getIntAttribute("mix", 50);
-            *lpActive = xmlState->getBoolAttribute("lpactive", false);
-            *lpFreq = static_cast<float>(xmlState->getDoubleAttribute("lpfreq", 1000));
-            *hpActive = xmlState->getBoolAttribute("hpactive", false);
-            *hpFreq = static_cast<float>(xmlState->getDoubleAttribute("hpfreq", 1000));
+            m_stateParams[i]->setValueNotifyingHost(m_stateParams[i]->getDefaultValue());
         }
     }
 }
 
+void MckDelayAudioProcessor::applyXmlState(const juce::XmlElement &xml)
+{
+    *time = xml.getIntAttribute("time", 250);
+    *feedback = xml.getIntAttribute("feedback", 25);
+    *mix = xml.getIntAttribute("mix", 50);
+    *lpActive = xml.getBoolAttribute("lpactive", false);
+    *lpFreq = static_cast<float>(xml.getDoubleAttribute("lpfreq", 1000));
+    *hpActive = xml.getBoolAttribute("hpactive", false);
+    *hpFreq = static_cast<float>(xml.getDoubleAttribute("hpfreq", 1000));
+    *interp = xml.getIntAttribute("interp", 1);
+    *mode = xml.getIntAttribute("mode", 0);
+    *numTaps = xml.getIntAttribute("taps", 4);
+    *longTime = xml.getIntAttribute("longtime", 4000);
+    *longFormat = xml.getIntAttribute("longformat", 1);
+    *fdnLines = xml.getIntAttribute("fdnlines", 1);
+    *modShape = xml.getIntAttribute("modshape", 0);
+    *modRate = static_cast<float>(xml.getDoubleAttribute("modrate", 0.5));
+    *modDepth = static_cast<float>(xml.getDoubleAttribute("moddepth", 0.0));
+    *modPhase = xml.getIntAttribute("modphase", 90);
+    *automation = xml.getIntAttribute("automation", 0);
+    for (int t = 0; t < MckDsp::maxDelayTaps; t++)
+    {
+        juce::String id = "tap" + juce::String(t + 1);
+        *taps[t].time = xml.getIntAttribute(id + "time", std::min(getMaxTime(), 125 * (t + 1)));
+        *taps[t].level = xml.getIntAttribute(id + "level", 25);
+        *taps[t].pan = xml.getIntAttribute(id + "pan", 0);
+        *taps[t].lpActive = xml.getBoolAttribute(id + "lpactive", false);
+        *taps[t].lpFreq = static_cast<float>(xml.getDoubleAttribute(id + "lpfreq", 1000));
+        *taps[t].hpActive = xml.getBoolAttribute(id + "hpactive", false);
+        *taps[t].hpFreq = static_cast<float>(xml.getDoubleAttribute(id + "hpfreq", 1000));
+    }
+}
+
+const MckDsp::PresetBankView &MckDelayAudioProcessor::getFactoryBank()
+{
+    // Plain values of the parameters that differ from their defaults
+    struct FactoryPreset
+    {
+        const char *name;
+        std::vector<std::pair<const char *, float>> values;
+    };
+    static const std::vector<uint8_t> data = []
+    {
+        const FactoryPreset presets[] = {
+            {"Init", {}},
+            {"Slapback", {{"time", 110}, {"feedback", 10}, {"mix", 35}, {"lpactive", 1}, {"lpfreq", 5000}}},
+            {"Quarter Echo", {{"time", 500}, {"feedback", 40}, {"mix", 35}, {"hpactive", 1}, {"hpfreq", 200}}},
+            {"Dark Repeats", {{"time", 375}, {"feedback", 60}, {"mix", 40}, {"lpactive", 1}, {"lpfreq", 1800}, {"interp", 3}}},
+            {"Ping Pong Taps", {{"mode", 1}, {"taps", 4}, {"feedback", 30}, {"mix", 40}, {"tap1pan", -100}, {"tap2pan", 100}, {"tap3pan", -100}, {"tap4pan", 100}}},
+            {"Tape Loop", {{"mode", 2}, {"longtime", 8000}, {"longformat", 2}, {"feedback", 70}, {"mix", 40}, {"lpactive", 1}, {"lpfreq", 3000}, {"hpactive", 1}, {"hpfreq", 150}}},
+            {"Small Room", {{"mode", 3}, {"time", 120}, {"fdnlines", 1}, {"feedback", 60}, {"mix", 25}, {"lpactive", 1}, {"lpfreq", 6000}}},
+            {"Large Hall", {{"mode", 3}, {"time", 600}, {"fdnlines", 2}, {"feedback", 85}, {"mix", 35}, {"lpactive", 1}, {"lpfreq", 3500}, {"hpactive", 1}, {"hpfreq", 80}}},
+            {"Chorus", {{"time", 15}, {"feedback", 0}, {"mix", 50}, {"moddepth", 3.0f}, {"modrate", 0.8f}, {"modphase", 90}}},
+            {"Flanger", {{"time", 2}, {"feedback", 60}, {"mix", 50}, {"moddepth", 1.5f}, {"modrate", 0.2f}, {"modshape", 1}, {"modphase", 180}}},
+        };
+        MckDsp::PresetBankWriter writer;
+        for (const auto &preset : presets)
+        {
+            std::vector<MckDsp::StateValue> values;
+            for (const auto &v : preset.values)
+            {
+                values.push_back({MckDsp::stateId(v.first), v.second});
+            }
+            std::vector<uint8_t> state(MckDsp::stateSize(values.size()));
+            MckDsp::writeState(values.data(), values.size(), 0, state.data());
+            writer.add(preset.name, state.data(), state.size());
+        }
+        return writer.build();
+    }();
+
+    // Read through the same view as a mapped user bank
+    static const MckDsp::PresetBankView bank = []
+    {
+        MckDsp::PresetBankView view;
+        view.open(data.data(), data.size());
+        return view;
+    }();
+    return bank;
+}
+
+juce::File MckDelayAudioProcessor::getUserBankFile()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("MckAudio").getChildFile("MckDelay").getChildFile("UserPresets.mckbank");
+}
+
+void MckDelayAudioProcessor::loadUserBank()
+{
+    m_userBank.close();
+    m_userBankFile.reset();
+
+    const auto file = getUserBankFile();
+    if (!file.existsAsFile())
+    {
+        return;
+    }
+    m_userBankFile = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+    if (m_userBankFile->getData() == nullptr || !m_userBank.open(m_userBankFile->getData(), m_userBankFile->getSize()))
+    {
+        m_userBank.close();
+        m_userBankFile.reset();
+    }
+}
+
+bool MckDelayAudioProcessor::writeUserBank(const MckDsp::PresetBankWriter &writer)
+{
+    const auto data = writer.build();
+
+    // The file is replaced instead of written in place, other instances keep reading their mapping of the old one
+    const auto file = getUserBankFile();
+    file.getParentDirectory().createDirectory();
+    m_userBank.close();
+    m_userBankFile.reset();
+    juce::TemporaryFile temp(file);
+    const bool written = temp.getFile().replaceWithData(data.data(), data.size()) && temp.overwriteTargetFileWithTemporary();
+    loadUserBank();
+    return written;
+}
+
 //==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor *JUCE_CALLTYPE createPluginFilter()
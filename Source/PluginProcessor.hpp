@@ -9,15 +9,29 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <vector>
-#include "DelayModule.hpp"
+#include "FeedbackDelayNetwork.hpp"
+#include "IdleDetector.hpp"
+#include "LongDelay.hpp"
+#include "MultiChannelDelay.hpp"
+#include "MultiTapDelay.hpp"
+#include "LoadProfiler.hpp"
+#include "ParameterSnapshot.hpp"
+#include "PresetBank.hpp"
+#include "Telemetry.hpp"
+#include "Trace.hpp"
+#include "WorkerPool.hpp"
 
 class MckDelayAudioProcessorEditor;
 
 //==============================================================================
 /**
  */
-class MckDelayAudioProcessor : public juce::AudioProcessor
+class MckDelayAudioProcessor : public juce::AudioProcessor,
+                               private juce::AsyncUpdater
 #if JucePlugin_Enable_ARA
     ,
                                public juce::AudioProcessorARAExtension
@@ -37,6 +51,8 @@ public:
 #endif
 
   void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
+  void processBlock(juce::AudioBuffer<double> &, juce::MidiBuffer &) override;
+  bool supportsDoublePrecisionProcessing() const override { return true; };
 
   //==============================================================================
   juce::AudioProcessorEditor *createEditor() override;
@@ -57,15 +73,32 @@ public:
   const juce::String getProgramName(int index) override;
   void changeProgramName(int index, const juce::String &newName) override;
 
+  // Stores the current settings as a new user preset and selects it, from the message thread.
+  // Other instances see the preset once they are created again.
+  bool saveUserPreset(const juce::String &name);
+
   //==============================================================================
   void getStateInformation(juce::MemoryBlock &destData) override;
   void setStateInformation(const void *data, int sizeInBytes) override;
 
   void setEditor(MckDelayAudioProcessorEditor *editor){m_editor = editor; };
 
+  // Largest bus, e.g. 7th order ambisonics
+  static constexpr int maxBusChannels = 64;
+
+  // The audio thread only measures and reports blocks while telemetry is enabled
+  void setTelemetryEnabled(bool enabled) { m_telemetryEnabled.store(enabled, std::memory_order_relaxed); };
+  // Called from the message thread, returns false once the queue is drained
+  bool popTelemetry(MckDsp::TelemetryFrame &frame) { return m_telemetry.pop(frame); };
+
+  // Load of every processed block relative to its real-time budget, readable from any thread
+  MckDsp::LoadProfiler &getLoadProfiler() { return m_loadProfiler; };
+  // Statistics and histogram of the load profiler together with the current audio settings
+  juce::String getLoadProfileJson() const;
+
   void setTime(int t) { *time = t; };
   int getTime() { return *time; };
-  int getMinTime() { return 100; };
+  int getMinTime() { return 1; };
   int getMaxTime() { return 1000; };
 
   void setMix(int m) { *mix = m; };
@@ -74,6 +107,14 @@ public:
   void setFeedback(int f) { *feedback = f; };
   int getFeedback() { return *feedback; };
 
+  // Reads the impulse response of the convolution in the feedback path, from the message thread.
+  // The channels of the file are mixed down and the response follows the sample rate of the engines.
+  bool loadImpulseResponse(const juce::File &file);
+  juce::File getImpulseResponseFile() const;
+
+  // Removes the impulse response, the line then runs without convolution until another one is loaded
+  void clearImpulseResponse();
+
 private:
   //==============================================================================
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MckDelayAudioProcessor)
@@ -87,9 +128,135 @@ private:
   juce::AudioParameterFloat *lpFreq;
   juce::AudioParameterBool *hpActive;
   juce::AudioParameterFloat *hpFreq;
+  juce::AudioParameterChoice *interp;
+  juce::AudioParameterChoice *mode;
+  juce::AudioParameterInt *numTaps;
+  juce::AudioParameterInt *longTime;
+  juce::AudioParameterChoice *longFormat;
+  juce::AudioParameterChoice *fdnLines;
+  juce::AudioParameterChoice *modShape;
+  juce::AudioParameterFloat *modRate;
+  juce::AudioParameterFloat *modDepth;
+  juce::AudioParameterInt *modPhase;
+  juce::AudioParameterBool *convActive;
+  juce::AudioParameterChoice *automation;
+
+  // Parameter controlled by each MIDI CC number, nullptr for unmapped controllers
+  std::array<juce::RangedAudioParameter *, 128> m_controllers{};
+  // Controllers whose value the host has not been told about yet, one bit per CC number
+  std::array<std::atomic<uint64_t>, 2> m_pendingControllers{};
+
+  // Sets the parameter of a mapped controller on the audio thread, the next block reads it
+  void applyController(int number, int value);
+
+  struct TapParameters
+  {
+    juce::AudioParameterInt *time;
+    juce::AudioParameterInt *level;
+    juce::AudioParameterInt *pan;
+    juce::AudioParameterBool *lpActive;
+    juce::AudioParameterFloat *lpFreq;
+    juce::AudioParameterBool *hpActive;
+    juce::AudioParameterFloat *hpFreq;
+  };
+  TapParameters taps[MckDsp::maxDelayTaps];
+
+  MckDsp::ParameterSnapshot m_params;
+
+  // Sets every parameter the state knows, all others return to their defaults
+  void applyState(const MckDsp::StateView &state);
+
+  // Sessions saved before the binary state hold this XML
+  void applyXmlState(const juce::XmlElement &xml);
+
+  // Maps the user bank file, an empty bank if there is none
+  void loadUserBank();
+
+  // Replaces the user bank file with the presets of writer and maps it again
+  bool writeUserBank(const MckDsp::PresetBankWriter &writer);
+
+  // Every user preset, e.g. to add or rename one
+  MckDsp::PresetBankWriter copyUserBank() const;
+
+  static const MckDsp::PresetBankView &getFactoryBank();
+  static juce::File getUserBankFile();
 
-  double m_oldTime { 0.0 };
+  // Parameters in state order with the hashes of their IDs, and the hashes sorted for lookups
+  std::vector<juce::RangedAudioParameter *> m_stateParams;
+  std::vector<uint32_t> m_stateIds;
+  std::vector<std::pair<uint32_t, int>> m_stateLookup;
 
-  std::vector<MckDsp::DelayModule> m_delays;
+  // Programs are the factory presets followed by the presets of the user bank
+  std::unique_ptr<juce::MemoryMappedFile> m_userBankFile;
+  MckDsp::PresetBankView m_userBank;
+  int m_currentProgram{0};
+
+  std::atomic<bool> m_telemetryEnabled{false};
+  MckDsp::SpscQueue<MckDsp::TelemetryFrame, 256> m_telemetry;
+  double m_sampleRate{0};
+  int m_samplesPerBlock{0};
+
+  MckDsp::LoadProfiler m_loadProfiler;
+
+  // The engines are skipped while the selected line holds nothing but silence
+  MckDsp::IdleDetector m_idle;
+
+  // Every group of up to groupChannels channels runs through its own set of engines
+  static constexpr int groupChannels = MckDsp::MultiChannelDelay<float>::maxChannels;
+  static constexpr int maxGroups = (maxBusChannels + groupChannels - 1) / groupChannels;
+  // Fewer groups are processed on the audio thread alone
+  static constexpr int minParallelGroups = 2;
+  static constexpr int maxPoolWorkers = 3;
+
+  template <typename SampleType>
+  struct Engines
+  {
+    MckDsp::MultiChannelDelay<SampleType> delay;
+    MckDsp::MultiTapDelay<SampleType> multiTap;
+    MckDsp::LongDelay<SampleType> longDelay;
+    MckDsp::FeedbackDelayNetwork<SampleType> fdn;
+  };
+
+  template <typename SampleType>
+  void processDelay(juce::AudioBuffer<SampleType> &buffer, const juce::MidiBuffer &midiMessages, std::array<Engines<SampleType>, maxGroups> &engines);
+
+  MckDsp::DelayParameters readParameters() const;
+
+  // Hands the parameters marked dirty to the engines of a group, the delay time ramps over rampLength samples
+  template <typename SampleType>
+  void applyParameters(const MckDsp::DelayParameters &params, unsigned dirty, size_t rampLength, int group, Engines<SampleType> &engines);
+
+  // Prepares the engine of m_engineMode for the used groups of the host's precision and releases
+  // all others, then applies every parameter again. Only while audio is stopped or suspended
+  void prepareEngines();
+
+  // Tells the host about controller changes, switches the engines to a newly selected mode, grows the long delay
+  // line and switches its storage format on the message thread, triggered by the audio thread
+  void handleAsyncUpdate() override;
+
+#if !MCK_DELAY_SHARED_ARENA
+  // Declared before the engines, which hand their buffers back on destruction
+  MckDsp::DelayArena m_arena;
+#endif
+
+  // Only the engines of the used groups matching the host's processing precision hold a delay buffer,
+  // and of those only the engine of m_engineMode, the mode they were prepared for
+  std::atomic<int> m_engineMode{0};
+  std::array<Engines<float>, maxGroups> m_float;
+  std::array<Engines<double>, maxGroups> m_double;
   size_t numChannels { 0 };
+  int m_numGroups{0};
+
+  // Spreads the groups over several threads for large channel counts
+  MckDsp::WorkerPool m_pool;
+
+  // Loaded impulse response at the rate of its file, the state keeps the path after the parameter values
+  juce::CriticalSection m_irLock;
+  juce::File m_irFile;
+  std::vector<float> m_irSamples;
+  double m_irSampleRate{0};
+  std::atomic<double> m_irLengthInMs{0.0};
+
+  // Hands the response to the line of every used group, resampled to the current rate. Not real-time safe
+  void applyImpulseResponse();
 };
@@ -0,0 +1,174 @@
+#include "PresetBank.hpp"
+
+#include <cstring>
+
+namespace MckDsp
+{
+    namespace
+    {
+        inline void put16(uint8_t *p, uint16_t v)
+        {
+            p[0] = static_cast<uint8_t>(v);
+            p[1] = static_cast<uint8_t>(v >> 8);
+        }
+
+        inline void put32(uint8_t *p, uint32_t v)
+        {
+            p[0] = static_cast<uint8_t>(v);
+            p[1] = static_cast<uint8_t>(v >> 8);
+            p[2] = static_cast<uint8_t>(v >> 16);
+            p[3] = static_cast<uint8_t>(v >> 24);
+        }
+
+        inline uint16_t get16(const uint8_t *p)
+        {
+            return static_cast<uint16_t>(p[0] | p[1] << 8);
+        }
+
+        inline uint32_t get32(const uint8_t *p)
+        {
+            return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+                   static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+        }
+    }
+
+    void writeState(const StateValue *values, size_t numValues, int32_t program, void *dst)
+    {
+        uint8_t *p = static_cast<uint8_t *>(dst);
+        put32(p, StateFormat::magic);
+        put16(p + 4, StateFormat::version);
+        put16(p + 6, static_cast<uint16_t>(numValues));
+        put32(p + 8, static_cast<uint32_t>(program));
+        p += StateFormat::headerSize;
+        for (size_t i = 0; i < numValues; i++, p += StateFormat::valueSize)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &values[i].value, sizeof(bits));
+            put32(p, values[i].id);
+            put32(p + 4, bits);
+        }
+    }
+
+    bool StateView::open(const void *data, size_t size)
+    {
+        *this = StateView();
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        if (p == nullptr || size < StateFormat::headerSize || get32(p) != StateFormat::magic)
+        {
+            return false;
+        }
+        // States of a newer version than this reader knows are rejected
+        const int version = get16(p + 4);
+        const size_t numValues = get16(p + 6);
+        if (version < 1 || version > StateFormat::version || size < stateSize(numValues))
+        {
+            return false;
+        }
+        m_data = p;
+        m_numValues = numValues;
+        m_version = version;
+        m_program = static_cast<int32_t>(get32(p + 8));
+        return true;
+    }
+
+    StateValue StateView::getValue(size_t index) const
+    {
+        const uint8_t *p = m_data + StateFormat::headerSize + index * StateFormat::valueSize;
+        StateValue v;
+        v.id = get32(p);
+        const uint32_t bits = get32(p + 4);
+        std::memcpy(&v.value, &bits, sizeof(bits));
+        return v;
+    }
+
+    bool PresetBankView::open(const void *data, size_t size)
+    {
+        close();
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        if (p == nullptr || size < BankFormat::headerSize || get32(p) != BankFormat::magic || get16(p + 4) != BankFormat::version)
+        {
+            return false;
+        }
+        const size_t numPresets = get32(p + 8);
+        if (numPresets > (size - BankFormat::headerSize) / BankFormat::entrySize)
+        {
+            return false;
+        }
+
+        m_data = p;
+        m_numPresets = numPresets;
+        for (size_t i = 0; i < numPresets; i++)
+        {
+            const uint64_t nameEnd = static_cast<uint64_t>(entryField(i, 0)) + entryField(i, 1);
+            const uint64_t stateEnd = static_cast<uint64_t>(entryField(i, 2)) + entryField(i, 3);
+            StateView state;
+            if (nameEnd > size || stateEnd > size || !state.open(p + entryField(i, 2), entryField(i, 3)))
+            {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string_view PresetBankView::getName(size_t index) const
+    {
+        return std::string_view(reinterpret_cast<const char *>(m_data + entryField(index, 0)), entryField(index, 1));
+    }
+
+    StateView PresetBankView::getState(size_t index) const
+    {
+        StateView state;
+        state.open(m_data + entryField(index, 2), entryField(index, 3));
+        return state;
+    }
+
+    uint32_t PresetBankView::entryField(size_t index, int field) const
+    {
+        return get32(m_data + BankFormat::headerSize + index * BankFormat::entrySize + static_cast<size_t>(field) * 4);
+    }
+
+    void PresetBankWriter::add(std::string_view name, const void *state, size_t size)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(state);
+        m_names.emplace_back(name);
+        m_states.emplace_back(p, p + size);
+    }
+
+    std::vector<uint8_t> PresetBankWriter::build() const
+    {
+        const size_t numPresets = m_names.size();
+        size_t size = BankFormat::headerSize + numPresets * BankFormat::entrySize;
+        for (size_t i = 0; i < numPresets; i++)
+        {
+            size += m_names[i].size() + m_states[i].size();
+        }
+
+        std::vector<uint8_t> bank(size);
+        uint8_t *p = bank.data();
+        put32(p, BankFormat::magic);
+        put16(p + 4, BankFormat::version);
+        put16(p + 6, 0);
+        put32(p + 8, static_cast<uint32_t>(numPresets));
+
+        // Names and states follow the index in preset order
+        size_t offset = BankFormat::headerSize + numPresets * BankFormat::entrySize;
+        for (size_t i = 0; i < numPresets; i++)
+        {
+            uint8_t *entry = p + BankFormat::headerSize + i * BankFormat::entrySize;
+            put32(entry, static_cast<uint32_t>(offset));
+            put32(entry + 4, static_cast<uint32_t>(m_names[i].size()));
+            std::memcpy(p + offset, m_names[i].data(), m_names[i].size());
+            offset += m_names[i].size();
+
+            put32(entry + 8, static_cast<uint32_t>(offset));
+            put32(entry + 12, static_cast<uint32_t>(m_states[i].size()));
+            if (!m_states[i].empty())
+            {
+                std::memcpy(p + offset, m_states[i].data(), m_states[i].size());
+            }
+            offset += m_states[i].size();
+        }
+        return bank;
+    }
+}
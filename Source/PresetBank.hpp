@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace MckDsp
+{
+    // Parameter value keyed by a hash of the parameter ID. Values are plain, not normalized,
+    // so a state stays valid when a choice gains entries or a range grows.
+    struct StateValue
+    {
+        uint32_t id{0};
+        float value{0.0f};
+    };
+
+    // FNV-1a hash of a parameter ID
+    constexpr uint32_t stateId(std::string_view paramId)
+    {
+        uint32_t h = 2166136261u;
+        for (char c : paramId)
+        {
+            h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return h;
+    }
+
+    // Compact binary plugin state, little endian:
+    // "MCKS", u16 version, u16 number of values, i32 program, then the values as u32 id and f32 value
+    namespace StateFormat
+    {
+        constexpr uint32_t magic = 0x534b434d;
+        constexpr uint16_t version = 1;
+        constexpr size_t headerSize = 12;
+        constexpr size_t valueSize = 8;
+        constexpr size_t maxValues = 0xffff;
+    }
+
+    inline size_t stateSize(size_t numValues) { return StateFormat::headerSize + numValues * StateFormat::valueSize; }
+
+    // Writes stateSize(numValues) bytes to dst, numValues must not exceed StateFormat::maxValues
+    void writeState(const StateValue *values, size_t numValues, int32_t program, void *dst);
+
+    // Read-only view of a binary state, the data has to outlive the view
+    class StateView
+    {
+    public:
+        // Returns false for anything but a complete binary state, e.g. the XML state of older sessions
+        bool open(const void *data, size_t size);
+
+        bool isValid() const { return m_data != nullptr; };
+        int getVersion() const { return m_version; };
+        int32_t getProgram() const { return m_program; };
+        size_t getNumValues() const { return m_numValues; };
+        StateValue getValue(size_t index) const;
+
+        // The encoded state, e.g. to copy it into another bank
+        const void *getData() const { return m_data; };
+        size_t getSize() const { return m_data != nullptr ? stateSize(m_numValues) : 0; };
+
+    private:
+        const uint8_t *m_data{nullptr};
+        size_t m_numValues{0};
+        int m_version{0};
+        int32_t m_program{0};
+    };
+
+    // Named binary states in one contiguous region, e.g. a memory mapped file, little endian:
+    // "MCKB", u16 version, u16 reserved, u32 number of presets, then one index entry per preset with
+    // u32 name offset, u32 name size, u32 state offset, u32 state size, then the names and states.
+    // Offsets count from the start of the bank. open() checks every entry once, so a lookup is a
+    // single index access without any parsing.
+    namespace BankFormat
+    {
+        constexpr uint32_t magic = 0x424b434d;
+        constexpr uint16_t version = 1;
+        constexpr size_t headerSize = 12;
+        constexpr size_t entrySize = 16;
+    }
+
+    class PresetBankView
+    {
+    public:
+        // Returns false and stays empty if the region is not a complete bank
+        bool open(const void *data, size_t size);
+
+        void close() { *this = PresetBankView(); };
+
+        size_t getNumPresets() const { return m_numPresets; };
+
+        std::string_view getName(size_t index) const;
+
+        StateView getState(size_t index) const;
+
+    private:
+        uint32_t entryField(size_t index, int field) const;
+
+        const uint8_t *m_data{nullptr};
+        size_t m_numPresets{0};
+    };
+
+    // Builds a bank in memory, not meant for the audio thread
+    class PresetBankWriter
+    {
+    public:
+        void add(std::string_view name, const void *state, size_t size);
+
+        void setName(size_t index, std::string_view name) { m_names[index] = name; };
+
+        size_t getNumPresets() const { return m_names.size(); };
+
+        std::vector<uint8_t> build() const;
+
+    private:
+        std::vector<std::string> m_names{};
+        std::vector<std::vector<uint8_t>> m_states{};
+    };
+}
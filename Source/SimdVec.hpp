@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MCKDSP_SIMD_SSE2 1
+#endif
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MCKDSP_SIMD_AVX 1
+#endif
+
+namespace MckDsp
+{
+    // Fixed width pack of N samples that is processed in SIMD lanes.
+    // Wide packs are split into two halves until a width maps onto an SSE/AVX
+    // register via the specializations below, or down to the scalar fallback.
+    // Memory passed to load() and store() must be aligned to N * sizeof(T).
+    template <typename T, int N>
+    struct Vec
+    {
+        static_assert(N > 1 && (N & (N - 1)) == 0, "Vec width must be a power of two");
+
+        Vec<T, N / 2> lo;
+        Vec<T, N / 2> hi;
+
+        static Vec load(const T *ptr) { return {Vec<T, N / 2>::load(ptr), Vec<T, N / 2>::load(ptr + N / 2)}; }
+        static Vec broadcast(T val) { return {Vec<T, N / 2>::broadcast(val), Vec<T, N / 2>::broadcast(val)}; }
+
+        void store(T *ptr) const
+        {
+            lo.store(ptr);
+            hi.store(ptr + N / 2);
+        }
+
+        friend Vec operator+(const Vec &a, const Vec &b) { return {a.lo + b.lo, a.hi + b.hi}; }
+        friend Vec operator-(const Vec &a, const Vec &b) { return {a.lo - b.lo, a.hi - b.hi}; }
+        friend Vec operator*(const Vec &a, const Vec &b) { return {a.lo * b.lo, a.hi * b.hi}; }
+
+        // Unnormalized Walsh-Hadamard transform across the lanes, in natural (Sylvester) order
+        friend Vec hadamard(const Vec &a)
+        {
+            const Vec<T, N / 2> l = hadamard(a.lo);
+            const Vec<T, N / 2> h = hadamard(a.hi);
+            return {l + h, l - h};
+        }
+    };
+
+    // Scalar fallback
+    template <typename T>
+    struct Vec<T, 1>
+    {
+        T v;
+
+        static Vec load(const T *ptr) { return {*ptr}; }
+        static Vec broadcast(T val) { return {val}; }
+        void store(T *ptr) const { *ptr = v; }
+
+        friend Vec operator+(const Vec &a, const Vec &b) { return {a.v + b.v}; }
+        friend Vec operator-(const Vec &a, const Vec &b) { return {a.v - b.v}; }
+        friend Vec operator*(const Vec &a, const Vec &b) { return {a.v * b.v}; }
+        friend Vec hadamard(const Vec &a) { return a; }
+    };
+
+#if MCKDSP_SIMD_SSE2
+    template <>
+    struct Vec<double, 2>
+    {
+        __m128d v;
+
+        static Vec load(const double *ptr) { return {_mm_load_pd(ptr)}; }
+        static Vec broadcast(double val) { return {_mm_set1_pd(val)}; }
+        void store(double *ptr) const { _mm_store_pd(ptr, v); }
+
+        friend Vec operator+(const Vec &a, const Vec &b) { return {_mm_add_pd(a.v, b.v)}; }
+        friend Vec operator-(const Vec &a, const Vec &b) { return {_mm_sub_pd(a.v, b.v)}; }
+        friend Vec operator*(const Vec &a, const Vec &b) { return {_mm_mul_pd(a.v, b.v)}; }
+
+        // The butterflies negate by multiplying with +-1, which keeps the results identical to the generic version
+        friend Vec hadamard(const Vec &a)
+        {
+            return {_mm_add_pd(_mm_mul_pd(a.v, _mm_setr_pd(1.0, -1.0)), _mm_shuffle_pd(a.v, a.v, 1))};
+        }
+    };
+
+    // Stereo float uses the lower half of an SSE register
+    template <>
+    struct Vec<float, 2>
+    {
+        __m128 v;
+
+        static Vec load(const float *ptr) { return {_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(ptr)))}; }
+        static Vec broadcast(float val) { return {_mm_set1_ps(val)}; }
+        void store(float *ptr) const { _mm_storel_epi64(reinterpret_cast<__m128i *>(ptr), _mm_castps_si128(v)); }
+
+        friend Vec operator+(const Vec &a, const Vec &b) { return {_mm_add_ps(a.v, b.v)}; }
+        friend Vec operator-(const Vec &a, const Vec &b) { return {_mm_sub_ps(a.v, b.v)}; }
+        friend Vec operator*(const Vec &a, const Vec &b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+        friend Vec hadamard(const Vec &a)
+        {
+            return {_mm_add_ps(_mm_mul_ps(a.v, _mm_setr_ps(1.0f, -1.0f, 1.0f, -1.0f)), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1)))};
+        }
+    };
+
+    template <>
+    struct Vec<float, 4>
+    {
+        __m128 v;
+
+        static Vec load(const float *ptr) { return {_mm_load_ps(ptr)}; }
+        static Vec broadcast(float val) { return {_mm_set1_ps(val)}; }
+        void store(float *ptr) const { _mm_store_ps(ptr, v); }
+
+        friend Vec operator+(const Vec &a, const Vec &b) { return {_mm_add_ps(a.v, b.v)}; }
+        friend Vec operator-(const Vec &a, const Vec &b) { return {_mm_sub_ps(a.v, b.v)}; }
+        friend Vec operator*(const Vec &a, const Vec &b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+        friend Vec hadamard(const Vec &a)
+        {
+            const __m128 v = _mm_add_ps(_mm_mul_ps(a.v, _mm_setr_ps(1.0f, -1.0f, 1.0f, -1.0f)), _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1)));
+            return {_mm_add_ps(_mm_mul_ps(v, _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f)), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)))};
+        }
+    };
+#endif
+
+#if MCKDSP_SIMD_AVX
+    template <>
+    struct Vec<double, 4>
+    {
+        __m256d v;
+
+        static Vec load(const double *ptr) { return {_mm256_load_pd(ptr)}; }
+        static Vec broadcast(double val) { return {_mm256_set1_pd(val)}; }
+        void store(double *ptr) const { _mm256_store_pd(ptr, v); }
+
+        friend Vec operator+(const Vec &a, const Vec &b) { return {_mm256_add_pd(a.v, b.v)}; }
+        friend Vec operator-(const Vec &a, const Vec &b) { return {_mm256_sub_pd(a.v, b.v)}; }
+        friend Vec operator*(const Vec &a, const Vec &b) { return {_mm256_mul_pd(a.v, b.v)}; }
+
+        friend Vec hadamard(const Vec &a)
+        {
+            const __m256d v = _mm256_add_pd(_mm256_mul_pd(a.v, _mm256_setr_pd(1.0, -1.0, 1.0, -1.0)), _mm256_permute_pd(a.v, 0b0101));
+            return {_mm256_add_pd(_mm256_mul_pd(v, _mm256_setr_pd(1.0, 1.0, -1.0, -1.0)), _mm256_permute2f128_pd(v, v, 1))};
+        }
+    };
+
+    template <>
+    struct Vec<float, 8>
+    {
+        __m256 v;
+
+        static Vec load(const float *ptr) { return {_mm256_load_ps(ptr)}; }
+        static Vec broadcast(float val) { return {_mm256_set1_ps(val)}; }
+        void store(float *ptr) const { _mm256_store_ps(ptr, v); }
+
+        friend Vec operator+(const Vec &a, const Vec &b) { return {_mm256_add_ps(a.v, b.v)}; }
+        friend Vec operator-(const Vec &a, const Vec &b) { return {_mm256_sub_ps(a.v, b.v)}; }
+        friend Vec operator*(const Vec &a, const Vec &b) { return {_mm256_mul_ps(a.v, b.v)}; }
+
+        friend Vec hadamard(const Vec &a)
+        {
+            __m256 v = _mm256_add_ps(_mm256_mul_ps(a.v, _mm256_setr_ps(1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f)), _mm256_permute_ps(a.v, _MM_SHUFFLE(2, 3, 0, 1)));
+            v = _mm256_add_ps(_mm256_mul_ps(v, _mm256_setr_ps(1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, -1.0f)), _mm256_permute_ps(v, _MM_SHUFFLE(1, 0, 3, 2)));
+            return {_mm256_add_ps(_mm256_mul_ps(v, _mm256_setr_ps(1.0f, 1.0f, 1.0f, 1.0f, -1.0f, -1.0f, -1.0f, -1.0f)), _mm256_permute2f128_ps(v, v, 1))};
+        }
+    };
+#endif
+}
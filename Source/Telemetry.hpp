@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace MckDsp
+{
+    // Peak and RMS of one block
+    struct Levels
+    {
+        float peak{0.0f};
+        float rms{0.0f};
+    };
+
+    // What the audio thread reports to the editor once per block
+    struct TelemetryFrame
+    {
+        Levels input{};
+        Levels wet{};
+        // Signal that is written back into the delay line
+        Levels feedback{};
+        float blockTimeInUs{0.0f};
+        // Processing time relative to the duration of the block
+        float blockLoad{0.0f};
+        uint32_t numSamples{0};
+    };
+
+    // Accumulates peak and sum of squares over several spans or channels
+    class LevelAccumulator
+    {
+    public:
+        template <typename SampleType>
+        inline void add(const SampleType *ptr, size_t numSamples, size_t stride = 1)
+        {
+            float peak = m_peak;
+            double sum = 0.0;
+            for (size_t s = 0; s < numSamples * stride; s += stride)
+            {
+                const float x = static_cast<float>(ptr[s]);
+                peak = std::fmax(peak, std::fabs(x));
+                sum += static_cast<double>(x) * x;
+            }
+            m_peak = peak;
+            m_sum += sum;
+            m_count += numSamples;
+        }
+
+        // Adds numFrames frames of one channel from an interleaved ring buffer starting at frame start
+        template <typename SampleType>
+        inline void addRing(const SampleType *ring, unsigned len, unsigned start, size_t numFrames, size_t lanes, size_t channel)
+        {
+            numFrames = numFrames < len ? numFrames : len;
+            start &= len - 1;
+            const size_t first = numFrames < len - start ? numFrames : len - start;
+            add(ring + start * lanes + channel, first, lanes);
+            add(ring + channel, numFrames - first, lanes);
+        }
+
+        // Adds the summary of a span of numSamples samples
+        inline void add(const Levels &levels, size_t numSamples)
+        {
+            m_peak = std::fmax(m_peak, levels.peak);
+            m_sum += static_cast<double>(levels.rms) * levels.rms * static_cast<double>(numSamples);
+            m_count += numSamples;
+        }
+
+        Levels get() const
+        {
+            Levels l;
+            l.peak = m_peak;
+            l.rms = m_count > 0 ? static_cast<float>(std::sqrt(m_sum / static_cast<double>(m_count))) : 0.0f;
+            return l;
+        }
+
+    private:
+        float m_peak{0.0f};
+        double m_sum{0.0};
+        size_t m_count{0};
+    };
+
+    // Wait-free single producer, single consumer queue with a power of two capacity.
+    // push() never blocks or allocates, it drops the element when the queue is full.
+    template <typename T, size_t Capacity>
+    class SpscQueue
+    {
+        static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        bool push(const T &item)
+        {
+            const size_t head = m_head.load(std::memory_order_relaxed);
+            if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+            {
+                return false;
+            }
+            m_items[head & (Capacity - 1)] = item;
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T &item)
+        {
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (m_head.load(std::memory_order_acquire) == tail)
+            {
+                return false;
+            }
+            item = m_items[tail & (Capacity - 1)];
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        // Producer and consumer indices live on their own cache lines
+        alignas(64) std::atomic<size_t> m_head{0};
+        alignas(64) std::atomic<size_t> m_tail{0};
+        alignas(64) std::array<T, Capacity> m_items{};
+    };
+}
@@ -0,0 +1,134 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace MckDsp
+{
+    namespace Trace
+    {
+        namespace
+        {
+            // Buffers are only ever added at the front, so a reader walks a stable list
+            std::atomic<ThreadBuffer *> g_head{nullptr};
+            std::atomic<int> g_numThreads{0};
+
+            void appendEscaped(std::string &json, const char *text)
+            {
+                for (const char *c = text; *c != '\0'; c++)
+                {
+                    if (*c == '"' || *c == '\\')
+                    {
+                        json += '\\';
+                    }
+                    json += *c;
+                }
+            }
+        }
+
+        size_t ThreadBuffer::read(Event *dst) const
+        {
+            const uint64_t end = m_count.load(std::memory_order_acquire);
+            const uint64_t begin = std::max(m_clearedCount.load(std::memory_order_relaxed), end > eventsPerThread ? end - eventsPerThread : 0);
+            for (uint64_t n = begin; n < end; n++)
+            {
+                const Slot &slot = m_slots[n & (eventsPerThread - 1)];
+                Event &e = dst[n - begin];
+                e.name = slot.name.load(std::memory_order_relaxed);
+                e.startInNs = slot.startInNs.load(std::memory_order_relaxed);
+                e.durationInNs = slot.durationInNs.load(std::memory_order_relaxed);
+            }
+
+            // The slot of the event in flight and everything before it may have been overwritten
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t now = m_count.load(std::memory_order_relaxed);
+            const uint64_t firstValid = now + 1 > eventsPerThread ? now + 1 - eventsPerThread : 0;
+            if (firstValid <= begin)
+            {
+                return static_cast<size_t>(end - begin);
+            }
+            if (firstValid >= end)
+            {
+                return 0;
+            }
+            const size_t skip = static_cast<size_t>(firstValid - begin);
+            std::copy(dst + skip, dst + (end - begin), dst);
+            return static_cast<size_t>(end - firstValid);
+        }
+
+        ThreadBuffer &threadBuffer()
+        {
+            thread_local ThreadBuffer *buffer = nullptr;
+            if (buffer == nullptr)
+            {
+                // Never freed, the recorded zones stay exportable after the thread ends
+                buffer = new ThreadBuffer();
+                buffer->m_id = g_numThreads.fetch_add(1, std::memory_order_relaxed) + 1;
+                buffer->m_next = g_head.load(std::memory_order_relaxed);
+                while (!g_head.compare_exchange_weak(buffer->m_next, buffer, std::memory_order_release, std::memory_order_relaxed))
+                {
+                }
+            }
+            return *buffer;
+        }
+
+        std::string toChromeJson()
+        {
+            std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+            bool first = true;
+            auto separate = [&]
+            {
+                if (!first)
+                {
+                    json += ",\n";
+                }
+                first = false;
+            };
+
+            std::vector<Event> events(eventsPerThread);
+            char number[64];
+            for (ThreadBuffer *b = g_head.load(std::memory_order_acquire); b != nullptr; b = b->m_next)
+            {
+                const size_t numEvents = b->read(events.data());
+                const std::string tid = std::to_string(b->getId());
+
+                separate();
+                json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"";
+                if (const char *name = b->getName())
+                {
+                    appendEscaped(json, name);
+                }
+                else
+                {
+                    json += "Thread " + tid;
+                }
+                json += "\"}}";
+
+                // Complete events with microsecond timestamps of the steady clock
+                for (size_t i = 0; i < numEvents; i++)
+                {
+                    const Event &e = events[i];
+                    separate();
+                    json += "{\"name\":\"";
+                    appendEscaped(json, e.name);
+                    std::snprintf(number, sizeof(number), "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,",
+                                  static_cast<double>(e.startInNs) / 1000.0, static_cast<double>(e.durationInNs) / 1000.0);
+                    json += number;
+                    json += "\"pid\":1,\"tid\":" + tid + "}";
+                }
+            }
+            json += "]}\n";
+            return json;
+        }
+
+        void clear()
+        {
+            for (ThreadBuffer *b = g_head.load(std::memory_order_acquire); b != nullptr; b = b->m_next)
+            {
+                b->clear();
+            }
+        }
+    }
+}
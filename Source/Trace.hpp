@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace MckDsp
+{
+    // Scoped timing zones of the hot paths for a Chrome / Perfetto trace. Every thread records
+    // into its own ring buffer without locks or allocations, only its first zone allocates the
+    // buffer. The MCK_TRACE_* macros compile to nothing unless MCK_TRACE is set, see CMakeLists.txt.
+    namespace Trace
+    {
+#if MCK_TRACE
+        constexpr bool enabled = true;
+#else
+        constexpr bool enabled = false;
+#endif
+
+        // Older events are overwritten once a thread recorded this many
+        constexpr size_t eventsPerThread = 1 << 16;
+
+        // Names are string literals, only the pointer is stored
+        struct Event
+        {
+            const char *name{nullptr};
+            uint64_t startInNs{0};
+            uint64_t durationInNs{0};
+        };
+
+        // Monotonic clock of the process, the same one other tools use for their timelines
+        inline uint64_t nowInNs()
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             std::chrono::steady_clock::now().time_since_epoch())
+                                             .count());
+        }
+
+        // Single producer ring of the events of one thread, read by toChromeJson() on any thread
+        class ThreadBuffer
+        {
+        public:
+            inline void push(const char *name, uint64_t startInNs, uint64_t durationInNs)
+            {
+                const uint64_t n = m_count.load(std::memory_order_relaxed);
+                Slot &slot = m_slots[n & (eventsPerThread - 1)];
+                slot.name.store(name, std::memory_order_relaxed);
+                slot.startInNs.store(startInNs, std::memory_order_relaxed);
+                slot.durationInNs.store(durationInNs, std::memory_order_relaxed);
+                m_count.store(n + 1, std::memory_order_release);
+            }
+
+            void setName(const char *name) { m_name.store(name, std::memory_order_relaxed); };
+            const char *getName() const { return m_name.load(std::memory_order_relaxed); };
+
+            int getId() const { return m_id; };
+
+            // Copies the events still in the ring to dst, which holds eventsPerThread events.
+            // Slots the thread overwrites meanwhile are dropped, returns the number copied.
+            size_t read(Event *dst) const;
+
+            // Hides the events recorded so far from read()
+            void clear() { m_clearedCount.store(m_count.load(std::memory_order_acquire), std::memory_order_relaxed); };
+
+        private:
+            friend ThreadBuffer &threadBuffer();
+            friend std::string toChromeJson();
+            friend void clear();
+
+            struct Slot
+            {
+                std::atomic<const char *> name{nullptr};
+                std::atomic<uint64_t> startInNs{0};
+                std::atomic<uint64_t> durationInNs{0};
+            };
+
+            Slot m_slots[eventsPerThread]{};
+            std::atomic<uint64_t> m_count{0};
+            std::atomic<uint64_t> m_clearedCount{0};
+            std::atomic<const char *> m_name{nullptr};
+            int m_id{0};
+            ThreadBuffer *m_next{nullptr};
+        };
+
+        // Buffer of the calling thread, created and registered on first use. Buffers outlive
+        // their threads, so the zones of a stopped worker still show up in the export.
+        ThreadBuffer &threadBuffer();
+
+        // Row label of the calling thread in the trace viewer
+        inline void setThreadName(const char *name) { threadBuffer().setName(name); }
+
+        // Chrome trace event JSON of every recorded zone of every thread, may run while the zones keep recording
+        std::string toChromeJson();
+
+        // Hides everything recorded so far from the next export
+        void clear();
+
+        // Records the time between its construction and destruction
+        class Zone
+        {
+        public:
+            explicit Zone(const char *name) : m_name(name), m_startInNs(nowInNs()) {}
+
+            ~Zone()
+            {
+                const uint64_t end = nowInNs();
+                threadBuffer().push(m_name, m_startInNs, end - m_startInNs);
+            }
+
+            Zone(const Zone &) = delete;
+            Zone &operator=(const Zone &) = delete;
+
+        private:
+            const char *m_name;
+            uint64_t m_startInNs;
+        };
+    }
+}
+
+#define MCK_TRACE_CONCAT_INNER(a, b) a##b
+#define MCK_TRACE_CONCAT(a, b) MCK_TRACE_CONCAT_INNER(a, b)
+
+#if MCK_TRACE
+// Times the rest of the enclosing scope, name has to be a string literal
+#define MCK_TRACE_ZONE(name) const MckDsp::Trace::Zone MCK_TRACE_CONCAT(mckTraceZone, __LINE__)(name)
+#define MCK_TRACE_THREAD(name) MckDsp::Trace::setThreadName(name)
+#else
+#define MCK_TRACE_ZONE(name) static_cast<void>(0)
+#define MCK_TRACE_THREAD(name) static_cast<void>(0)
+#endif
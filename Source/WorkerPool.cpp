@@ -0,0 +1,212 @@
+#include "WorkerPool.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace MckDsp
+{
+    namespace
+    {
+        // Hint to the core that the thread is busy waiting
+        inline void cpuRelax()
+        {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+            _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+            __asm__ __volatile__("yield");
+#endif
+        }
+
+        // Same as juce::ScopedNoDenormals on the audio thread, decaying feedback must not slow down the workers
+        inline void disableDenormals()
+        {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+            _mm_setcsr(_mm_getcsr() | 0x8040);
+#elif defined(__aarch64__)
+            uint64_t fpcr;
+            __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+            __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | (uint64_t(1) << 24)));
+#endif
+        }
+
+        // Asks for the scheduling of an audio thread with the given period, false without the rights to it
+        bool promoteToRealtime(double periodInMs)
+        {
+#if defined(__APPLE__)
+            mach_timebase_info_data_t timebase;
+            mach_timebase_info(&timebase);
+            const double ticksPerMs = 1e6 * static_cast<double>(timebase.denom) / static_cast<double>(timebase.numer);
+            thread_time_constraint_policy_data_t policy;
+            policy.period = static_cast<uint32_t>(periodInMs * ticksPerMs);
+            policy.computation = static_cast<uint32_t>(0.5 * periodInMs * ticksPerMs);
+            policy.constraint = policy.period;
+            policy.preemptible = 1;
+            return thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+                                     reinterpret_cast<thread_policy_t>(&policy), THREAD_TIME_CONSTRAINT_POLICY_COUNT) == KERN_SUCCESS;
+#elif defined(_WIN32)
+            (void)periodInMs;
+            return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#elif defined(__unix__)
+            // Halfway up the FIFO range, which is where audio servers usually put their clients
+            (void)periodInMs;
+            sched_param param{};
+            param.sched_priority = (sched_get_priority_min(SCHED_FIFO) + sched_get_priority_max(SCHED_FIFO)) / 2;
+            return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+            (void)periodInMs;
+            return false;
+#endif
+        }
+
+        // Workers start spinning this long before the next job is due
+        constexpr auto spinTime = std::chrono::microseconds(200);
+        // and give up at most this long after it, a job that comes later is joined after the next nap
+        constexpr auto lateSpinTime = std::chrono::milliseconds(1);
+        // Longest nap between two looks at the job, also bounds how long stop() waits
+        constexpr auto sleepTime = std::chrono::milliseconds(2);
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        stop();
+    }
+
+    void WorkerPool::start(int numWorkers, double periodInMs)
+    {
+        stop();
+        numWorkers = std::max(0, std::min(maxWorkers, numWorkers));
+        m_quit.store(false, std::memory_order_relaxed);
+        m_numStarted.store(0, std::memory_order_relaxed);
+        m_numRealtime.store(0, std::memory_order_relaxed);
+        m_threads.reserve(static_cast<size_t>(numWorkers));
+        for (int w = 0; w < numWorkers; w++)
+        {
+            m_threads.emplace_back([this, periodInMs]
+                                   { workerLoop(periodInMs); });
+        }
+
+        // The caller decides by getNumRealtimeWorkers() whether to use the pool at all
+        while (periodInMs > 0.0 && m_numStarted.load(std::memory_order_acquire) < numWorkers)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void WorkerPool::stop()
+    {
+        m_quit.store(true, std::memory_order_relaxed);
+        for (auto &t : m_threads)
+        {
+            t.join();
+        }
+        m_threads.clear();
+    }
+
+    void WorkerPool::runTasks(size_t numTasks, TaskFn fn, void *ctx)
+    {
+        if (m_threads.empty() || numTasks < 2 || numTasks > maxTasks)
+        {
+            for (size_t i = 0; i < numTasks; i++)
+            {
+                fn(ctx, i);
+            }
+            return;
+        }
+
+        m_fn = fn;
+        m_ctx = ctx;
+        m_done.store(0, std::memory_order_relaxed);
+
+        const uint32_t job = jobOf(m_claim.load(std::memory_order_relaxed)) + 1;
+        m_claim.store(static_cast<uint64_t>(job) << 32 | static_cast<uint64_t>(numTasks) << 16, std::memory_order_release);
+
+        work(job);
+
+        // Tasks claimed by a worker are still running, as long as the worker runs at real-time priority
+        // this takes no longer than one task
+        while (m_done.load(std::memory_order_acquire) < numTasks)
+        {
+            cpuRelax();
+        }
+    }
+
+    void WorkerPool::work(uint32_t job)
+    {
+        for (;;)
+        {
+            uint64_t claim = m_claim.load(std::memory_order_acquire);
+            do
+            {
+                if (jobOf(claim) != job || indexOf(claim) >= countOf(claim))
+                {
+                    return;
+                }
+            } while (!m_claim.compare_exchange_weak(claim, claim + 1, std::memory_order_acq_rel, std::memory_order_acquire));
+
+            m_fn(m_ctx, indexOf(claim));
+            m_done.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    void WorkerPool::workerLoop(double periodInMs)
+    {
+        disableDenormals();
+        if (periodInMs > 0.0 && promoteToRealtime(periodInMs))
+        {
+            m_numRealtime.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_numStarted.fetch_add(1, std::memory_order_release);
+        MCK_TRACE_THREAD("Worker");
+
+        using Clock = std::chrono::steady_clock;
+        uint32_t seen = jobOf(m_claim.load(std::memory_order_acquire));
+        auto lastJob = Clock::now();
+        Clock::duration interval{0};
+
+        while (!m_quit.load(std::memory_order_relaxed))
+        {
+            const uint32_t job = jobOf(m_claim.load(std::memory_order_acquire));
+            const auto now = Clock::now();
+            if (job != seen)
+            {
+                seen = job;
+                interval = now - lastJob;
+                lastJob = now;
+                work(job);
+                continue;
+            }
+
+            // Sleeps until shortly before the next job is due and spins until a little after it
+            const auto due = lastJob + interval;
+            if (now < due - spinTime)
+            {
+                std::this_thread::sleep_for(std::min<Clock::duration>(due - spinTime - now, sleepTime));
+            }
+            else if (now < due + std::min<Clock::duration>(interval / 2, lateSpinTime))
+            {
+                cpuRelax();
+            }
+            else
+            {
+                std::this_thread::sleep_for(sleepTime);
+            }
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace MckDsp
+{
+    // Small pool of threads that helps the audio thread with independent tasks.
+    // run() neither allocates, locks nor makes system calls. Nobody wakes the workers, they sleep until
+    // shortly before the next job is due, judged by the interval of the previous ones, and spin from there.
+    // A worker that is late to wake up costs parallelism only, the calling thread works on the tasks as
+    // well. It does wait for the tasks a worker already claimed though, so only workers that run at
+    // real-time priority keep that wait bounded, see getNumRealtimeWorkers().
+    class WorkerPool
+    {
+    public:
+        static constexpr int maxWorkers = 8;
+        static constexpr size_t maxTasks = 0xffff;
+
+        WorkerPool() = default;
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        // Starts numWorkers threads, not from the audio thread. With a period, the time between two
+        // calls of run(), the workers ask for real-time scheduling and start() waits for the answer.
+        void start(int numWorkers, double periodInMs = 0.0);
+
+        // Joins all threads, not from the audio thread
+        void stop();
+
+        int getNumWorkers() const { return static_cast<int>(m_threads.size()); };
+
+        // Workers the system granted real-time scheduling, lacking the rights they keep their priority
+        int getNumRealtimeWorkers() const { return m_numRealtime.load(std::memory_order_acquire); };
+
+        // Calls task(index) for every index below numTasks, spread over the caller and the workers.
+        // Only one thread may call run() at a time.
+        template <typename Task>
+        void run(size_t numTasks, Task &task)
+        {
+            runTasks(numTasks, [](void *ctx, size_t index)
+                     { (*static_cast<Task *>(ctx))(index); },
+                     &task);
+        }
+
+    private:
+        using TaskFn = void (*)(void *, size_t);
+
+        void runTasks(size_t numTasks, TaskFn fn, void *ctx);
+
+        void workerLoop(double periodInMs);
+
+        // Claims and runs tasks of the given job until none are left
+        void work(uint32_t job);
+
+        // Every claim carries the job in the upper 32 bits, the number of tasks and the next task
+        // index in the lower ones, so a worker can never take a task of a later job
+        static uint32_t jobOf(uint64_t claim) { return static_cast<uint32_t>(claim >> 32); };
+        static size_t countOf(uint64_t claim) { return static_cast<size_t>((claim >> 16) & maxTasks); };
+        static size_t indexOf(uint64_t claim) { return static_cast<size_t>(claim & maxTasks); };
+
+        std::vector<std::thread> m_threads{};
+        std::atomic<bool> m_quit{false};
+
+        std::atomic<uint64_t> m_claim{0};
+        std::atomic<size_t> m_done{0};
+        // Published together with the job through m_claim
+        TaskFn m_fn{nullptr};
+        void *m_ctx{nullptr};
+
+        // Workers that asked for real-time scheduling so far, and how many of them got it
+        std::atomic<int> m_numStarted{0};
+        std::atomic<int> m_numRealtime{0};
+    };
+}
@@ -0,0 +1,1667 @@
+#include "DelayModule.hpp"
+#include "FeedbackDelayNetwork.hpp"
+#include "FilterChain.hpp"
+#include "Lfo.hpp"
+#include "LongDelay.hpp"
+#include "MultiChannelDelay.hpp"
+#include "MultiTapDelay.hpp"
+#include "OnePoleFilter.hpp"
+#include "PresetBank.hpp"
+#include "SimdVec.hpp"
+#include "Trace.hpp"
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Golden reference tests: every optimized kernel has to reproduce the scalar
+// per sample path it replaces. DelayModule::processSample and OnePoleFilter::processSample
+// are the references, everything else is compared against them sample by sample.
+namespace
+{
+    struct Options
+    {
+        // Allowed error in units in the last place of the reference sample
+        double floatUlps{4.0};
+        double doubleUlps{0.0};
+        // Below this magnitude errors are measured in ULPs of the floor instead, so tiny
+        // reference values near silence do not blow up the relative error
+        double ulpFloor{1.0 / (1 << 20)};
+        size_t numSamples{24000};
+        bool verbose{false};
+    };
+
+    Options opt;
+
+    constexpr double sampleRate = 48000.0;
+
+    enum class Signal
+    {
+        Impulse,
+        Sweep,
+        Noise,
+        Step,
+        Count
+    };
+
+    const char *signalName(Signal s)
+    {
+        switch (s)
+        {
+        case Signal::Impulse:
+            return "impulse";
+        case Signal::Sweep:
+            return "sweep";
+        case Signal::Noise:
+            return "noise";
+        default:
+            return "step";
+        }
+    }
+
+    const char *interpolationName(MckDsp::Interpolation mode)
+    {
+        switch (mode)
+        {
+        case MckDsp::Interpolation::Linear:
+            return "linear";
+        case MckDsp::Interpolation::Lagrange:
+            return "lagrange";
+        case MckDsp::Interpolation::Hermite:
+            return "hermite";
+        case MckDsp::Interpolation::Allpass:
+            return "allpass";
+        default:
+            return "none";
+        }
+    }
+
+    const char *stagesName(MckDsp::FilterStages stages)
+    {
+        switch (stages)
+        {
+        case MckDsp::FilterStages::HighPass:
+            return "hp";
+        case MckDsp::FilterStages::LowPass:
+            return "lp";
+        case MckDsp::FilterStages::Both:
+            return "hp+lp";
+        default:
+            return "nofilter";
+        }
+    }
+
+    const char *shapeName(MckDsp::LfoShape shape)
+    {
+        switch (shape)
+        {
+        case MckDsp::LfoShape::Triangle:
+            return "triangle";
+        case MckDsp::LfoShape::Random:
+            return "random";
+        default:
+            return "sine";
+        }
+    }
+
+    template <typename SampleType>
+    const char *typeName()
+    {
+        return sizeof(SampleType) == sizeof(float) ? "float" : "double";
+    }
+
+    // Deterministic test signals, seed only matters for noise and the impulse positions
+    template <typename SampleType>
+    std::vector<SampleType> makeSignal(Signal s, size_t n, uint32_t seed)
+    {
+        std::vector<SampleType> x(n, SampleType(0));
+        uint32_t state = 0x9e3779b9u ^ (seed * 0x85ebca6bu);
+        auto next = [&state]
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state;
+        };
+        switch (s)
+        {
+        case Signal::Impulse:
+            for (size_t i = seed % 97; i < n; i += 4801)
+            {
+                x[i] = SampleType(1);
+            }
+            break;
+        case Signal::Sweep:
+        {
+            // Logarithmic sweep from 20 Hz to 20 kHz
+            const double f0 = 20.0, f1 = 20000.0, len = static_cast<double>(n) / sampleRate;
+            const double k = std::log(f1 / f0);
+            for (size_t i = 0; i < n; i++)
+            {
+                const double t = static_cast<double>(i) / sampleRate;
+                x[i] = static_cast<SampleType>(0.5 * std::sin(2.0 * M_PI * f0 * len / k * (std::exp(t / len * k) - 1.0)));
+            }
+            break;
+        }
+        case Signal::Noise:
+            for (auto &v : x)
+            {
+                v = static_cast<SampleType>(static_cast<double>(next()) / 4294967296.0 - 0.5);
+            }
+            break;
+        default:
+            std::fill(x.begin() + static_cast<std::ptrdiff_t>(n / 4), x.end(), SampleType(0.25));
+            break;
+        }
+        return x;
+    }
+
+    // Irregular block sizes, the same for the reference and the optimized path
+    std::vector<size_t> makeBlocks(size_t n, uint32_t seed)
+    {
+        std::vector<size_t> blocks;
+        uint32_t state = seed * 1664525u + 1013904223u;
+        for (size_t pos = 0; pos < n;)
+        {
+            state = state * 1664525u + 1013904223u;
+            const size_t len = std::min<size_t>(1 + (state >> 8) % 700, n - pos);
+            blocks.push_back(len);
+            pos += len;
+        }
+        return blocks;
+    }
+
+    // Settings applied at the start of a block
+    struct Settings
+    {
+        double timeInMs{3.0123};
+        double feedback{0.7};
+        double mix{0.5};
+    };
+
+    // With ramps enabled the delay time, feedback and mix jump every few blocks
+    Settings settingsForBlock(size_t block, bool ramp)
+    {
+        Settings s;
+        if (ramp)
+        {
+            const size_t step = block / 5;
+            s.timeInMs = 2.5 + 0.731 * static_cast<double>(step % 23);
+            s.feedback = 0.2 + 0.05 * static_cast<double>(step % 15);
+            s.mix = 0.1 * static_cast<double>(step % 11);
+        }
+        return s;
+    }
+
+    // Delay time modulation, off while the depth is zero
+    struct Modulation
+    {
+        MckDsp::LfoShape shape{MckDsp::LfoShape::Sine};
+        double rateInHz{0.0};
+        double depthInMs{0.0};
+        // Between adjacent channels, in cycles
+        double phaseOffset{0.0};
+    };
+
+    std::string modulationName(const Modulation &mod)
+    {
+        return mod.depthInMs > 0.0 ? std::string(" mod ") + shapeName(mod.shape) : std::string();
+    }
+
+    // Largest error of one comparison and where it happened
+    struct Result
+    {
+        double maxAbs{0.0};
+        double maxUlps{0.0};
+        int channel{0};
+        size_t sample{0};
+        bool finite{true};
+    };
+
+    template <typename SampleType>
+    double ulpsBetween(SampleType ref, SampleType got)
+    {
+        if (ref == got)
+        {
+            return 0.0;
+        }
+        const SampleType scale = std::max(std::fabs(ref), static_cast<SampleType>(opt.ulpFloor));
+        const SampleType ulp = std::nextafter(scale, std::numeric_limits<SampleType>::infinity()) - scale;
+        return static_cast<double>(std::fabs(ref - got)) / static_cast<double>(ulp);
+    }
+
+    template <typename SampleType>
+    void compare(const std::vector<SampleType> &ref, const std::vector<SampleType> &got, int channel, Result &r)
+    {
+        for (size_t i = 0; i < ref.size(); i++)
+        {
+            if (!std::isfinite(got[i]))
+            {
+                r.finite = false;
+            }
+            const double ulps = ulpsBetween(ref[i], got[i]);
+            if (ulps > r.maxUlps || !std::isfinite(got[i]))
+            {
+                r.maxUlps = std::isfinite(got[i]) ? ulps : std::numeric_limits<double>::infinity();
+                r.maxAbs = std::fabs(static_cast<double>(ref[i]) - static_cast<double>(got[i]));
+                r.channel = channel;
+                r.sample = i;
+            }
+        }
+    }
+
+    int numCases = 0;
+    int numFailed = 0;
+
+    template <typename SampleType>
+    void report(const std::string &name, const Result &r)
+    {
+        const double limit = sizeof(SampleType) == sizeof(float) ? opt.floatUlps : opt.doubleUlps;
+        const bool ok = r.finite && r.maxUlps <= limit;
+        numCases++;
+        if (!ok)
+        {
+            numFailed++;
+        }
+        if (!ok || opt.verbose)
+        {
+            std::printf("%-4s %-64s max %.3g (%.2f ulp) at ch %d sample %zu\n",
+                        ok ? "ok" : "FAIL", name.c_str(), r.maxAbs, r.maxUlps, r.channel, r.sample);
+        }
+    }
+
+    template <typename SampleType>
+    void configure(MckDsp::DelayModule<SampleType> &d, MckDsp::Interpolation mode, MckDsp::FilterStages stages)
+    {
+        d.prepareToPlay(sampleRate, 700);
+        d.setInterpolation(mode);
+        d.setHighPass(stages == MckDsp::FilterStages::HighPass || stages == MckDsp::FilterStages::Both, 120.0);
+        d.setLowPass(stages == MckDsp::FilterStages::LowPass || stages == MckDsp::FilterStages::Both, 3000.0);
+    }
+
+    template <typename SampleType>
+    void apply(MckDsp::DelayModule<SampleType> &d, const Settings &s)
+    {
+        d.setDelayInMs(s.timeInMs);
+        d.setFeedback(s.feedback);
+        d.setMix(s.mix);
+    }
+
+    // Reference: DelayModule::processSample, settings change at the same block boundaries.
+    // Under modulation the line runs channel * phaseOffset cycles ahead in the LFO.
+    template <typename SampleType>
+    std::vector<SampleType> renderReference(const std::vector<SampleType> &in, const std::vector<size_t> &blocks,
+                                            MckDsp::Interpolation mode, MckDsp::FilterStages stages, bool ramp,
+                                            const Modulation &mod = {}, int channel = 0)
+    {
+        MckDsp::DelayModule<SampleType> d;
+        configure(d, mode, stages);
+        d.setModulation(mod.shape, mod.rateInHz, mod.depthInMs, static_cast<double>(channel) * mod.phaseOffset);
+        std::vector<SampleType> out(in.size());
+        size_t pos = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            apply(d, settingsForBlock(b, ramp));
+            for (size_t i = pos; i < pos + blocks[b]; i++)
+            {
+                out[i] = d.processSample(in[i]);
+            }
+            pos += blocks[b];
+        }
+        return out;
+    }
+
+    template <typename SampleType>
+    void testDelayModuleBlock(MckDsp::Interpolation mode, MckDsp::FilterStages stages, Signal s, bool ramp)
+    {
+        const auto in = makeSignal<SampleType>(s, opt.numSamples, 1);
+        const auto blocks = makeBlocks(opt.numSamples, 1);
+        const auto ref = renderReference(in, blocks, mode, stages, ramp);
+
+        MckDsp::DelayModule<SampleType> d;
+        configure(d, mode, stages);
+        std::vector<SampleType> out(in.size());
+        size_t pos = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            apply(d, settingsForBlock(b, ramp));
+            d.processBlock(in.data() + pos, out.data() + pos, blocks[b]);
+            pos += blocks[b];
+        }
+
+        Result r;
+        compare(ref, out, 0, r);
+        report<SampleType>(std::string("DelayModule::processBlock ") + typeName<SampleType>() + " " + interpolationName(mode) + " " +
+                               stagesName(stages) + " " + signalName(s) + (ramp ? " ramp" : ""),
+                           r);
+    }
+
+    template <typename SampleType>
+    void testMultiChannelDelay(int numChannels, MckDsp::Interpolation mode, MckDsp::FilterStages stages, Signal s, bool ramp,
+                               const Modulation &mod = {})
+    {
+        const auto blocks = makeBlocks(opt.numSamples, 2);
+        std::vector<std::vector<SampleType>> in, ref, out;
+        for (int c = 0; c < numChannels; c++)
+        {
+            // Every channel gets a different signal, so lane mixups show up
+            const auto sig = static_cast<Signal>((static_cast<int>(s) + c) % static_cast<int>(Signal::Count));
+            in.push_back(makeSignal<SampleType>(sig, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            ref.push_back(renderReference(in.back(), blocks, mode, stages, ramp, mod, c));
+            out.push_back(std::vector<SampleType>(opt.numSamples));
+        }
+
+        MckDsp::MultiChannelDelay<SampleType> d;
+        d.prepareToPlay(sampleRate, 700, numChannels);
+        d.setModulation(mod.shape, mod.rateInHz, mod.depthInMs, 0.0, mod.phaseOffset);
+        d.setInterpolation(mode);
+        d.setHighPass(stages == MckDsp::FilterStages::HighPass || stages == MckDsp::FilterStages::Both, 120.0);
+        d.setLowPass(stages == MckDsp::FilterStages::LowPass || stages == MckDsp::FilterStages::Both, 3000.0);
+        size_t pos = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const Settings set = settingsForBlock(b, ramp);
+            d.setDelayInMs(set.timeInMs, 0);
+            d.setFeedback(set.feedback);
+            d.setMix(set.mix);
+            const SampleType *readPtrs[MckDsp::MultiChannelDelay<SampleType>::maxChannels];
+            SampleType *writePtrs[MckDsp::MultiChannelDelay<SampleType>::maxChannels];
+            for (int c = 0; c < numChannels; c++)
+            {
+                readPtrs[c] = in[c].data() + pos;
+                writePtrs[c] = out[c].data() + pos;
+            }
+            d.processBlock(readPtrs, writePtrs, blocks[b]);
+            pos += blocks[b];
+        }
+
+        Result r;
+        for (int c = 0; c < numChannels; c++)
+        {
+            compare(ref[c], out[c], c, r);
+        }
+        report<SampleType>(std::string("MultiChannelDelay ") + std::to_string(numChannels) + "ch " + typeName<SampleType>() + " " +
+                               interpolationName(mode) + " " + stagesName(stages) + " " + signalName(s) + (ramp ? " ramp" : "") +
+                               modulationName(mod),
+                           r);
+    }
+
+    // The FFTs of the convolution round differently from the direct paths, so convolved
+    // output is held to an absolute error instead of ULPs
+    template <typename SampleType>
+    void compareWithin(const std::vector<SampleType> &ref, const std::vector<SampleType> &got, int channel, double maxError, Result &r)
+    {
+        for (size_t i = 0; i < ref.size(); i++)
+        {
+            const double err = std::fabs(static_cast<double>(ref[i]) - static_cast<double>(got[i]));
+            if (!(err <= maxError))
+            {
+                r.finite = false;
+            }
+            if (err > r.maxAbs || !std::isfinite(err))
+            {
+                r.maxAbs = err;
+                r.channel = channel;
+                r.sample = i;
+            }
+        }
+    }
+
+    template <typename SampleType>
+    double convolutionTolerance()
+    {
+        return std::is_same_v<SampleType, float> ? 1e-4 : 1e-10;
+    }
+
+    // A single unit impulse as response has to leave the delay as it is, which checks
+    // that the latency of the convolution is made up for exactly in every mode
+    template <typename SampleType>
+    void testConvolvedDelay(int numChannels, MckDsp::Interpolation mode, MckDsp::FilterStages stages, Signal s, bool ramp)
+    {
+        const auto blocks = makeBlocks(opt.numSamples, 4);
+        std::vector<std::vector<SampleType>> in, ref, out;
+        for (int c = 0; c < numChannels; c++)
+        {
+            const auto sig = static_cast<Signal>((static_cast<int>(s) + c) % static_cast<int>(Signal::Count));
+            in.push_back(makeSignal<SampleType>(sig, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            ref.push_back(renderReference(in.back(), blocks, mode, stages, ramp));
+            out.push_back(std::vector<SampleType>(opt.numSamples));
+        }
+
+        const float dirac = 1.0f;
+        MckDsp::MultiChannelDelay<SampleType> d;
+        d.prepareToPlay(sampleRate, 700, numChannels);
+        d.setImpulseResponse(&dirac, 1);
+        d.setConvolution(true);
+        d.setInterpolation(mode);
+        d.setHighPass(stages == MckDsp::FilterStages::HighPass || stages == MckDsp::FilterStages::Both, 120.0);
+        d.setLowPass(stages == MckDsp::FilterStages::LowPass || stages == MckDsp::FilterStages::Both, 3000.0);
+        size_t pos = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const Settings set = settingsForBlock(b, ramp);
+            d.setDelayInMs(set.timeInMs, 0);
+            d.setFeedback(set.feedback);
+            d.setMix(set.mix);
+            const SampleType *readPtrs[MckDsp::MultiChannelDelay<SampleType>::maxChannels];
+            SampleType *writePtrs[MckDsp::MultiChannelDelay<SampleType>::maxChannels];
+            for (int c = 0; c < numChannels; c++)
+            {
+                readPtrs[c] = in[c].data() + pos;
+                writePtrs[c] = out[c].data() + pos;
+            }
+            d.processBlock(readPtrs, writePtrs, blocks[b]);
+            pos += blocks[b];
+        }
+
+        Result r;
+        for (int c = 0; c < numChannels; c++)
+        {
+            compareWithin(ref[c], out[c], c, convolutionTolerance<SampleType>(), r);
+        }
+        report<SampleType>(std::string("MultiChannelDelay convolved ") + std::to_string(numChannels) + "ch " + typeName<SampleType>() + " " +
+                               interpolationName(mode) + " " + stagesName(stages) + " " + signalName(s) + (ramp ? " ramp" : ""),
+                           r);
+    }
+
+    // A response of many partitions against the direct sum of the convolution in the feedback path
+    template <typename SampleType>
+    void testConvolution(int numChannels, size_t irLength, Signal s)
+    {
+        constexpr size_t latency = MckDsp::MultiChannelDelay<SampleType>::convolutionLatency;
+        const size_t delay = 480;
+        const double feedback = 0.6;
+        const double mix = 0.5;
+
+        // Decaying noise like a small room, scaled to a gain of at most one so the loop stays stable
+        std::vector<double> decay(irLength);
+        double sum = 0.0;
+        uint32_t state = 12345u;
+        for (size_t i = 0; i < irLength; i++)
+        {
+            state = state * 1664525u + 1013904223u;
+            const double noise = static_cast<double>(state >> 8) / 8388608.0 - 1.0;
+            decay[i] = noise * std::exp(-4.0 * static_cast<double>(i) / static_cast<double>(irLength));
+            sum += std::fabs(decay[i]);
+        }
+        std::vector<float> ir(irLength);
+        for (size_t i = 0; i < irLength; i++)
+        {
+            ir[i] = static_cast<float>(decay[i] / sum);
+        }
+
+        const auto blocks = makeBlocks(opt.numSamples, 5);
+        std::vector<std::vector<SampleType>> in, ref, out;
+        for (int c = 0; c < numChannels; c++)
+        {
+            const auto sig = static_cast<Signal>((static_cast<int>(s) + c) % static_cast<int>(Signal::Count));
+            in.push_back(makeSignal<SampleType>(sig, opt.numSamples, static_cast<uint32_t>(c + 1)));
+
+            // The line holds the response applied to what was fed back one partition earlier
+            std::vector<double> fed(opt.numSamples, 0.0), line(opt.numSamples, 0.0);
+            std::vector<SampleType> r(opt.numSamples);
+            for (size_t n = 0; n < opt.numSamples; n++)
+            {
+                const double x = static_cast<double>(in.back()[n]);
+                const double dly = n >= delay - latency ? line[n - (delay - latency)] : 0.0;
+                fed[n] = feedback * dly + x;
+                double acc = 0.0;
+                for (size_t m = 0; m < irLength && m + latency <= n; m++)
+                {
+                    acc += static_cast<double>(ir[m]) * fed[n - latency - m];
+                }
+                line[n] = acc;
+                r[n] = static_cast<SampleType>(mix * dly + (1.0 - mix) * x);
+            }
+            ref.push_back(r);
+            out.push_back(std::vector<SampleType>(opt.numSamples));
+        }
+
+        MckDsp::MultiChannelDelay<SampleType> d;
+        d.prepareToPlay(sampleRate, 700, numChannels);
+        d.setImpulseResponse(ir.data(), ir.size());
+        d.setConvolution(true);
+        d.setDelayInMs(static_cast<double>(delay) / sampleRate * 1000.0, 0);
+        d.setFeedback(feedback);
+        d.setMix(mix);
+        size_t pos = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const SampleType *readPtrs[MckDsp::MultiChannelDelay<SampleType>::maxChannels];
+            SampleType *writePtrs[MckDsp::MultiChannelDelay<SampleType>::maxChannels];
+            for (int c = 0; c < numChannels; c++)
+            {
+                readPtrs[c] = in[c].data() + pos;
+                writePtrs[c] = out[c].data() + pos;
+            }
+            d.processBlock(readPtrs, writePtrs, blocks[b]);
+            pos += blocks[b];
+        }
+
+        Result r;
+        for (int c = 0; c < numChannels; c++)
+        {
+            compareWithin(ref[c], out[c], c, convolutionTolerance<SampleType>(), r);
+        }
+        report<SampleType>(std::string("MultiChannelDelay convolution ") + std::to_string(irLength) + "taps " + std::to_string(numChannels) + "ch " +
+                               typeName<SampleType>() + " " + signalName(s),
+                           r);
+    }
+
+    // Channels split into groups of MultiChannelDelay::maxChannels that run on a worker pool,
+    // as the plugin does for large buses. Every channel still has to match its own reference.
+    template <typename SampleType>
+    void testGroupedDelay(MckDsp::WorkerPool &pool, int numChannels, MckDsp::Interpolation mode, MckDsp::FilterStages stages, Signal s, bool ramp)
+    {
+        constexpr int groupChannels = MckDsp::MultiChannelDelay<SampleType>::maxChannels;
+        const int numGroups = (numChannels + groupChannels - 1) / groupChannels;
+
+        const auto blocks = makeBlocks(opt.numSamples, 3);
+        std::vector<std::vector<SampleType>> ref, out;
+        for (int c = 0; c < numChannels; c++)
+        {
+            const auto sig = static_cast<Signal>((static_cast<int>(s) + c) % static_cast<int>(Signal::Count));
+            out.push_back(makeSignal<SampleType>(sig, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            ref.push_back(renderReference(out.back(), blocks, mode, stages, ramp));
+        }
+
+        std::vector<MckDsp::MultiChannelDelay<SampleType>> groups(static_cast<size_t>(numGroups));
+        for (int g = 0; g < numGroups; g++)
+        {
+            auto &d = groups[g];
+            d.prepareToPlay(sampleRate, 700, std::min(groupChannels, numChannels - g * groupChannels));
+            d.setInterpolation(mode);
+            d.setHighPass(stages == MckDsp::FilterStages::HighPass || stages == MckDsp::FilterStages::Both, 120.0);
+            d.setLowPass(stages == MckDsp::FilterStages::LowPass || stages == MckDsp::FilterStages::Both, 3000.0);
+        }
+
+        std::vector<SampleType *> ptrs(static_cast<size_t>(numGroups * groupChannels));
+        size_t pos = 0;
+        size_t len = 0;
+        auto task = [&](size_t g)
+        {
+            groups[g].processBlock(ptrs.data() + g * groupChannels, ptrs.data() + g * groupChannels, len);
+        };
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const Settings set = settingsForBlock(b, ramp);
+            for (auto &d : groups)
+            {
+                d.setDelayInMs(set.timeInMs, 0);
+                d.setFeedback(set.feedback);
+                d.setMix(set.mix);
+            }
+            for (int c = 0; c < numChannels; c++)
+            {
+                ptrs[c] = out[c].data() + pos;
+            }
+            len = blocks[b];
+            pool.run(static_cast<size_t>(numGroups), task);
+            pos += blocks[b];
+        }
+
+        Result r;
+        for (int c = 0; c < numChannels; c++)
+        {
+            compare(ref[c], out[c], c, r);
+        }
+        report<SampleType>(std::string("MultiChannelDelay pooled ") + std::to_string(numChannels) + "ch " + typeName<SampleType>() + " " +
+                               interpolationName(mode) + " " + stagesName(stages) + " " + signalName(s) + (ramp ? " ramp" : ""),
+                           r);
+    }
+
+    // A single centred tap at full level is the same delay as a DelayModule. Only without filters
+    // though, the taps filter their output while DelayModule filters what it writes into the line,
+    // which is the same response but neither rounds nor reacts to time changes the same way.
+    template <typename SampleType>
+    void testMultiTapDelay(int numChannels, MckDsp::Interpolation mode, Signal s, bool ramp)
+    {
+        const auto blocks = makeBlocks(opt.numSamples, 3);
+        std::vector<std::vector<SampleType>> in, ref, out;
+        for (int c = 0; c < numChannels; c++)
+        {
+            const auto sig = static_cast<Signal>((static_cast<int>(s) + c) % static_cast<int>(Signal::Count));
+            in.push_back(makeSignal<SampleType>(sig, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            ref.push_back(renderReference(in.back(), blocks, mode, MckDsp::FilterStages::None, ramp));
+            out.push_back(std::vector<SampleType>(opt.numSamples));
+        }
+
+        MckDsp::MultiTapDelay<SampleType> d;
+        d.prepareToPlay(sampleRate, 700, numChannels);
+        d.setInterpolation(mode);
+        d.setNumTaps(1);
+        MckDsp::DelayTap tap;
+        tap.gain = 1.0;
+        tap.pan = 0.0;
+        size_t pos = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const Settings set = settingsForBlock(b, ramp);
+            tap.timeInMs = set.timeInMs;
+            d.setTap(0, tap);
+            d.setFeedback(set.feedback);
+            d.setMix(set.mix);
+            const SampleType *readPtrs[MckDsp::MultiTapDelay<SampleType>::maxChannels];
+            SampleType *writePtrs[MckDsp::MultiTapDelay<SampleType>::maxChannels];
+            for (int c = 0; c < numChannels; c++)
+            {
+                readPtrs[c] = in[c].data() + pos;
+                writePtrs[c] = out[c].data() + pos;
+            }
+            d.processBlock(readPtrs, writePtrs, blocks[b]);
+            pos += blocks[b];
+        }
+
+        Result r;
+        for (int c = 0; c < numChannels; c++)
+        {
+            compare(ref[c], out[c], c, r);
+        }
+        report<SampleType>(std::string("MultiTapDelay 1tap ") + std::to_string(numChannels) + "ch " + typeName<SampleType>() + " " +
+                               interpolationName(mode) + " " + signalName(s) + (ramp ? " ramp" : ""),
+                           r);
+    }
+
+    // With float storage the paged line of LongDelay holds exactly what DelayModule<float> keeps in its ring
+    void testLongDelay(int numChannels, MckDsp::Interpolation mode, MckDsp::FilterStages stages, Signal s, bool ramp)
+    {
+        const auto blocks = makeBlocks(opt.numSamples, 4);
+        std::vector<std::vector<float>> in, ref, out;
+        for (int c = 0; c < numChannels; c++)
+        {
+            const auto sig = static_cast<Signal>((static_cast<int>(s) + c) % static_cast<int>(Signal::Count));
+            in.push_back(makeSignal<float>(sig, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            ref.push_back(renderReference(in.back(), blocks, mode, stages, ramp));
+            out.push_back(std::vector<float>(opt.numSamples));
+        }
+
+        MckDsp::LongDelay<float> d;
+        d.setFormat(MckDsp::SampleFormat::Float32);
+        d.setMaxDelayInMs(100.0);
+        d.prepareToPlay(sampleRate, 700, numChannels);
+        d.setInterpolation(mode);
+        d.setHighPass(stages == MckDsp::FilterStages::HighPass || stages == MckDsp::FilterStages::Both, 120.0);
+        d.setLowPass(stages == MckDsp::FilterStages::LowPass || stages == MckDsp::FilterStages::Both, 3000.0);
+        size_t pos = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const Settings set = settingsForBlock(b, ramp);
+            d.setDelayInMs(set.timeInMs);
+            d.setFeedback(set.feedback);
+            d.setMix(set.mix);
+            const float *readPtrs[MckDsp::LongDelay<float>::maxChannels];
+            float *writePtrs[MckDsp::LongDelay<float>::maxChannels];
+            for (int c = 0; c < numChannels; c++)
+            {
+                readPtrs[c] = in[c].data() + pos;
+                writePtrs[c] = out[c].data() + pos;
+            }
+            d.processBlock(readPtrs, writePtrs, blocks[b]);
+            pos += blocks[b];
+        }
+
+        Result r;
+        for (int c = 0; c < numChannels; c++)
+        {
+            compare(ref[c], out[c], c, r);
+        }
+        report<float>(std::string("LongDelay float32 ") + std::to_string(numChannels) + "ch float " + interpolationName(mode) + " " +
+                          stagesName(stages) + " " + signalName(s) + (ramp ? " ramp" : ""),
+                      r);
+    }
+
+    // FilterChain on N lanes against one OnePoleFilter pair per lane, every lane carries another signal
+    template <typename SampleType, int N, bool HighPass, bool LowPass>
+    void testFilterChain(Signal s)
+    {
+        using Chain = MckDsp::FilterChain<SampleType, N, HighPass, LowPass>;
+        using V = typename Chain::V;
+
+        std::vector<std::vector<SampleType>> in, ref, out;
+        for (int c = 0; c < N; c++)
+        {
+            const auto sig = static_cast<Signal>((static_cast<int>(s) + c) % static_cast<int>(Signal::Count));
+            in.push_back(makeSignal<SampleType>(sig, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            ref.push_back(std::vector<SampleType>(opt.numSamples));
+            out.push_back(std::vector<SampleType>(opt.numSamples));
+
+            MckDsp::OnePoleFilter<SampleType> hp, lp;
+            hp.prepareToPlay(sampleRate, 700);
+            lp.prepareToPlay(sampleRate, 700);
+            hp.setHPF(120.0);
+            lp.setLPF(3000.0);
+            for (size_t i = 0; i < opt.numSamples; i++)
+            {
+                SampleType x = in[c][i];
+                if (HighPass)
+                {
+                    x = hp.processSample(x);
+                }
+                if (LowPass)
+                {
+                    x = lp.processSample(x);
+                }
+                ref[c][i] = x;
+            }
+        }
+
+        alignas(64) SampleType zero[N]{};
+        alignas(64) SampleType frame[N]{};
+        Chain chain;
+        chain.load(MckDsp::OnePoleFilter<SampleType>::makeHPF(120.0, sampleRate),
+                   MckDsp::OnePoleFilter<SampleType>::makeLPF(3000.0, sampleRate),
+                   zero, zero, zero, zero);
+        for (size_t i = 0; i < opt.numSamples; i++)
+        {
+            for (int c = 0; c < N; c++)
+            {
+                frame[c] = in[c][i];
+            }
+            chain.process(V::load(frame)).store(frame);
+            for (int c = 0; c < N; c++)
+            {
+                out[c][i] = frame[c];
+            }
+        }
+
+        Result r;
+        for (int c = 0; c < N; c++)
+        {
+            compare(ref[c], out[c], c, r);
+        }
+        report<SampleType>(std::string("FilterChain ") + std::to_string(N) + "lanes " + typeName<SampleType>() + " " +
+                               stagesName(MckDsp::makeFilterStages(HighPass, LowPass)) + " " + signalName(s),
+                           r);
+    }
+
+    constexpr MckDsp::Interpolation modes[] = {MckDsp::Interpolation::None, MckDsp::Interpolation::Linear, MckDsp::Interpolation::Lagrange,
+                                               MckDsp::Interpolation::Hermite, MckDsp::Interpolation::Allpass};
+    constexpr MckDsp::FilterStages stageSets[] = {MckDsp::FilterStages::None, MckDsp::FilterStages::HighPass, MckDsp::FilterStages::LowPass,
+                                                  MckDsp::FilterStages::Both};
+
+    template <typename SampleType, int N>
+    void testFilterChains()
+    {
+        for (int s = 0; s < static_cast<int>(Signal::Count); s++)
+        {
+            testFilterChain<SampleType, N, false, false>(static_cast<Signal>(s));
+            testFilterChain<SampleType, N, true, false>(static_cast<Signal>(s));
+            testFilterChain<SampleType, N, false, true>(static_cast<Signal>(s));
+            testFilterChain<SampleType, N, true, true>(static_cast<Signal>(s));
+        }
+    }
+
+    // In place Walsh-Hadamard butterflies in natural order, the scalar reference for hadamard()
+    template <typename SampleType>
+    void fastWalshHadamard(SampleType *x, int n)
+    {
+        for (int h = 1; h < n; h *= 2)
+        {
+            for (int i = 0; i < n; i += 2 * h)
+            {
+                for (int j = i; j < i + h; j++)
+                {
+                    const SampleType a = x[j];
+                    const SampleType b = x[j + h];
+                    x[j] = a + b;
+                    x[j + h] = a - b;
+                }
+            }
+        }
+    }
+
+    // hadamard() on N lanes against the scalar butterflies, every lane carries another signal
+    template <typename SampleType, int N>
+    void testHadamard(Signal s)
+    {
+        using V = MckDsp::Vec<SampleType, N>;
+
+        std::vector<std::vector<SampleType>> in, ref, out;
+        for (int c = 0; c < N; c++)
+        {
+            const auto sig = static_cast<Signal>((static_cast<int>(s) + c) % static_cast<int>(Signal::Count));
+            in.push_back(makeSignal<SampleType>(sig, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            ref.push_back(std::vector<SampleType>(opt.numSamples));
+            out.push_back(std::vector<SampleType>(opt.numSamples));
+        }
+
+        alignas(64) SampleType frame[N]{};
+        for (size_t i = 0; i < opt.numSamples; i++)
+        {
+            for (int c = 0; c < N; c++)
+            {
+                frame[c] = in[c][i];
+            }
+            hadamard(V::load(frame)).store(frame);
+            for (int c = 0; c < N; c++)
+            {
+                out[c][i] = frame[c];
+                frame[c] = in[c][i];
+            }
+            fastWalshHadamard(frame, N);
+            for (int c = 0; c < N; c++)
+            {
+                ref[c][i] = frame[c];
+            }
+        }
+
+        Result r;
+        for (int c = 0; c < N; c++)
+        {
+            compare(ref[c], out[c], c, r);
+        }
+        report<SampleType>(std::string("Hadamard ") + std::to_string(N) + "lanes " + typeName<SampleType>() + " " + signalName(s), r);
+    }
+
+    // FeedbackDelayNetwork against one OnePoleFilter pair and one plain delay line per line,
+    // mixed by the scalar butterflies. The line lengths have to be distinct primes.
+    template <typename SampleType>
+    void testFeedbackDelayNetwork(int numLines, int numChannels, MckDsp::FilterStages stages, Signal s)
+    {
+        const bool hpActive = stages == MckDsp::FilterStages::HighPass || stages == MckDsp::FilterStages::Both;
+        const bool lpActive = stages == MckDsp::FilterStages::LowPass || stages == MckDsp::FilterStages::Both;
+        const double timeInMs = 50.0, feedback = 0.85, mix = 0.6;
+
+        MckDsp::FeedbackDelayNetwork<SampleType> fdn;
+        fdn.setMaxNumLines(numLines);
+        fdn.prepareToPlay(sampleRate, 700, numChannels);
+        fdn.setNumLines(numLines);
+        fdn.setDelayInMs(timeInMs);
+        fdn.setFeedback(feedback);
+        fdn.setMix(mix);
+        fdn.setHighPass(hpActive, 120.0);
+        fdn.setLowPass(lpActive, 3000.0);
+
+        Result r;
+        std::vector<size_t> lengths;
+        for (int i = 0; i < numLines; i++)
+        {
+            lengths.push_back(fdn.getLineLength(i));
+            bool prime = lengths[i] > 1;
+            for (size_t d = 2; d * d <= lengths[i]; d++)
+            {
+                prime = prime && lengths[i] % d != 0;
+            }
+            if (!prime || (i > 0 && lengths[i] <= lengths[i - 1]))
+            {
+                r.finite = false;
+            }
+        }
+
+        std::vector<std::vector<SampleType>> in, ref, out;
+        for (int c = 0; c < numChannels; c++)
+        {
+            const auto sig = static_cast<Signal>((static_cast<int>(s) + c) % static_cast<int>(Signal::Count));
+            in.push_back(makeSignal<SampleType>(sig, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            ref.push_back(std::vector<SampleType>(opt.numSamples));
+            out.push_back(std::vector<SampleType>(opt.numSamples));
+        }
+
+        const int numSlots = std::min(numChannels, numLines);
+        const SampleType wet = static_cast<SampleType>(mix) * static_cast<SampleType>(std::sqrt(static_cast<double>(numSlots) / numLines));
+        const SampleType dry = SampleType(1) - static_cast<SampleType>(mix);
+        std::vector<SampleType> gains;
+        std::vector<MckDsp::OnePoleFilter<SampleType>> hp(static_cast<size_t>(numLines)), lp(static_cast<size_t>(numLines));
+        std::vector<std::vector<SampleType>> written;
+        for (int i = 0; i < numLines; i++)
+        {
+            const double g = std::pow(feedback, static_cast<double>(lengths[i]) / static_cast<double>(lengths.back()));
+            gains.push_back(static_cast<SampleType>(g * (1.0 / std::sqrt(static_cast<double>(numLines)))));
+            hp[i].prepareToPlay(sampleRate, 700);
+            lp[i].prepareToPlay(sampleRate, 700);
+            hp[i].setHPF(120.0);
+            lp[i].setLPF(3000.0);
+            written.push_back(std::vector<SampleType>(opt.numSamples));
+        }
+
+        SampleType lines[MckDsp::FeedbackDelayNetwork<SampleType>::maxLines];
+        for (size_t n = 0; n < opt.numSamples; n++)
+        {
+            SampleType slotIn[MckDsp::FeedbackDelayNetwork<SampleType>::maxChannels]{};
+            SampleType slotOut[MckDsp::FeedbackDelayNetwork<SampleType>::maxChannels]{};
+            for (int c = 0; c < numChannels; c++)
+            {
+                slotIn[c % numSlots] += in[c][n];
+            }
+            for (int i = 0; i < numLines; i++)
+            {
+                SampleType y = n >= lengths[i] ? written[i][n - lengths[i]] : SampleType(0);
+                if (hpActive)
+                {
+                    y = hp[i].processSample(y);
+                }
+                if (lpActive)
+                {
+                    y = lp[i].processSample(y);
+                }
+                lines[i] = y;
+                slotOut[i % numSlots] += y;
+            }
+            fastWalshHadamard(lines, numLines);
+            for (int i = 0; i < numLines; i++)
+            {
+                written[i][n] = lines[i] * gains[i] + slotIn[i % numSlots];
+            }
+            for (int c = 0; c < numChannels; c++)
+            {
+                ref[c][n] = dry * in[c][n] + wet * slotOut[c % numSlots];
+            }
+        }
+
+        const auto blocks = makeBlocks(opt.numSamples, 3);
+        size_t pos = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const SampleType *readPtrs[MckDsp::FeedbackDelayNetwork<SampleType>::maxChannels];
+            SampleType *writePtrs[MckDsp::FeedbackDelayNetwork<SampleType>::maxChannels];
+            for (int c = 0; c < numChannels; c++)
+            {
+                readPtrs[c] = in[c].data() + pos;
+                writePtrs[c] = out[c].data() + pos;
+            }
+            fdn.processBlock(readPtrs, writePtrs, blocks[b]);
+            pos += blocks[b];
+        }
+
+        for (int c = 0; c < numChannels; c++)
+        {
+            compare(ref[c], out[c], c, r);
+        }
+        report<SampleType>(std::string("FeedbackDelayNetwork ") + std::to_string(numLines) + "lines " + std::to_string(numChannels) + "ch " +
+                               typeName<SampleType>() + " " + stagesName(stages) + " " + signalName(s),
+                           r);
+    }
+
+    // Runs the samples [begin, end) of every channel through fdn in the blocks of makeBlocks()
+    template <typename SampleType>
+    void processFdn(MckDsp::FeedbackDelayNetwork<SampleType> &fdn, const std::vector<std::vector<SampleType>> &in,
+                    std::vector<std::vector<SampleType>> &out, size_t begin, size_t end, uint32_t seed)
+    {
+        const auto blocks = makeBlocks(end - begin, seed);
+        size_t pos = begin;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const SampleType *readPtrs[MckDsp::FeedbackDelayNetwork<SampleType>::maxChannels];
+            SampleType *writePtrs[MckDsp::FeedbackDelayNetwork<SampleType>::maxChannels];
+            for (size_t c = 0; c < in.size(); c++)
+            {
+                readPtrs[c] = in[c].data() + pos;
+                writePtrs[c] = out[c].data() + pos;
+            }
+            fdn.processBlock(readPtrs, writePtrs, blocks[b]);
+            pos += blocks[b];
+        }
+    }
+
+    // Switching from 16 to 4 lines only clears the frames the 4 lines read, also once a longer time reaches
+    // further back, so the network has to sound exactly like a new one fed from the switch on. The 16 lines
+    // fill the whole ring first, so anything not cleared would be heard.
+    template <typename SampleType>
+    void testFeedbackDelayNetworkLineSwitch()
+    {
+        const size_t numChannels = 2, switchAt = opt.numSamples / 2, longerAt = opt.numSamples * 5 / 8;
+        std::vector<std::vector<SampleType>> in, out, ref;
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            in.push_back(makeSignal<SampleType>(Signal::Noise, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            out.push_back(std::vector<SampleType>(opt.numSamples));
+            ref.push_back(std::vector<SampleType>(opt.numSamples));
+        }
+
+        MckDsp::FeedbackDelayNetwork<SampleType> switched, fresh;
+        for (auto *fdn : {&switched, &fresh})
+        {
+            fdn->setMaxNumLines(16);
+            fdn->setMaxDelayInMs(100.0);
+            fdn->prepareToPlay(sampleRate, 700, static_cast<int>(numChannels));
+            fdn->setFeedback(0.9);
+            fdn->setMix(0.5);
+            fdn->setDelayInMs(50.0);
+        }
+        switched.setNumLines(16);
+        processFdn(switched, in, out, 0, switchAt, 1);
+        switched.setNumLines(4);
+        processFdn(switched, in, out, switchAt, longerAt, 2);
+        switched.setDelayInMs(100.0);
+        processFdn(switched, in, out, longerAt, opt.numSamples, 3);
+
+        fresh.setNumLines(4);
+        processFdn(fresh, in, ref, switchAt, longerAt, 2);
+        fresh.setDelayInMs(100.0);
+        processFdn(fresh, in, ref, longerAt, opt.numSamples, 3);
+
+        Result r;
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            compare(std::vector<SampleType>(ref[c].begin() + switchAt, ref[c].end()), std::vector<SampleType>(out[c].begin() + switchAt, out[c].end()),
+                    static_cast<int>(c), r);
+        }
+        report<SampleType>(std::string("FeedbackDelayNetwork line switch ") + typeName<SampleType>(), r);
+    }
+
+    // 16 lines in a ring reserved for 4 are shorter, setMaxNumLines() hands a larger ring over at the next
+    // block, from where on the network sounds exactly like one reserved for 16 lines from the start
+    template <typename SampleType>
+    void testFeedbackDelayNetworkGrowth()
+    {
+        const size_t numChannels = 3, growAt = opt.numSamples / 8;
+        const double maxDelayInMs = 300.0, timeInMs = 150.0;
+        std::vector<std::vector<SampleType>> in, out, ref;
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            in.push_back(makeSignal<SampleType>(Signal::Noise, opt.numSamples, static_cast<uint32_t>(c + 1)));
+            out.push_back(std::vector<SampleType>(opt.numSamples));
+            ref.push_back(std::vector<SampleType>(opt.numSamples));
+        }
+
+        MckDsp::FeedbackDelayNetwork<SampleType> grown, fresh;
+        grown.setMaxNumLines(4);
+        fresh.setMaxNumLines(16);
+        for (auto *fdn : {&grown, &fresh})
+        {
+            fdn->setMaxDelayInMs(maxDelayInMs);
+            fdn->prepareToPlay(sampleRate, 700, static_cast<int>(numChannels));
+            fdn->setNumLines(16);
+            fdn->setFeedback(0.9);
+            fdn->setMix(0.5);
+            fdn->setDelayInMs(timeInMs);
+        }
+
+        Result r;
+        const unsigned timeInSamples = static_cast<unsigned>(timeInMs / 1000.0 * sampleRate);
+        if (grown.getLineLength(15) >= timeInSamples * 3 / 4 || fresh.getLineLength(15) <= timeInSamples * 9 / 10)
+        {
+            r.finite = false;
+        }
+
+        processFdn(grown, in, out, 0, growAt, 1);
+        grown.setMaxNumLines(16);
+        processFdn(grown, in, out, growAt, opt.numSamples, 2);
+        processFdn(fresh, in, ref, growAt, opt.numSamples, 2);
+        if (grown.getLineLength(15) != fresh.getLineLength(15))
+        {
+            r.finite = false;
+        }
+
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            compare(std::vector<SampleType>(ref[c].begin() + growAt, ref[c].end()), std::vector<SampleType>(out[c].begin() + growAt, out[c].end()),
+                    static_cast<int>(c), r);
+        }
+        report<SampleType>(std::string("FeedbackDelayNetwork growth ") + typeName<SampleType>(), r);
+    }
+
+    // Lfo lanes against the exact shapes at their own phases. The straight segments of the
+    // triangle may cut its corners, the random shape has to stay in range and smooth.
+    template <typename SampleType>
+    void testLfo(MckDsp::LfoShape shape, int numLanes)
+    {
+        const double rateInHz = 3.7, phase = 0.1, phaseOffset = 0.3;
+        const double inc = rateInHz / sampleRate;
+
+        MckDsp::Lfo<SampleType> lfo;
+        lfo.prepareToPlay(sampleRate, numLanes);
+        lfo.setShape(shape);
+        lfo.setRate(rateInHz);
+        lfo.setPhase(phase, phaseOffset);
+
+        double tolerance = sizeof(SampleType) == sizeof(float) ? 1e-5 : 1e-9;
+        if (shape == MckDsp::LfoShape::Triangle)
+        {
+            tolerance = 4.0 * inc * static_cast<double>(MckDsp::Lfo<SampleType>::segmentLength);
+        }
+        // Smoothstep is steepest half way with 1.5 times the jump of at most two per cycle
+        const double maxStep = 3.0 * inc * 1.001;
+
+        Result r;
+        std::vector<double> prev(static_cast<size_t>(numLanes), 0.0);
+        double minValue = 1.0, maxValue = -1.0;
+        for (size_t n = 0; n < opt.numSamples; n++)
+        {
+            const SampleType *values = lfo.next();
+            for (int l = 0; l < numLanes; l++)
+            {
+                const double v = static_cast<double>(values[l]);
+                const double p = phase + static_cast<double>(l) * phaseOffset + static_cast<double>(n) * inc;
+                double err = 0.0;
+                if (shape == MckDsp::LfoShape::Random)
+                {
+                    err = std::max(0.0, std::fabs(v) - 1.0);
+                    if (n > 0 && std::fabs(v - prev[l]) > maxStep)
+                    {
+                        err = std::max(err, std::fabs(v - prev[l]));
+                    }
+                    minValue = std::min(minValue, v);
+                    maxValue = std::max(maxValue, v);
+                }
+                else if (shape == MckDsp::LfoShape::Triangle)
+                {
+                    const double q = p + 0.75;
+                    err = std::fabs(v - (4.0 * std::fabs(q - std::floor(q) - 0.5) - 1.0));
+                }
+                else
+                {
+                    err = std::fabs(v - std::sin(2.0 * M_PI * p));
+                }
+                if (!(err <= tolerance))
+                {
+                    r.finite = false;
+                }
+                if (err > r.maxAbs)
+                {
+                    r.maxAbs = err;
+                    r.channel = l;
+                    r.sample = n;
+                }
+                prev[l] = v;
+            }
+        }
+        // A random shape that never moves is no modulation at all
+        if (shape == MckDsp::LfoShape::Random && maxValue - minValue < 0.1)
+        {
+            r.finite = false;
+        }
+        report<SampleType>(std::string("Lfo ") + shapeName(shape) + " " + std::to_string(numLanes) + "lanes " + typeName<SampleType>(), r);
+    }
+
+    // A frozen line has to keep playing exactly what it would have read next, the reference
+    // reads that loop from a second line with the feedback off. Capturing swaps the loop out
+    // for a silent buffer and back, the snapshot exports the loop oldest first.
+    template <typename SampleType>
+    void testFreeze(MckDsp::Interpolation mode, MckDsp::FilterStages stages, Signal s)
+    {
+        const double delayInMs = 3.0;
+        const size_t loopLen = static_cast<size_t>(delayInMs / 1000.0 * sampleRate);
+        const double mix = 0.4;
+        const auto in = makeSignal<SampleType>(s, opt.numSamples, 5);
+        const auto blocks = makeBlocks(opt.numSamples, 5);
+        const size_t freezeAt = opt.numSamples / 3;
+        const size_t captureAt = freezeAt + 1000;
+        const size_t recallAt = 2 * opt.numSamples / 3;
+
+        auto setup = [&](MckDsp::DelayModule<SampleType> &d)
+        {
+            configure(d, mode, stages);
+            d.setDelayInMs(delayInMs);
+            d.setFeedback(0.6);
+            d.setMix(mix);
+        };
+
+        MckDsp::DelayModule<SampleType> refLine;
+        setup(refLine);
+        std::vector<SampleType> ref(in.size());
+        for (size_t i = 0; i < freezeAt; i++)
+        {
+            ref[i] = refLine.processSample(in[i]);
+        }
+        refLine.setInterpolation(MckDsp::Interpolation::None);
+        refLine.setFeedback(0.0);
+        refLine.setMix(1.0);
+        std::vector<SampleType> loop(loopLen);
+        for (size_t i = 0; i < loopLen; i++)
+        {
+            loop[i] = refLine.processSample(SampleType(0));
+        }
+        const SampleType wet = static_cast<SampleType>(mix);
+        const SampleType dry = SampleType(1) - wet;
+        for (size_t i = freezeAt; i < in.size(); i++)
+        {
+            const SampleType dly = i < captureAt ? loop[(i - freezeAt) % loopLen] : i < recallAt ? SampleType(0) : loop[(i - recallAt) % loopLen];
+            ref[i] = wet * dly + dry * in[i];
+        }
+
+        MckDsp::DelayModule<SampleType> d;
+        d.setCaptureEnabled(true);
+        setup(d);
+        Result r;
+        std::vector<SampleType> out(in.size()), snapshot(loopLen + 1);
+        size_t pos = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            // Blocks are split where the line freezes or captures
+            for (size_t end = pos + blocks[b]; pos < end;)
+            {
+                if (pos == freezeAt)
+                {
+                    d.setFreeze(true);
+                }
+                if (pos == captureAt || pos == recallAt)
+                {
+                    if (!d.capture())
+                    {
+                        r.finite = false;
+                    }
+                    const size_t expected = pos == captureAt ? loopLen : 0;
+                    if (d.getSnapshotLength() != expected || d.exportSnapshot(snapshot.data(), snapshot.size()) != expected)
+                    {
+                        r.finite = false;
+                    }
+                    if (pos == captureAt)
+                    {
+                        snapshot.resize(loopLen);
+                        compare(loop, snapshot, 1, r);
+                    }
+                }
+                size_t len = end - pos;
+                for (size_t event : {freezeAt, captureAt, recallAt})
+                {
+                    if (event > pos)
+                    {
+                        len = std::min(len, event - pos);
+                    }
+                }
+                d.processBlock(in.data() + pos, out.data() + pos, len);
+                pos += len;
+            }
+        }
+        compare(ref, out, 0, r);
+        report<SampleType>(std::string("DelayModule freeze ") + typeName<SampleType>() + " " + interpolationName(mode) + " " +
+                               stagesName(stages) + " " + signalName(s),
+                           r);
+    }
+
+    // A capture() right after setMaxDelayInMs() takes both larger blocks over first, so the line and the snapshot
+    // keep trading places at the new size and a later growth reaches both of them again
+    template <typename SampleType>
+    void testCaptureDuringGrowth()
+    {
+        MckDsp::DelayModule<SampleType> d;
+        d.setMaxDelayInMs(50.0);
+        d.setCaptureEnabled(true);
+        configure(d, MckDsp::Interpolation::None, MckDsp::FilterStages::None);
+        d.setFeedback(0.0);
+        d.setMix(1.0);
+        d.setDelayInMs(20.0);
+
+        Result r;
+        const auto noise = makeSignal<SampleType>(Signal::Noise, 5000, 7);
+        std::vector<SampleType> out(noise.size());
+        d.processBlock(noise.data(), out.data(), noise.size());
+
+        // Every buffer the line runs on after a growth starts silent, so it delays by the whole new time
+        auto expectDelay = [&](double delayInMs)
+        {
+            const size_t delay = static_cast<size_t>(delayInMs / 1000.0 * sampleRate);
+            const auto in = makeSignal<SampleType>(Signal::Noise, delay + 2000, 8);
+            std::vector<SampleType> ref(in.size()), got(in.size());
+            std::copy(in.begin(), in.end() - static_cast<std::ptrdiff_t>(delay), ref.begin() + static_cast<std::ptrdiff_t>(delay));
+            d.setDelayInMs(delayInMs);
+            const auto blocks = makeBlocks(in.size(), 7);
+            size_t pos = 0;
+            for (size_t b = 0; b < blocks.size(); b++)
+            {
+                d.processBlock(in.data() + pos, got.data() + pos, blocks[b]);
+                pos += blocks[b];
+            }
+            compare(ref, got, 0, r);
+        };
+
+        for (double maxDelayInMs : {500.0, 1000.0})
+        {
+            d.setMaxDelayInMs(maxDelayInMs);
+            for (int c = 0; c < 2; c++)
+            {
+                if (!d.capture())
+                {
+                    r.finite = false;
+                }
+                expectDelay(maxDelayInMs - 100.0);
+            }
+        }
+        report<SampleType>(std::string("DelayModule capture during growth ") + typeName<SampleType>(), r);
+    }
+
+    // Exports running next to captures always see one whole snapshot, never half a swap
+    template <typename SampleType>
+    void testCaptureExport()
+    {
+        const size_t loopLen = 480;
+        const auto in = makeSignal<SampleType>(Signal::Noise, 4 * loopLen, 6);
+        MckDsp::DelayModule<SampleType> d;
+        d.setCaptureEnabled(true);
+        configure(d, MckDsp::Interpolation::None, MckDsp::FilterStages::None);
+        d.setDelayInMs(10.0);
+        d.setFeedback(0.5);
+        d.setMix(0.5);
+        std::vector<SampleType> out(in.size());
+        d.processBlock(in.data(), out.data(), in.size());
+        d.setFreeze(true);
+        d.capture();
+
+        Result r;
+        std::vector<SampleType> loop(loopLen);
+        if (d.exportSnapshot(loop.data(), loop.size()) != loopLen)
+        {
+            r.finite = false;
+        }
+
+        std::atomic<bool> done{false};
+        std::atomic<size_t> numExports{0};
+        std::thread exporter([&]
+                             {
+                                 std::vector<SampleType> snapshot(loopLen);
+                                 while (!done.load(std::memory_order_acquire))
+                                 {
+                                     const size_t n = d.exportSnapshot(snapshot.data(), snapshot.size());
+                                     if ((n != 0 && n != loopLen) || (n == loopLen && snapshot != loop))
+                                     {
+                                         r.finite = false;
+                                     }
+                                     numExports++;
+                                 }
+                             });
+        // A capture fails while an export runs, so both sides go on until each got through often enough
+        size_t numCaptures = 0;
+        for (int i = 0; i < 20000 || numCaptures < 1000 || numExports.load() < 1000; i++)
+        {
+            numCaptures += d.capture() ? 1 : 0;
+            d.processBlock(in.data(), out.data(), 64);
+        }
+        done.store(true, std::memory_order_release);
+        exporter.join();
+
+        report<SampleType>(std::string("DelayModule capture export ") + typeName<SampleType>(), r);
+    }
+
+    template <typename SampleType>
+    void run()
+    {
+        MckDsp::WorkerPool pool;
+        pool.start(3);
+
+        for (auto mode : modes)
+        {
+            for (auto stages : stageSets)
+            {
+                for (int s = 0; s < static_cast<int>(Signal::Count); s++)
+                {
+                    for (bool ramp : {false, true})
+                    {
+                        testDelayModuleBlock<SampleType>(mode, stages, static_cast<Signal>(s), ramp);
+                        for (int numChannels : {1, 2, 3, 8})
+                        {
+                            testMultiChannelDelay<SampleType>(numChannels, mode, stages, static_cast<Signal>(s), ramp);
+                        }
+                        if constexpr (std::is_same_v<SampleType, float>)
+                        {
+                            for (int numChannels : {1, 2})
+                            {
+                                testLongDelay(numChannels, mode, stages, static_cast<Signal>(s), ramp);
+                            }
+                        }
+                    }
+                }
+            }
+            for (int s = 0; s < static_cast<int>(Signal::Count); s++)
+            {
+                for (bool ramp : {false, true})
+                {
+                    for (int numChannels : {1, 2})
+                    {
+                        testMultiTapDelay<SampleType>(numChannels, mode, static_cast<Signal>(s), ramp);
+                    }
+                    testGroupedDelay<SampleType>(pool, 20, mode, MckDsp::FilterStages::Both, static_cast<Signal>(s), ramp);
+                }
+            }
+        }
+
+        // Workers that asked for real-time scheduling, whether or not they got it, wake up on their own as well
+        MckDsp::WorkerPool realtimePool;
+        realtimePool.start(3, 1.0);
+        for (auto mode : modes)
+        {
+            testGroupedDelay<SampleType>(realtimePool, 20, mode, MckDsp::FilterStages::Both, Signal::Noise, true);
+        }
+        for (auto shape : {MckDsp::LfoShape::Sine, MckDsp::LfoShape::Triangle, MckDsp::LfoShape::Random})
+        {
+            for (int numLanes : {1, 2, 4, 8})
+            {
+                testLfo<SampleType>(shape, numLanes);
+            }
+
+            // Deep enough to hit the shortest delay, so the clamping has to agree as well
+            Modulation mod;
+            mod.shape = shape;
+            mod.rateInHz = 3.7;
+            mod.depthInMs = 2.8;
+            mod.phaseOffset = 0.3;
+            for (auto mode : modes)
+            {
+                for (int s = 0; s < static_cast<int>(Signal::Count); s++)
+                {
+                    for (bool ramp : {false, true})
+                    {
+                        for (int numChannels : {1, 2, 3, 8})
+                        {
+                            testMultiChannelDelay<SampleType>(numChannels, mode, MckDsp::FilterStages::Both, static_cast<Signal>(s), ramp, mod);
+                        }
+                    }
+                }
+            }
+        }
+
+        for (auto mode : modes)
+        {
+            for (auto stages : {MckDsp::FilterStages::None, MckDsp::FilterStages::Both})
+            {
+                testFreeze<SampleType>(mode, stages, Signal::Noise);
+            }
+        }
+        testCaptureExport<SampleType>();
+        testCaptureDuringGrowth<SampleType>();
+
+        for (auto mode : modes)
+        {
+            for (int s = 0; s < static_cast<int>(Signal::Count); s++)
+            {
+                for (bool ramp : {false, true})
+                {
+                    for (int numChannels : {1, 2, 3, 8})
+                    {
+                        testConvolvedDelay<SampleType>(numChannels, mode, MckDsp::FilterStages::Both, static_cast<Signal>(s), ramp);
+                    }
+                }
+            }
+        }
+        for (size_t irLength : {64, 1000, 4096})
+        {
+            for (int numChannels : {1, 3})
+            {
+                testConvolution<SampleType>(numChannels, irLength, Signal::Noise);
+            }
+        }
+
+        testFilterChains<SampleType, 1>();
+        testFilterChains<SampleType, 2>();
+        testFilterChains<SampleType, 4>();
+        testFilterChains<SampleType, 8>();
+
+        for (int s = 0; s < static_cast<int>(Signal::Count); s++)
+        {
+            testHadamard<SampleType, 2>(static_cast<Signal>(s));
+            testHadamard<SampleType, 4>(static_cast<Signal>(s));
+            testHadamard<SampleType, 8>(static_cast<Signal>(s));
+            testHadamard<SampleType, 16>(static_cast<Signal>(s));
+            for (auto stages : stageSets)
+            {
+                for (int numLines : {4, 8, 16})
+                {
+                    for (int numChannels : {1, 3, 8})
+                    {
+                        testFeedbackDelayNetwork<SampleType>(numLines, numChannels, stages, static_cast<Signal>(s));
+                    }
+                }
+            }
+        }
+        testFeedbackDelayNetworkLineSwitch<SampleType>();
+        testFeedbackDelayNetworkGrowth<SampleType>();
+    }
+
+    // Binary states written into a bank have to read back exactly, anything truncated or foreign is rejected
+    void testPresetBank()
+    {
+        Result r;
+        MckDsp::PresetBankWriter writer;
+        std::vector<std::vector<MckDsp::StateValue>> presets;
+        for (size_t p = 0; p < 5; p++)
+        {
+            std::vector<MckDsp::StateValue> values;
+            for (size_t i = 0; i < p * 37; i++)
+            {
+                const std::string id = "param" + std::to_string(i);
+                values.push_back({MckDsp::stateId(id), static_cast<float>(i) * 0.37f - static_cast<float>(p)});
+            }
+            std::vector<uint8_t> state(MckDsp::stateSize(values.size()));
+            MckDsp::writeState(values.data(), values.size(), static_cast<int32_t>(p), state.data());
+            writer.add("Preset " + std::to_string(p), state.data(), state.size());
+            presets.push_back(values);
+        }
+        const auto bank = writer.build();
+
+        MckDsp::PresetBankView view;
+        if (!view.open(bank.data(), bank.size()) || view.getNumPresets() != presets.size())
+        {
+            r.finite = false;
+        }
+        for (size_t p = 0; p < view.getNumPresets(); p++)
+        {
+            const auto state = view.getState(p);
+            if (view.getName(p) != "Preset " + std::to_string(p) || !state.isValid() || state.getProgram() != static_cast<int32_t>(p) ||
+                state.getNumValues() != presets[p].size())
+            {
+                r.finite = false;
+                continue;
+            }
+            for (size_t i = 0; i < state.getNumValues(); i++)
+            {
+                const auto v = state.getValue(i);
+                if (v.id != presets[p][i].id || v.value != presets[p][i].value)
+                {
+                    r.finite = false;
+                }
+            }
+        }
+
+        // Every truncation of the bank breaks at least one entry
+        for (size_t size = 0; size < bank.size(); size += 7)
+        {
+            MckDsp::PresetBankView cut;
+            if (cut.open(bank.data(), size))
+            {
+                r.finite = false;
+            }
+        }
+        // The XML wrapper of copyXmlToBinary is not a binary state
+        const uint8_t xmlBlob[16] = {0x56, 0x43, 0x32, 0x21, 4, 0, 0, 0, '<', 'x', '/', '>'};
+        MckDsp::StateView xml;
+        if (xml.open(xmlBlob, sizeof(xmlBlob)))
+        {
+            r.finite = false;
+        }
+        report<double>("PresetBank round trip", r);
+    }
+
+    // Zones of several threads end up in one trace, a wrapped ring keeps only its newest events
+    void testTrace()
+    {
+        Result r;
+        MckDsp::Trace::clear();
+
+        auto countOf = [](const std::string &text, const std::string &pattern)
+        {
+            size_t n = 0;
+            for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+            {
+                n++;
+            }
+            return n;
+        };
+
+        const size_t numZones = 100;
+        const size_t numWrapped = MckDsp::Trace::eventsPerThread + 10;
+        for (size_t i = 0; i < numZones; i++)
+        {
+            const MckDsp::Trace::Zone zone("Main\"Zone");
+        }
+        auto record = [&]
+        {
+            MckDsp::Trace::setThreadName("TraceWorker");
+            for (size_t i = 0; i < numWrapped; i++)
+            {
+                const MckDsp::Trace::Zone zone("WorkerZone");
+            }
+        };
+        std::thread worker(record);
+        worker.join();
+
+        const std::string json = MckDsp::Trace::toChromeJson();
+        // The newest slot of a ring counts as in flight, so a wrapped ring loses one more event
+        if (countOf(json, "\"Main\\\"Zone\"") != numZones ||
+            countOf(json, "\"WorkerZone\"") != MckDsp::Trace::eventsPerThread - 1 ||
+            countOf(json, "\"ph\":\"X\"") != numZones + MckDsp::Trace::eventsPerThread - 1 ||
+            countOf(json, "\"TraceWorker\"") != 1 ||
+            json.compare(0, 15, "{\"displayTimeUn") != 0)
+        {
+            r.finite = false;
+        }
+
+        MckDsp::Trace::clear();
+        if (countOf(MckDsp::Trace::toChromeJson(), "\"ph\":\"X\"") != 0)
+        {
+            r.finite = false;
+        }
+        report<double>("Trace export", r);
+    }
+
+    void parseArgs(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (std::strcmp(argv[i], "--verbose") == 0)
+            {
+                opt.verbose = true;
+            }
+            else if (std::strcmp(argv[i], "--float-ulps") == 0 && i + 1 < argc)
+            {
+                opt.floatUlps = std::atof(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--double-ulps") == 0 && i + 1 < argc)
+            {
+                opt.doubleUlps = std::atof(argv[++i]);
+            }
+            else if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            {
+                opt.numSamples = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+            }
+            else
+            {
+                std::fprintf(stderr, "Usage: %s [--verbose] [--float-ulps <n>] [--double-ulps <n>] [--samples <per case>]\n", argv[0]);
+                std::exit(1);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    parseArgs(argc, argv);
+
+    testPresetBank();
+    testTrace();
+    run<double>();
+    run<float>();
+
+    std::printf("%d of %d cases within tolerance (float %.1f ulp, double %.1f ulp)\n",
+                numCases - numFailed, numCases, opt.floatUlps, opt.doubleUlps);
+    return numFailed > 0 ? 1 : 0;
+}